@@ -0,0 +1,99 @@
+/*
+ * Micro-benchmark of the conversion kernels in src/matio/read_data.c,
+ * for every combination of the type in the file, the output type and
+ * byte swapping.
+ *
+ * The data is converted a block of READ_BLOCK_SIZE bytes at a time, as
+ * when a variable is read. Build from the package directory after
+ * ./configure has written src/matio/config.h, with the flags R builds
+ * the package with, e.g.
+ *
+ *   CC=`R CMD config CC`
+ *   $CC `R CMD config CFLAGS` `R CMD config --cppflags` \
+ *       -DR_NO_REMAP -DSTRICT_R_HEADERS -Isrc/matio \
+ *       inst/benchmarks/convert.c src/matio/endian.c src/matio/inflate.c \
+ *       src/matio/mat.c src/matio/mat4.c src/matio/mat5.c \
+ *       src/matio/matvar_cell.c src/matio/matvar_struct.c \
+ *       src/matio/read_data.c `R CMD config --ldflags` -lz -o convert
+ *   ./convert [elements] [repetitions]
+ *
+ * and prints the throughput in million elements per second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "matio_private.h"
+
+#define READ_BLOCK_SIZE (16384)
+
+static const enum matio_types types[] = {
+    MAT_T_DOUBLE, MAT_T_SINGLE, MAT_T_INT64, MAT_T_UINT64, MAT_T_INT32,
+    MAT_T_UINT32, MAT_T_INT16, MAT_T_UINT16, MAT_T_INT8, MAT_T_UINT8
+};
+
+static const char *names[] = {
+    "double", "single", "int64", "uint64", "int32",
+    "uint32", "int16", "uint16", "int8", "uint8"
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+int
+main(int argc,char **argv)
+{
+    size_t n = argc > 1 ? (size_t)strtod(argv[1],NULL) : 10000000;
+    int reps = argc > 2 ? atoi(argv[2]) : 5;
+    size_t ntypes = sizeof(types)/sizeof(types[0]);
+    size_t i, j, k, block;
+    unsigned char *src, *dst;
+    int swap, r;
+
+    src = malloc(n*8);
+    dst = malloc(n*8);
+    if ( NULL == src || NULL == dst ) {
+        fprintf(stderr,"Couldn't allocate %lu elements\n",(unsigned long)n);
+        return 1;
+    }
+    /* Small values, that are in range of every type in either byte order */
+    for ( k = 0; k < n*8; k++ )
+        src[k] = (unsigned char)(k % 64);
+
+    printf("%-8s %-8s %-4s %10s\n","src","dst","swap","Melem/s");
+    for ( i = 0; i < ntypes; i++ ) {
+        size_t src_size = Mat_SizeOf(types[i]);
+        block = READ_BLOCK_SIZE / src_size;
+        for ( j = 0; j < ntypes; j++ ) {
+            size_t dst_size = Mat_SizeOf(types[j]);
+            for ( swap = 0; swap <= 1; swap++ ) {
+                double t, best = 0;
+                for ( r = 0; r < reps; r++ ) {
+                    t = now();
+                    for ( k = 0; k < n; k += block ) {
+                        size_t len = n - k < block ? n - k : block;
+                        ConvertData(dst + k*dst_size,types[j],
+                                    src + k*src_size,types[i],len,swap);
+                    }
+                    t = now() - t;
+                    if ( 0 == r || t < best )
+                        best = t;
+                }
+                printf("%-8s %-8s %-4d %10.1f\n",names[i],names[j],swap,
+                       1e-6*n/best);
+            }
+        }
+    }
+
+    free(src);
+    free(dst);
+
+    return 0;
+}
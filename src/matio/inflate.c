@@ -28,12 +28,47 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <limits.h>
 #include "matio_private.h"
 
 #if HAVE_ZLIB
 
 /** @cond mat_devman */
 
+/** @brief Reads compressed data into the input buffer of the MAT file
+ *
+ * Refills the input of the zlib stream with at most @c nbytes (and
+ * at least 1) bytes from the file. The input buffer is shared by the
+ * streams of the MAT file, any input left in it must be given back
+ * to the file with InflateSync before another stream refills it.
+ * @ingroup mat_internal
+ * @param mat Pointer to the MAT file
+ * @param z zlib compression stream
+ * @param nbytes Number of bytes wanted
+ * @return Number of bytes read from the file
+ */
+static size_t
+InflateFill(mat_t *mat, z_streamp z, size_t nbytes)
+{
+    if ( NULL == mat->zbuf ) {
+        mat->zbuf = malloc(mat->zbuf_size);
+        if ( NULL == mat->zbuf ) {
+            Mat_Critical("Couldn't allocate memory for the input buffer");
+            return 0;
+        }
+    }
+
+    if ( nbytes < 1 )
+        nbytes = 1;
+    else if ( nbytes > mat->zbuf_size )
+        nbytes = mat->zbuf_size;
+
+    z->next_in  = ZLIB_BYTE_PTR(mat->zbuf);
+    z->avail_in = (uInt)fread(mat->zbuf,1,nbytes,(FILE*)mat->fp);
+
+    return z->avail_in;
+}
+
 /** @brief Inflate the data until @c nbytes of uncompressed data has been
  *         inflated
  *
@@ -44,21 +79,18 @@
  * @return Number of bytes read from the file
  */
 size_t
-InflateSkip(mat_t *mat, z_streamp z, int nbytes)
+InflateSkip(mat_t *mat, z_streamp z, size_t nbytes)
 {
-    mat_uint8_t comp_buf[512],uncomp_buf[512];
-    int    n, err, cnt = 0;
-    size_t bytesread = 0;
+    mat_uint8_t uncomp_buf[512];
+    int    err;
+    size_t n, cnt = 0, bytesread = 0;
 
-    if ( nbytes < 1 )
+    if ( nbytes == 0 )
         return 0;
 
     n = (nbytes<512) ? nbytes : 512;
-    if ( !z->avail_in ) {
-        z->next_in = comp_buf;
-        z->avail_in += fread(comp_buf,1,n,(FILE*)mat->fp);
-        bytesread   += z->avail_in;
-    }
+    if ( !z->avail_in )
+        bytesread += InflateFill(mat,z,nbytes);
     z->avail_out = n;
     z->next_out  = uncomp_buf;
     err = inflate(z,Z_FULL_FLUSH);
@@ -76,9 +108,9 @@ InflateSkip(mat_t *mat, z_streamp z, int nbytes)
     }
     while ( cnt < nbytes ) {
         if ( !z->avail_in ) {
-            z->next_in   = comp_buf;
-            z->avail_in += fread(comp_buf,1,n,(FILE*)mat->fp);
-            bytesread   += z->avail_in;
+            if ( 0 == InflateFill(mat,z,nbytes-cnt) )
+                break;
+            bytesread += z->avail_in;
         }
         err = inflate(z,Z_FULL_FLUSH);
         if ( err == Z_STREAM_END ) {
@@ -95,14 +127,7 @@ InflateSkip(mat_t *mat, z_streamp z, int nbytes)
         }
     }
 
-    if ( z->avail_in ) {
-        long offset = -(long)z->avail_in;
-        (void)fseek((FILE*)mat->fp,offset,SEEK_CUR);
-        bytesread -= z->avail_in;
-        z->avail_in = 0;
-    }
-
-    return bytesread;
+    return bytesread - InflateSync(mat,z);
 }
 
 /** @brief Inflate the data until @c nbytes of compressed data has been
@@ -175,13 +200,13 @@ InflateSkip2(mat_t *mat, matvar_t *matvar, int nbytes)
  * @return Number of bytes read from the file
  */
 size_t
-InflateSkipData(mat_t *mat,z_streamp z,enum matio_types data_type,int len)
+InflateSkipData(mat_t *mat,z_streamp z,enum matio_types data_type,size_t len)
 {
-    int data_size = 0;
+    size_t data_size = 0;
 
     if ( (mat == NULL) || (z == NULL) )
         return 0;
-    else if ( len < 1 )
+    else if ( len == 0 )
         return 0;
 
     switch ( data_type ) {
@@ -652,76 +677,115 @@ InflateDataType(mat_t *mat, z_streamp z, void *buf)
     return bytesread;
 }
 
-/** @brief Inflates the data
+/** @brief Gives the unused input of the zlib stream back to the file
  *
- * buf must hold at least @c nBytes bytes
+ * Seeks back over the input read into the input buffer of the MAT file
+ * that hasn't been inflated, so that the file position is at the next
+ * compressed byte of the stream.
  * @ingroup mat_internal
  * @param mat Pointer to the MAT file
  * @param z zlib compression stream
- * @param buf Pointer to store the data type
+ * @return Number of bytes given back to the file
+ */
+size_t
+InflateSync(mat_t *mat, z_streamp z)
+{
+    size_t nbytes = z->avail_in;
+
+    if ( nbytes ) {
+        (void)fseek((FILE*)mat->fp,-(long)nbytes,SEEK_CUR);
+        z->avail_in = 0;
+    }
+
+    return nbytes;
+}
+
+/** @brief Inflates a block of a larger run of data
+ *
+ * Like InflateData, but the unused input is left in the stream for the
+ * next block instead of being given back to the file. The input buffer
+ * is refilled with the compressed data of up to @c nAhead uncompressed
+ * bytes at a time. The caller must call InflateSync after the last
+ * block, before the file or another stream is read.
+ * @ingroup mat_internal
+ * @param mat Pointer to the MAT file
+ * @param z zlib compression stream
+ * @param buf Pointer to store the data
  * @param nBytes Number of bytes to inflate
+ * @param nAhead Number of bytes left to inflate in the run, including
+ *        this block
  * @return Number of bytes read from the file
  */
 size_t
-InflateData(mat_t *mat, z_streamp z, void *buf, unsigned int nBytes)
+InflateDataBlock(mat_t *mat, z_streamp z, void *buf, size_t nBytes,
+    size_t nAhead)
 {
-    mat_uint8_t comp_buf[1024];
     int    err;
-    unsigned int bytesread = 0;
+    size_t bytesread = 0, remaining = nBytes;
 
     if ( buf == NULL )
         return 0;
     if ( nBytes == 0 ) {
         return bytesread;
     }
+    if ( nAhead < nBytes )
+        nAhead = nBytes;
 
-    if ( !z->avail_in ) {
-        if ( nBytes > 1024 ) {
-            z->avail_in = fread(comp_buf,1,1024,(FILE*)mat->fp);
-        } else {
-            z->avail_in = fread(comp_buf,1,nBytes,(FILE*)mat->fp);
-        }
-        bytesread += z->avail_in;
-        z->next_in = comp_buf;
-    }
-    z->avail_out = nBytes;
+    /* avail_out is an unsigned int, so larger data is inflated in
+     * chunks of at most UINT_MAX bytes */
     z->next_out = (Bytef*)buf;
-    err = inflate(z,Z_FULL_FLUSH);
-    if ( err == Z_STREAM_END ) {
-        return bytesread;
-    } else if ( err != Z_OK ) {
-        Mat_Critical("InflateData: inflate returned %s",zError( err == Z_NEED_DICT ? Z_DATA_ERROR : err ));
-        return bytesread;
-    }
-    while ( z->avail_out && !z->avail_in ) {
-        if ( nBytes > 1024 + bytesread ) {
-            z->avail_in = fread(comp_buf,1,1024,(FILE*)mat->fp);
-        } else if ( nBytes < 1 + bytesread ) { /* Read a byte at a time */
-            z->avail_in = fread(comp_buf,1,1,(FILE*)mat->fp);
-        } else {
-            z->avail_in = fread(comp_buf,1,nBytes-bytesread,(FILE*)mat->fp);
-        }
-        bytesread += z->avail_in;
-        z->next_in = comp_buf;
+    while ( remaining > 0 ) {
+        uInt n = (remaining > UINT_MAX) ? UINT_MAX : (uInt)remaining;
+
+        if ( !z->avail_in )
+            bytesread += InflateFill(mat,z,nAhead-(nBytes-remaining));
+        z->avail_out = n;
         err = inflate(z,Z_FULL_FLUSH);
-        if ( err == Z_STREAM_END ) {
-            break;
-        } else if ( err != Z_OK && err != Z_BUF_ERROR ) {
-            Mat_Critical("InflateData: inflate returned %s",zError(err == Z_NEED_DICT ? Z_DATA_ERROR : err));
-            break;
+        if ( err != Z_OK && err != Z_STREAM_END ) {
+            Mat_Critical("InflateData: inflate returned %s",zError( err == Z_NEED_DICT ? Z_DATA_ERROR : err ));
+            return bytesread;
         }
-    }
-
-    if ( z->avail_in ) {
-        long offset = -(long)z->avail_in;
-        (void)fseek((FILE*)mat->fp,offset,SEEK_CUR);
-        bytesread -= z->avail_in;
-        z->avail_in = 0;
+        while ( err != Z_STREAM_END && z->avail_out && !z->avail_in ) {
+            /* Refill with at most as many bytes as are left to inflate in
+             * the run, the compressed data is rarely larger */
+            if ( 0 == InflateFill(mat,z,nAhead-(nBytes-remaining)-(n-z->avail_out)) )
+                break;
+            bytesread += z->avail_in;
+            err = inflate(z,Z_FULL_FLUSH);
+            if ( err == Z_STREAM_END ) {
+                break;
+            } else if ( err != Z_OK && err != Z_BUF_ERROR ) {
+                Mat_Critical("InflateData: inflate returned %s",zError(err == Z_NEED_DICT ? Z_DATA_ERROR : err));
+                break;
+            }
+        }
+        if ( z->avail_out )
+            break;
+        remaining -= n;
     }
 
     return bytesread;
 }
 
+/** @brief Inflates the data
+ *
+ * buf must hold at least @c nBytes bytes. The unused input is given back
+ * to the file.
+ * @ingroup mat_internal
+ * @param mat Pointer to the MAT file
+ * @param z zlib compression stream
+ * @param buf Pointer to store the data type
+ * @param nBytes Number of bytes to inflate
+ * @return Number of bytes read from the file
+ */
+size_t
+InflateData(mat_t *mat, z_streamp z, void *buf, size_t nBytes)
+{
+    size_t bytesread = InflateDataBlock(mat,z,buf,nBytes,nBytes);
+
+    return bytesread - InflateSync(mat,z);
+}
+
 /** @brief Inflates the structure's fieldname length
  *
  * buf must hold at least 8 bytes
@@ -48,6 +48,13 @@
 #if defined(MAT73) && MAT73
 #   include "mat73.h"
 #endif
+#if defined(HAVE_MMAP)
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+#if defined(HAVE_PTHREAD) && defined(HAVE_OPEN_MEMSTREAM)
+#   include <pthread.h>
+#endif
 
 /*
  *===================================================================
@@ -55,6 +62,40 @@
  *===================================================================
  */
 
+/** @brief Maps a read only MAT file into memory
+ *
+ * Maps the whole file read only into memory. The file pointer is kept
+ * open, the mapping is only used to access uncompressed data, see
+ * Mat_VarGetDataPtr.
+ * @param mat MAT file pointer
+ * @retval 0 on success
+ */
+static int
+MapFile(mat_t *mat)
+{
+#if defined(HAVE_MMAP)
+    struct stat sb;
+    void *map;
+
+    if ( NULL == mat || NULL == mat->fp || NULL != mat->map )
+        return 1;
+    if ( 0 != fstat(fileno((FILE*)mat->fp),&sb) || sb.st_size <= 0 )
+        return 1;
+
+    map = mmap(NULL,(size_t)sb.st_size,PROT_READ,MAP_PRIVATE,
+               fileno((FILE*)mat->fp),0);
+    if ( MAP_FAILED == map )
+        return 1;
+
+    mat->map      = map;
+    mat->map_size = (size_t)sb.st_size;
+
+    return 0;
+#else
+    return 1;
+#endif
+}
+
 static void
 ReadData(mat_t *mat, matvar_t *matvar)
 {
@@ -71,6 +112,255 @@ ReadData(mat_t *mat, matvar_t *matvar)
     return;
 }
 
+#if defined(HAVE_PTHREAD) && defined(HAVE_OPEN_MEMSTREAM)
+/** @brief A variable to compress on a writer thread
+ *
+ * @ingroup mat_internal
+ */
+struct MatWriteJob {
+    matvar_t *matvar;          /**< Variable to write, freed when written */
+    int compress;              /**< Compression of the variable */
+    int level;                 /**< zlib compression level */
+    enum matio_compression_strategy strategy; /**< zlib strategy */
+    size_t wbuf_size;          /**< Size of the output buffer */
+    char *buf;                 /**< The compressed variable */
+    size_t size;               /**< Size of the compressed variable in bytes */
+    int err;                   /**< Non-zero if the compression failed */
+    int done;                  /**< Non-zero when the job is compressed */
+    struct MatWriteJob *next;  /**< Next variable, in file order */
+};
+
+/** @brief Threads that compress variables, see Mat_SetWriteThreads
+ *
+ * The jobs are kept in file order. The threads take the jobs from
+ * @c todo on, and the calling thread writes the compressed jobs from
+ * @c head on to the file.
+ * @ingroup mat_internal
+ */
+struct MatWriter {
+    pthread_mutex_t lock;      /**< Protects the jobs and stop */
+    pthread_cond_t cond;       /**< Signals new and compressed jobs */
+    pthread_t *threads;        /**< The threads */
+    int nthreads;              /**< Number of threads */
+    int stop;                  /**< Non-zero to stop the threads */
+    int err;                   /**< Non-zero if a variable failed */
+    size_t njobs;              /**< Number of jobs not written yet */
+    struct MatWriteJob *head;  /**< Next job to write to the file */
+    struct MatWriteJob *tail;  /**< Last job */
+    struct MatWriteJob *todo;  /**< Next job to compress */
+};
+
+/** @brief Compresses a variable into memory
+ *
+ * Writes the variable with Mat_VarWrite5 to a memory stream. Only the
+ * job is used, not the MAT file, so the function can run on any
+ * thread.
+ * @ingroup mat_internal
+ * @param job The variable to compress
+ * @retval 0 on success
+ */
+static int
+WriterCompress(struct MatWriteJob *job)
+{
+    mat_t mat;
+    FILE *fp;
+    int err;
+
+    fp = open_memstream(&job->buf,&job->size);
+    if ( NULL == fp )
+        return 1;
+
+    memset(&mat,0,sizeof(mat));
+    mat.fp      = fp;
+    mat.version = MAT_FT_MAT5;
+    mat.compression_level    = job->level;
+    mat.compression_strategy = job->strategy;
+    mat.wbuf_size = job->wbuf_size;
+    err = Mat_VarWrite5(&mat,job->matvar,job->compress);
+    free(mat.wbuf);
+    if ( 0 != fclose(fp) )
+        err = 1;
+
+    return err;
+}
+
+/** @brief Thread function of the writer
+ *
+ * Compresses the jobs, in file order, until the writer is stopped.
+ * @ingroup mat_internal
+ * @param arg The writer
+ * @return NULL
+ */
+static void *
+WriterThread(void *arg)
+{
+    struct MatWriter *w = (struct MatWriter*)arg;
+    struct MatWriteJob *job;
+
+    for ( ;; ) {
+        pthread_mutex_lock(&w->lock);
+        while ( NULL == w->todo && !w->stop )
+            pthread_cond_wait(&w->cond,&w->lock);
+        job = w->todo;
+        if ( NULL != job )
+            w->todo = job->next;
+        pthread_mutex_unlock(&w->lock);
+        if ( NULL == job )
+            break;
+
+        job->err = WriterCompress(job);
+
+        pthread_mutex_lock(&w->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    return NULL;
+}
+
+/** @brief Writes the compressed variables to the file
+ *
+ * Writes the jobs in file order, waiting for them to be compressed,
+ * until at most @c njobs jobs are left.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param njobs Number of jobs to leave to the threads
+ * @retval 0 on success
+ */
+static int
+WriterFlush(mat_t *mat,size_t njobs)
+{
+    struct MatWriter *w = (struct MatWriter*)mat->writer;
+    struct MatWriteJob *job;
+
+    while ( w->njobs > njobs ) {
+        pthread_mutex_lock(&w->lock);
+        job = w->head;
+        while ( !job->done )
+            pthread_cond_wait(&w->cond,&w->lock);
+        w->head = job->next;
+        if ( NULL == w->head )
+            w->tail = NULL;
+        w->njobs--;
+        pthread_mutex_unlock(&w->lock);
+
+        if ( job->err ) {
+            w->err = 1;
+        } else {
+            (void)fseek((FILE*)mat->fp,0,SEEK_END);
+            if ( fwrite(job->buf,1,job->size,(FILE*)mat->fp) != job->size )
+                w->err = 1;
+        }
+        free(job->buf);
+        Mat_VarFree(job->matvar);
+        free(job);
+    }
+
+    return w->err;
+}
+
+/** @brief Stops the threads of the writer
+ *
+ * Writes the remaining variables, then stops the threads and frees
+ * the writer.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @retval 0 on success
+ */
+static int
+WriterStop(mat_t *mat)
+{
+    struct MatWriter *w = (struct MatWriter*)mat->writer;
+    int i, err;
+
+    if ( NULL == w )
+        return 0;
+
+    err = WriterFlush(mat,0);
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    for ( i = 0; i < w->nthreads; i++ )
+        pthread_join(w->threads[i],NULL);
+
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    free(w->threads);
+    free(w);
+    mat->writer = NULL;
+
+    return err;
+}
+#else
+static int
+WriterStop(mat_t *mat)
+{
+    return 0;
+}
+#endif
+
+/** @brief Checks if a variable name is in the directory of the file
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param name Name of the variable
+ * @retval 1 if the variable exists
+ */
+static int
+DirContains(mat_t *mat,const char *name)
+{
+    size_t i;
+
+    if ( NULL == mat->dir ) {
+        size_t n = 0;
+        (void)Mat_GetDir(mat, &n);
+    }
+
+    for ( i = 0; i < mat->num_datasets; i++ ) {
+        if ( NULL != mat->dir[i] && NULL != name &&
+            0 == strcmp(mat->dir[i], name) )
+            return 1;
+    }
+
+    return 0;
+}
+
+/** @brief Adds a variable name to the directory of the file
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param name Name of the variable, or NULL
+ * @retval 0 on success
+ */
+static int
+DirAdd(mat_t *mat,const char *name)
+{
+    char **dir;
+
+    if ( NULL == mat->dir ) {
+        dir = (char**)malloc(sizeof(char*));
+    } else {
+        dir = (char**)realloc(mat->dir,
+        (mat->num_datasets + 1)*(sizeof(char*)));
+    }
+    if ( NULL == dir ) {
+        Mat_Critical("Couldn't allocate memory for the directory");
+        return 3;
+    }
+
+    mat->dir = dir;
+    if ( NULL != name ) {
+        mat->dir[mat->num_datasets++] = strdup_printf("%s", name);
+    } else {
+        mat->dir[mat->num_datasets++] = NULL;
+    }
+
+    return 0;
+}
+
 /* Stefan Widgren 2014-01-04: Mat_SizeOf moved from io.c */
 
 /** @brief Calculate the size of MAT data types
@@ -292,6 +582,8 @@ Mat_CreateVer(const char *matname,const char *hdr_str,enum mat_ft mat_file_ver)
  * @ingroup MAT
  * @param matname Name of MAT file to open
  * @param mode File access mode (MAT_ACC_RDONLY,MAT_ACC_RDWR,etc).
+ *        MAT_ACC_RDONLY|MAT_ACC_MMAP also maps a version 4 or 5 file
+ *        into memory, see Mat_VarGetDataPtr.
  * @return A pointer to the MAT file or NULL if it failed.  This is not a
  * simple FILE * and should not be used as one.
  */
@@ -310,7 +602,7 @@ Mat_Open(const char *matname,int mode)
     } else if ( (mode & 0x01) == MAT_ACC_RDWR ) {
         fp = fopen( matname, "r+b" );
         if ( !fp ) {
-            mat = Mat_CreateVer(matname,NULL,(enum mat_ft)(mode&0xfffffffe));
+            mat = Mat_CreateVer(matname,NULL,(enum mat_ft)(mode&0xfffffffc));
             return mat;
         }
     } else {
@@ -318,6 +610,11 @@ Mat_Open(const char *matname,int mode)
         return NULL;
     }
 
+    /* The tags are read a few bytes at a time, a large file buffer
+     * saves a read from the file for most of them. The size is only a
+     * hint, glibc keeps its default buffer of a file system block. */
+    (void)setvbuf(fp,NULL,_IOFBF,MAT_BUFFER_SIZE);
+
     mat = (mat_t*)malloc(sizeof(*mat));
     if ( NULL == mat ) {
         fclose(fp);
@@ -349,6 +646,19 @@ Mat_Open(const char *matname,int mode)
     mat->refs_id       = -1;
 #endif
     mat->dir           = NULL;
+    mat->map           = NULL;
+    mat->map_size      = 0;
+    mat->zbuf          = NULL;
+    mat->zbuf_size     = MAT_BUFFER_SIZE;
+    mat->writer        = NULL;
+    mat->write_threads = 0;
+    mat->compression_level    = -1;
+    mat->compression_strategy = MAT_STRATEGY_DEFAULT;
+    mat->wbuf          = NULL;
+    mat->wbuf_size     = MAT_WRITE_BUFFER_SIZE;
+    mat->wbuf_len      = 0;
+    mat->wbytes        = 0;
+    mat->wcount        = 0;
 
     bytesread += fread(mat->header,1,116,fp);
     mat->header[116] = '\0';
@@ -423,6 +733,12 @@ Mat_Open(const char *matname,int mode)
     mat->filename = strdup_printf("%s",matname);
     mat->mode = mode;
 
+    /* The mapping is optional, the file is read through the file
+     * pointer if the file can't be mapped. */
+    if ( (mode & MAT_ACC_MMAP) && (mode & 0x01) == MAT_ACC_RDONLY &&
+         (mat->version == MAT_FT_MAT5 || mat->version == MAT_FT_MAT4) )
+        (void)MapFile(mat);
+
     if ( mat->version == 0x0200 ) {
         fclose((FILE*)mat->fp);
 #if defined(MAT73) && MAT73
@@ -472,6 +788,8 @@ Mat_Close( mat_t *mat )
     int err = 0;
 
     if ( NULL != mat ) {
+        if ( WriterStop(mat) )
+            err = 1;
 #if defined(MAT73) && MAT73
         if ( mat->version == 0x0200 ) {
             if ( mat->refs_id > -1 )
@@ -481,9 +799,17 @@ Mat_Close( mat_t *mat )
             free(mat->fp);
             mat->fp = NULL;
         }
+#endif
+#if defined(HAVE_MMAP)
+        if ( NULL != mat->map )
+            munmap(mat->map,mat->map_size);
 #endif
         if ( NULL != mat->fp )
             fclose((FILE*)mat->fp);
+        if ( NULL != mat->zbuf )
+            free(mat->zbuf);
+        if ( NULL != mat->wbuf )
+            free(mat->wbuf);
         if ( NULL != mat->header )
             free(mat->header);
         if ( NULL != mat->subsys_offset )
@@ -504,6 +830,159 @@ Mat_Close( mat_t *mat )
     return err;
 }
 
+/** @brief Sets the size of the input buffer for compressed data
+ *
+ * Sets the size of the buffer that compressed data is read into
+ * before it's inflated. A larger buffer means fewer reads from the
+ * file for large compressed variables. The default size is 256 KB,
+ * sizes between 256 KB and 4 MB are reasonable.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param size Size of the buffer in bytes, at least 1024
+ * @retval 0 on success
+ */
+int
+Mat_SetBufferSize(mat_t *mat, size_t size)
+{
+    if ( NULL == mat || size < 1024 )
+        return 1;
+
+    /* The buffer is allocated again on the next read */
+    if ( NULL != mat->zbuf ) {
+        free(mat->zbuf);
+        mat->zbuf = NULL;
+    }
+    mat->zbuf_size = size;
+
+    return 0;
+}
+
+/** @brief Sets the size of the output buffer of a MAT file
+ *
+ * Sets the size of the buffer that variables are written to, after
+ * compression, before they are written to the file. A larger buffer
+ * means fewer writes to the file for large variables and for many
+ * small variables. The default size is 64 KB.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param size Size of the buffer in bytes, at least 1024
+ * @retval 0 on success
+ */
+int
+Mat_SetWriteBufferSize(mat_t *mat, size_t size)
+{
+    if ( NULL == mat || size < 1024 )
+        return 1;
+
+    /* The buffer is empty between two variables, and it is
+     * allocated again on the next write */
+    if ( NULL != mat->wbuf ) {
+        free(mat->wbuf);
+        mat->wbuf = NULL;
+    }
+    mat->wbuf_size = size;
+
+    return 0;
+}
+
+/** @brief Sets the number of threads that compress variables
+ *
+ * Starts (or stops) threads that compress the variables written
+ * with Mat_VarWriteAsync to a version 5 MAT file, one variable per
+ * thread. Each variable is compressed in memory, and the compressed
+ * variables are written to the file in order. The threads are
+ * stopped by Mat_Close. Without support for threads, the variables
+ * are compressed on the calling thread.
+ *
+ * Large numeric data is instead split into blocks of
+ * MAT_DEFLATE_BLOCK_SIZE bytes that are compressed in parallel on
+ * @c nthreads threads, and joined into one zlib stream.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param nthreads Number of threads, less than 2 to stop the threads
+ * @retval 0 on success
+ */
+int
+Mat_SetWriteThreads(mat_t *mat, int nthreads)
+{
+    int err;
+#if defined(HAVE_PTHREAD) && defined(HAVE_OPEN_MEMSTREAM)
+    struct MatWriter *w;
+#endif
+
+    if ( NULL == mat )
+        return 1;
+
+    err = WriterStop(mat);
+    mat->write_threads = 0;
+    if ( nthreads < 2 || MAT_FT_MAT5 != mat->version )
+        return err;
+    mat->write_threads = nthreads;
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_OPEN_MEMSTREAM)
+    w = (struct MatWriter*)calloc(1,sizeof(*w));
+    if ( NULL == w )
+        return 1;
+    w->threads = (pthread_t*)malloc(nthreads*sizeof(*w->threads));
+    if ( NULL == w->threads ) {
+        free(w);
+        return 1;
+    }
+    pthread_mutex_init(&w->lock,NULL);
+    pthread_cond_init(&w->cond,NULL);
+    for ( ; w->nthreads < nthreads; w->nthreads++ ) {
+        if ( pthread_create(w->threads+w->nthreads,NULL,WriterThread,w) )
+            break;
+    }
+    mat->writer = w;
+    if ( 0 == w->nthreads )
+        err = WriterStop(mat);
+#endif
+
+    return err;
+}
+
+/** @brief Sets the zlib compression level and strategy
+ *
+ * Sets the compression level and strategy of the variables written
+ * with compression to a version 5 MAT file from now on. A lower level
+ * compresses faster, to larger files.
+ *
+ * With the level MAT_COMPRESSION_LEVEL_AUTO, the level and strategy
+ * of each numeric variable are picked from a sample of its data: the
+ * fastest setting that compresses the sample within 5% of the best
+ * setting. The strategy is then not used.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param level Compression level from 0 (no compression) to 9 (best
+ *              compression), -1 for the default level (6), or
+ *              MAT_COMPRESSION_LEVEL_AUTO
+ * @param strategy Compression strategy
+ * @retval 0 on success
+ */
+int
+Mat_SetCompression(mat_t *mat, int level,
+    enum matio_compression_strategy strategy)
+{
+    if ( NULL == mat || level < MAT_COMPRESSION_LEVEL_AUTO || level > 9 )
+        return 1;
+
+    switch ( strategy ) {
+        case MAT_STRATEGY_DEFAULT:
+        case MAT_STRATEGY_FILTERED:
+        case MAT_STRATEGY_HUFFMAN_ONLY:
+        case MAT_STRATEGY_RLE:
+            break;
+        default:
+            return 1;
+    }
+
+    mat->compression_level    = level;
+    mat->compression_strategy = strategy;
+
+    return 0;
+}
+
 /** @brief Gets the filename for the given MAT file
  *
  * Gets the filename for the given MAT file
@@ -686,6 +1165,56 @@ Mat_Rewind( mat_t *mat )
     return err;
 }
 
+/** @brief Sets the position in a MAT file to a variable
+ *
+ * Positions the MAT file at the variable that starts @c offset bytes
+ * from the beginning of the file, so that the next call to
+ * @ref Mat_VarReadNext or @ref Mat_VarReadNextInfo reads that
+ * variable without scanning the preceding variables.  The offset is
+ * typically obtained from @ref Mat_VarGetFilePos.  Not supported for
+ * version 7.3 MAT files.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param offset Offset from the beginning of the MAT file to a variable
+ * @retval 0 on success
+ */
+int
+Mat_Seek( mat_t *mat, long offset )
+{
+    return Mat_Seek64(mat,offset);
+}
+
+/** @brief Sets the position in a MAT file to a variable at a 64-bit offset
+ *
+ * Like @ref Mat_Seek, for offsets beyond the range of @c long where
+ * it has 32 bits, e.g. on 64-bit Windows.  The file is positioned with
+ * @c _fseeki64 on Windows and @c fseeko where available.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param offset Offset from the beginning of the MAT file to a variable
+ * @retval 0 on success, or -1 if the platform can't seek to the offset
+ */
+int
+Mat_Seek64( mat_t *mat, mat_off_t offset )
+{
+    if ( NULL == mat || mat->version == MAT_FT_MAT73 || offset < mat->bof )
+        return -1;
+#if defined(_WIN32)
+    if ( _fseeki64((FILE*)mat->fp,offset,SEEK_SET) )
+        return -1;
+#elif defined(HAVE_FSEEKO)
+    if ( (mat_off_t)(off_t)offset != offset ||
+         fseeko((FILE*)mat->fp,(off_t)offset,SEEK_SET) )
+        return -1;
+#else
+    if ( offset > LONG_MAX ||
+         fseek((FILE*)mat->fp,(long)offset,SEEK_SET) )
+        return -1;
+#endif
+
+    return 0;
+}
+
 /** @brief Returns the size of a Matlab Class
  *
  * Returns the size (in bytes) of the matlab class class_type
@@ -770,7 +1299,10 @@ Mat_VarCalloc(void)
             matvar->internal->hdf5_ref   =  0;
             matvar->internal->id         = -1;
 #endif
+            matvar->internal->fpos       = -1L;
+            matvar->internal->fnbytes    = 0;
             matvar->internal->datapos    = 0;
+            matvar->internal->wnbytes    = 0;
             matvar->internal->num_fields = 0;
             matvar->internal->fieldnames = NULL;
 #if defined(HAVE_ZLIB)
@@ -1071,6 +1603,8 @@ Mat_VarDuplicate(const matvar_t *in, int opt)
         out->internal->hdf5_ref = in->internal->hdf5_ref;
         out->internal->id       = in->internal->id;
 #endif
+        out->internal->fpos     = in->internal->fpos;
+        out->internal->fnbytes  = in->internal->fnbytes;
         out->internal->datapos  = in->internal->datapos;
 #if defined(HAVE_ZLIB)
         out->internal->z        = NULL;
@@ -1572,6 +2106,102 @@ Mat_CalcSubscripts2(int rank,size_t *dims,size_t index)
     return subs;
 }
 
+/** @brief Returns the location of a variable in the MAT file
+ *
+ * Returns the offset from the beginning of the MAT file and the
+ * number of bytes in the file of a variable read with one of the
+ * Mat_VarReadNextInfo functions.  For compressed variables the number
+ * of bytes is the compressed size.
+ * @ingroup MAT
+ * @param matvar MAT variable
+ * @param[out] offset Offset from the beginning of the MAT file
+ * @param[out] nbytes Number of bytes of the variable in the MAT file
+ * @retval 0 on success
+ * @retval 1 if the location is unknown, e.g. for a created variable
+ */
+int
+Mat_VarGetFilePos(const matvar_t *matvar,long *offset,long *nbytes)
+{
+    if ( NULL == matvar || NULL == matvar->internal ||
+         matvar->internal->fpos == -1L )
+        return 1;
+
+    if ( NULL != offset )
+        *offset = matvar->internal->fpos;
+    if ( NULL != nbytes )
+        *nbytes = matvar->internal->fnbytes;
+
+    return 0;
+}
+
+/** @brief Returns a pointer to the data of a variable in a mapped MAT file
+ *
+ * Returns a pointer into the memory mapping of a MAT file opened with
+ * MAT_ACC_MMAP to the data of a real, uncompressed variable stored as
+ * double in the byte order of the machine. The data can be used
+ * without reading or converting it.  The pointer is valid until the
+ * MAT file is closed and must not be written to.
+ * @ingroup MAT
+ * @param mat MAT file pointer, opened with MAT_ACC_MMAP
+ * @param matvar MAT variable, from one of the Mat_VarReadNextInfo
+ *        functions
+ * @param[out] data Pointer to the data
+ * @retval 0 on success
+ * @retval 1 if the data is not available in the mapping
+ */
+int
+Mat_VarGetDataPtr(mat_t *mat,matvar_t *matvar,const void **data)
+{
+    const char *ptr;
+    size_t nelems = 1, nbytes;
+    long datapos;
+
+    if ( NULL == mat || NULL == mat->map || NULL == matvar ||
+         NULL == matvar->internal || NULL == data )
+        return 1;
+    if ( matvar->isComplex || matvar->isLogical || mat->byteswap ||
+         MAT_COMPRESSION_NONE != matvar->compression ||
+         MAT_C_DOUBLE != matvar->class_type )
+        return 1;
+    if ( SafeMulDims(matvar, &nelems) ||
+         SafeMul(&nbytes, nelems, sizeof(double)) )
+        return 1;
+
+    datapos = matvar->internal->datapos;
+    if ( datapos < 0 )
+        return 1;
+
+    if ( MAT_FT_MAT5 == mat->version ) {
+        mat_uint32_t tag[2];
+
+        /* The data element starts with a tag with the type and size */
+        if ( (size_t)datapos + 8 > mat->map_size )
+            return 1;
+        memcpy(tag,(const char*)mat->map + datapos,8);
+        if ( MAT_T_DOUBLE != tag[0] || nbytes != tag[1] )
+            return 1;
+        datapos += 8;
+    } else if ( MAT_FT_MAT4 == mat->version ) {
+        if ( MAT_T_DOUBLE != matvar->data_type )
+            return 1;
+    } else {
+        return 1;
+    }
+
+    if ( (size_t)datapos > mat->map_size ||
+         nbytes > mat->map_size - (size_t)datapos )
+        return 1;
+
+    /* The name of a version 4 variable can leave the data unaligned */
+    ptr = (const char*)mat->map + datapos;
+    if ( 0 != ((size_t)ptr % sizeof(double)) )
+        return 1;
+
+    *data = ptr;
+
+    return 0;
+}
+
 /** @brief Calculates the size of a matlab variable in bytes
  *
  * @ingroup MAT
@@ -1993,8 +2623,8 @@ Mat_VarReadDataAll(mat_t *mat,matvar_t *matvar)
  * @retval 0 on success
  */
 int
-Mat_VarReadDataLinear(mat_t *mat,matvar_t *matvar,void *data,int start,
-    int stride,int edge)
+Mat_VarReadDataLinear(mat_t *mat,matvar_t *matvar,void *data,size_t start,
+    size_t stride,size_t edge)
 {
     int err = 0;
 
@@ -2036,6 +2666,122 @@ Mat_VarReadDataLinear(mat_t *mat,matvar_t *matvar,void *data,int start,
     return err;
 }
 
+/** @brief Reads all the data of a real numeric MAT variable into a buffer
+ *
+ * Reads all the data of a real (not complex) numeric MAT variable
+ * into a pre-allocated buffer, converted to the type of the class
+ * @c class_type, e.g. MAT_C_DOUBLE to read the data as double. The
+ * data is decoded directly into the buffer without an intermediate
+ * copy. The variable must have been read by Mat_VarReadInfo or
+ * Mat_VarReadNextInfo. The file position is not changed.
+ * @ingroup MAT
+ * @param mat MAT file to read data from
+ * @param matvar MAT variable information
+ * @param data pointer to store data in (must be pre-allocated with
+ *        room for all the elements of the variable)
+ * @param class_type class type of the data to store
+ * @retval 0 on success
+ */
+int
+Mat_VarReadDataAs(mat_t *mat,matvar_t *matvar,void *data,
+    enum matio_classes class_type)
+{
+    int err = 0;
+
+    if ( (mat == NULL) || (matvar == NULL) || (data == NULL) )
+        return 1;
+
+    switch ( class_type ) {
+        case MAT_C_DOUBLE:
+        case MAT_C_SINGLE:
+        case MAT_C_INT64:
+        case MAT_C_UINT64:
+        case MAT_C_INT32:
+        case MAT_C_UINT32:
+        case MAT_C_INT16:
+        case MAT_C_UINT16:
+        case MAT_C_INT8:
+        case MAT_C_UINT8:
+            break;
+        default:
+            return -1;
+    }
+
+    if ( MAT_C_DOUBLE == class_type && NULL != mat->map ) {
+        const void *ptr;
+        size_t nelems = 1;
+
+        /* Copy the data from the mapping, no conversion needed */
+        if ( 0 == Mat_VarGetDataPtr(mat,matvar,&ptr) &&
+             0 == SafeMulDims(matvar,&nelems) ) {
+            memcpy(data,ptr,nelems*sizeof(double));
+            return 0;
+        }
+    }
+
+    switch ( mat->version ) {
+        case MAT_FT_MAT5:
+            err = Mat_VarReadDataAs5(mat,matvar,data,class_type);
+            break;
+        case MAT_FT_MAT73:
+#if defined(MAT73) && MAT73
+            err = Mat_VarReadDataAs73(mat,matvar,data,class_type);
+#else
+            err = 1;
+#endif
+            break;
+        case MAT_FT_MAT4:
+            err = Mat_VarReadDataAs4(mat,matvar,data,class_type);
+            break;
+        default:
+            err = 2;
+            break;
+    }
+
+    return err;
+}
+
+/** @brief Reads all the data of several real numeric MAT variables
+ *
+ * Reads the data of @c n variables as Mat_VarReadDataAs. The
+ * compressed variables of a version 5 MAT file that are read as
+ * MAT_C_DOUBLE or MAT_C_INT32 are inflated concurrently on up to
+ * @c nthreads threads, when matio is built with pthreads. Each
+ * variable can only be read once with this function.
+ * @ingroup MAT
+ * @param mat MAT file to read data from
+ * @param matvars MAT variables from Mat_VarReadNextInfo
+ * @param data pointers to store the data of each variable in
+ * @param class_types class type of the data to store of each variable
+ * @param n number of variables
+ * @param nthreads maximum number of threads to use
+ * @retval 0 on success
+ */
+int
+Mat_VarReadDataAsParallel(mat_t *mat,matvar_t **matvars,void **data,
+    const enum matio_classes *class_types,size_t n,int nthreads)
+{
+    size_t i;
+    int err = 0;
+
+    if ( (mat == NULL) || (matvars == NULL) || (data == NULL) ||
+         (class_types == NULL) )
+        return 1;
+
+    switch ( mat->version ) {
+        case MAT_FT_MAT5:
+            err = Mat_VarReadDataAsParallel5(mat,matvars,data,class_types,
+                                             n,nthreads);
+            break;
+        default:
+            for ( i = 0; i < n && !err; i++ )
+                err = Mat_VarReadDataAs(mat,matvars[i],data[i],class_types[i]);
+            break;
+    }
+
+    return err;
+}
+
 /** @brief Reads the information of the next variable in a MAT file
  *
  * Reads the next variable's information (class,flags-complex/global/logical,
@@ -2075,6 +2821,75 @@ Mat_VarReadNextInfo( mat_t *mat )
     return matvar;
 }
 
+/** @brief Reads the header information of the next variable in a MAT file
+ *
+ * Reads the class, flags (complex/global/logical), rank, dimensions
+ * and name of the next variable without decoding the fields of
+ * structures, the elements of cell arrays or function handles.  This
+ * is cheaper than @ref Mat_VarReadNextInfo when only a listing of the
+ * variables in a file is needed.  After reading, the MAT file is
+ * positioned past the current variable.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @return Pointer to the @ref matvar_t structure containing the MAT
+ * variable information
+ */
+matvar_t *
+Mat_VarReadNextInfoShallow( mat_t *mat )
+{
+    if ( mat == NULL )
+        return NULL;
+    else if ( mat->version == MAT_FT_MAT5 )
+        return Mat_VarReadNextInfoShallow5(mat);
+
+    return Mat_VarReadNextInfo(mat);
+}
+
+/** @brief Reads the information of the next variable accepted by a predicate
+ *
+ * Reads the information of the next variable whose name is accepted
+ * by @c pred.  Rejected MAT5 variables are skipped by seeking past
+ * their tag, so their data (compressed or not) and nested struct/cell
+ * fields are never read.  After reading, the MAT file is positioned
+ * past the returned variable.  A negative value from @c pred stops
+ * the scan, and NULL is returned.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param pred Predicate on the variable name, or NULL to accept all
+ * @param user_data Data passed to the predicate
+ * @return Pointer to the @ref matvar_t structure containing the MAT
+ * variable information, or NULL if there are no more matching variables
+ */
+matvar_t *
+Mat_VarReadNextInfoPredicate(mat_t *mat,mat_iter_pred_t pred,
+    const void *user_data)
+{
+    matvar_t *matvar;
+
+    if ( mat == NULL )
+        return NULL;
+    else if ( pred == NULL )
+        return Mat_VarReadNextInfo(mat);
+
+    if ( mat->version == MAT_FT_MAT5 ) {
+        matvar = Mat_VarReadNextInfoPredicate5(mat,pred,user_data);
+    } else {
+        /* The header of a v4 or v7.3 variable does not contain any
+         * nested data, so filter after reading it */
+        while ( NULL != (matvar = Mat_VarReadNextInfo(mat)) ) {
+            int accept = pred(matvar->name,user_data);
+            if ( accept > 0 )
+                break;
+            Mat_VarFree(matvar);
+            matvar = NULL;
+            if ( accept < 0 )
+                break;
+        }
+    }
+
+    return matvar;
+}
+
 /** @brief Reads the information of a variable with the given name from a MAT file
  *
  * Reads the named variable (or the next variable if name is NULL) information
@@ -2208,6 +3023,45 @@ Mat_VarReadNext( mat_t *mat )
     return matvar;
 }
 
+/** @brief Reads the next variable accepted by a predicate in a MAT file
+ *
+ * Reads the next variable whose name is accepted by @c pred.  See
+ * @ref Mat_VarReadNextInfoPredicate for how rejected variables are
+ * skipped.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param pred Predicate on the variable name, or NULL to accept all
+ * @param user_data Data passed to the predicate
+ * @return Pointer to the @ref matvar_t structure containing the MAT
+ * variable information, or NULL if there are no more matching variables
+ */
+matvar_t *
+Mat_VarReadNextPredicate(mat_t *mat,mat_iter_pred_t pred,
+    const void *user_data)
+{
+    long fpos = 0;
+    matvar_t *matvar = NULL;
+
+    if ( mat->version != MAT_FT_MAT73 ) {
+        if ( feof((FILE *)mat->fp) )
+            return NULL;
+        /* Read position so we can reset the file position if an error occurs */
+        fpos = ftell((FILE*)mat->fp);
+        if ( fpos == -1L ) {
+            Mat_Critical("Couldn't determine file position");
+            return NULL;
+        }
+    }
+    matvar = Mat_VarReadNextInfoPredicate(mat,pred,user_data);
+    if ( matvar ) {
+        ReadData(mat,matvar);
+    } else if ( mat->version != MAT_FT_MAT73 ) {
+        (void)fseek((FILE*)mat->fp,fpos,SEEK_SET);
+    }
+
+    return matvar;
+}
+
 /** @brief Writes the given MAT variable to a MAT file
  *
  * Writes the MAT variable information stored in matvar to the given MAT file.
@@ -2273,26 +3127,33 @@ Mat_VarWrite(mat_t *mat,matvar_t *matvar,enum matio_compression compress)
     if ( NULL == mat || NULL == matvar )
         return -1;
 
-    if ( NULL == mat->dir ) {
-        size_t n = 0;
-        (void)Mat_GetDir(mat, &n);
+#if defined(HAVE_PTHREAD) && defined(HAVE_OPEN_MEMSTREAM)
+    /* Keep the variables in order after the ones from Mat_VarWriteAsync.
+     * No variable is left on the writer threads if an error is raised
+     * below. */
+    if ( NULL != mat->writer )
+        (void)WriterFlush(mat,0);
+#endif
+
+    /* Error if MAT variable already exists in MAT file */
+    if ( DirContains(mat,matvar->name) ) {
+        Mat_Critical("Variable %s already exists.", matvar->name);
+        return 1;
     }
 
-    {
-        /* Error if MAT variable already exists in MAT file */
-        size_t i;
-        for ( i = 0; i < mat->num_datasets; i++ ) {
-            if ( NULL != mat->dir[i] &&
-                0 == strcmp(mat->dir[i], matvar->name) ) {
-                Mat_Critical("Variable %s already exists.", matvar->name);
-                return 1;
-            }
-        }
+    if ( MAT_FT_MAT5 == mat->version && Mat_VarCheckSize5(matvar) ) {
+        Mat_Critical("Variable %s is too large for a version 5 MAT file.",
+                     matvar->name);
+        return 1;
     }
 
-    if ( mat->version == MAT_FT_MAT5 )
+    if ( mat->version == MAT_FT_MAT5 ) {
+        /* Mat_VarWrite5 also runs on the writer threads, so it returns
+         * the error and it is reported here */
         err = Mat_VarWrite5(mat,matvar,compress);
-    else if ( mat->version == MAT_FT_MAT73 )
+        if ( err && NULL != matvar->name )
+            Mat_Critical("Couldn't write variable %s.", matvar->name);
+    } else if ( mat->version == MAT_FT_MAT73 )
 #if defined(MAT73) && MAT73
         err = Mat_VarWrite73(mat,matvar,compress);
 #else
@@ -2303,28 +3164,126 @@ Mat_VarWrite(mat_t *mat,matvar_t *matvar,enum matio_compression compress)
     else
         err = 2;
 
-    if ( err == 0 ) {
-        /* Update directory */
-        char **dir;
-        if ( NULL == mat->dir ) {
-            dir = (char**)malloc(sizeof(char*));
-        } else {
-            dir = (char**)realloc(mat->dir,
-            (mat->num_datasets + 1)*(sizeof(char*)));
+    if ( err == 0 )
+        err = DirAdd(mat,matvar->name);
+
+    return err;
+}
+
+/** @brief Writes the given MAT variable to a MAT file, compressed on a thread
+ *
+ * Like Mat_VarWrite, but takes ownership of the MAT variable. If
+ * writer threads are started with Mat_SetWriteThreads, a compressed
+ * variable is compressed on one of the threads and the function
+ * returns without waiting for it. The variables are written to the
+ * file in the order of the calls, and each variable is freed with
+ * Mat_VarFree when written. The data of the variable must not be
+ * changed or freed until then, see Mat_VarWriteFlush.
+ * @ingroup MAT
+ * @param mat MAT file to write to
+ * @param matvar MAT variable information to write
+ * @param compress Whether or not to compress the data
+ * @retval 0 on success, non-zero if this or an earlier variable failed
+ */
+int
+Mat_VarWriteAsync(mat_t *mat,matvar_t *matvar,enum matio_compression compress)
+{
+    int err;
+#if defined(HAVE_PTHREAD) && defined(HAVE_OPEN_MEMSTREAM)
+    struct MatWriter *w;
+    struct MatWriteJob *job;
+#endif
+
+    if ( NULL == mat || NULL == matvar ) {
+        Mat_VarFree(matvar);
+        return -1;
+    }
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_OPEN_MEMSTREAM)
+    /* Large numeric data is split into blocks that are compressed in
+     * parallel, see WriteCompressedData */
+    w = (struct MatWriter*)mat->writer;
+    if ( NULL != w && MAT_COMPRESSION_ZLIB == compress &&
+         NULL != matvar->name &&
+         (MAT_C_CELL == matvar->class_type ||
+          MAT_C_STRUCT == matvar->class_type ||
+          MAT_C_SPARSE == matvar->class_type ||
+          matvar->nbytes < 16*(size_t)MAT_DEFLATE_BLOCK_SIZE) ) {
+        if ( DirContains(mat,matvar->name) ||
+             Mat_VarCheckSize5(matvar) ) {
+            /* Write the earlier variables before the error is raised,
+             * their data must not be in use on the threads then */
+            (void)WriterFlush(mat,0);
+            if ( DirContains(mat,matvar->name) )
+                Mat_Critical("Variable %s already exists.", matvar->name);
+            else
+                Mat_Critical("Variable %s is too large for a version 5 "
+                             "MAT file.", matvar->name);
+            Mat_VarFree(matvar);
+            return 1;
         }
-        if ( NULL != dir ) {
-            mat->dir = dir;
-            if ( NULL != matvar->name ) {
-                mat->dir[mat->num_datasets++] =
-                    strdup_printf("%s", matvar->name);
-            } else {
-                mat->dir[mat->num_datasets++] = NULL;
-            }
-        } else {
-            err = 3;
-            Mat_Critical("Couldn't allocate memory for the directory");
+
+        job = (struct MatWriteJob*)calloc(1,sizeof(*job));
+        if ( NULL == job || DirAdd(mat,matvar->name) ) {
+            free(job);
+            Mat_VarFree(matvar);
+            return 1;
         }
+        job->matvar   = matvar;
+        job->compress = compress;
+        job->level    = mat->compression_level;
+        job->strategy = mat->compression_strategy;
+        job->wbuf_size = mat->wbuf_size;
+
+        pthread_mutex_lock(&w->lock);
+        if ( NULL == w->tail )
+            w->head = job;
+        else
+            w->tail->next = job;
+        w->tail = job;
+        if ( NULL == w->todo )
+            w->todo = job;
+        w->njobs++;
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+
+        /* Limit the number of variables held in memory */
+        return WriterFlush(mat,2*(size_t)w->nthreads);
     }
+#endif
+
+    err = Mat_VarWrite(mat,matvar,compress);
+    Mat_VarFree(matvar);
+
+    return err;
+}
+
+/** @brief Waits for the variables written with Mat_VarWriteAsync
+ *
+ * Writes all the variables that are being compressed on the writer
+ * threads to the file, and flushes the file buffer of a version 4 or
+ * 5 MAT file so that the variables can be read while the file is
+ * still open.
+ * @ingroup MAT
+ * @param mat MAT file
+ * @retval 0 on success, non-zero if a variable failed
+ */
+int
+Mat_VarWriteFlush(mat_t *mat)
+{
+    int err = 0;
+
+    if ( NULL == mat )
+        return -1;
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_OPEN_MEMSTREAM)
+    if ( NULL != mat->writer )
+        err = WriterFlush(mat,0);
+#endif
+
+    if ( MAT_FT_MAT73 != mat->version && NULL != mat->fp &&
+         0 != fflush((FILE*)mat->fp) )
+        err = 1;
 
     return err;
 }
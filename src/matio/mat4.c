@@ -80,6 +80,19 @@ Mat_Create4(const char* matname)
     mat->refs_id       = -1;
 #endif
     mat->dir           = NULL;
+    mat->map           = NULL;
+    mat->map_size      = 0;
+    mat->zbuf          = NULL;
+    mat->zbuf_size     = MAT_BUFFER_SIZE;
+    mat->writer        = NULL;
+    mat->write_threads = 0;
+    mat->compression_level    = -1;
+    mat->compression_strategy = MAT_STRATEGY_DEFAULT;
+    mat->wbuf          = NULL;
+    mat->wbuf_size     = MAT_WRITE_BUFFER_SIZE;
+    mat->wbuf_len      = 0;
+    mat->wbytes        = 0;
+    mat->wcount        = 0;
 
     Mat_Rewind(mat);
 
@@ -641,7 +654,7 @@ Mat_VarReadData4(mat_t *mat,matvar_t *matvar,void *data,
             err = 1;
         else if ( (size_t)stride[1]*(edge[1]-1)+start[1]+1 > matvar->dims[1] )
             err = 1;
-        if ( matvar->isComplex ) {
+        else if ( matvar->isComplex ) {
             mat_complex_split_t *cdata = (mat_complex_split_t*)data;
             size_t nbytes = Mat_SizeOf(matvar->data_type);
             SafeMulDims(matvar, &nbytes);
@@ -687,8 +700,8 @@ Mat_VarReadData4(mat_t *mat,matvar_t *matvar,void *data,
  * @retval 0 on success
  */
 int
-Mat_VarReadDataLinear4(mat_t *mat,matvar_t *matvar,void *data,int start,
-                       int stride,int edge)
+Mat_VarReadDataLinear4(mat_t *mat,matvar_t *matvar,void *data,size_t start,
+                       size_t stride,size_t edge)
 {
     int err = 0;
     size_t nelems = 1;
@@ -718,6 +731,50 @@ Mat_VarReadDataLinear4(mat_t *mat,matvar_t *matvar,void *data,int start,
     return err;
 }
 
+/** @if mat_devman
+ * @brief Reads the data of a real numeric version 4 MAT variable
+ *
+ * Reads all the data of the variable into a pre-allocated buffer,
+ * converted to the type of @c class_type.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo4
+ * @param data Pointer to store the data, must have room for all the
+ *        elements of the variable
+ * @param class_type Class type of the data to store
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarReadDataAs4(mat_t *mat,matvar_t *matvar,void *data,
+    enum matio_classes class_type)
+{
+    int err;
+    size_t nelems = 1;
+    long fpos;
+
+    if ( matvar->isComplex || MAT_C_DOUBLE != matvar->class_type )
+        return 1;
+    err = SafeMulDims(matvar, &nelems);
+    if ( err ) {
+        Mat_Critical("Integer multiplication overflow");
+        return 1;
+    }
+    if ( 0 == nelems )
+        return 0;
+    fpos = ftell((FILE*)mat->fp);
+    if ( fpos == -1L ) {
+        Mat_Critical("Couldn't determine file position");
+        return 1;
+    }
+
+    (void)fseek((FILE*)mat->fp,matvar->internal->datapos,SEEK_SET);
+    ReadDataSlab1(mat,data,class_type,matvar->data_type,0,1,nelems);
+    (void)fseek((FILE*)mat->fp,fpos,SEEK_SET);
+
+    return 0;
+}
+
 /** @if mat_devman
  * @brief Reads the header information for the next MAT variable in a version 4 MAT file
  *
@@ -744,6 +801,7 @@ Mat_VarReadNextInfo4(mat_t *mat)
     else if ( NULL == (matvar = Mat_VarCalloc()) )
         return NULL;
 
+    matvar->internal->fpos = ftell((FILE*)mat->fp);
     err = fread(&tmp,sizeof(int),1,(FILE*)mat->fp);
     if ( !err ) {
         Mat_VarFree(matvar);
@@ -894,6 +952,9 @@ Mat_VarReadNextInfo4(mat_t *mat)
         nBytes = (long)tmp2;
     }
     (void)fseek((FILE*)mat->fp,nBytes,SEEK_CUR);
+    if ( matvar->internal->fpos != -1L )
+        matvar->internal->fnbytes = matvar->internal->datapos + nBytes -
+                                    matvar->internal->fpos;
 
     return matvar;
 }
@@ -39,8 +39,10 @@ EXTERN int       Mat_VarWrite4(mat_t *mat,matvar_t *matvar);
 EXTERN void      Mat_VarRead4(mat_t *mat, matvar_t *matvar);
 EXTERN int       Mat_VarReadData4(mat_t *mat,matvar_t *matvar,void *data,
                      int *start,int *stride,int *edge);
-EXTERN int       Mat_VarReadDataLinear4(mat_t *mat,matvar_t *matvar,void *data,int start,
-                     int stride,int edge);
+EXTERN int       Mat_VarReadDataLinear4(mat_t *mat,matvar_t *matvar,void *data,size_t start,
+                     size_t stride,size_t edge);
+EXTERN int       Mat_VarReadDataAs4(mat_t *mat,matvar_t *matvar,void *data,
+                     enum matio_classes class_type);
 EXTERN matvar_t *Mat_VarReadNextInfo4(mat_t *mat);
 
 #endif
@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <time.h>
+#include <limits.h>
 #if defined(_MSC_VER) || defined(__MINGW32__)
 #   define SIZE_T_FMTSTR "Iu"
 #   define strdup _strdup
@@ -43,6 +44,11 @@
 #endif
 #include "matio_private.h"
 #include "mat5.h"
+#if defined(HAVE_PTHREAD)
+#   include <errno.h>
+#   include <pthread.h>
+#   include <unistd.h>
+#endif
 
 /** Get type from tag */
 #define TYPE_FROM_TAG(a)          ( ((a) & 0x000000ff) <= MAT_T_FUNCTION ) ? (enum matio_types)((a) & 0x000000ff) : MAT_T_UNKNOWN
@@ -73,14 +79,26 @@ static size_t ReadRankDims(mat_t *mat, matvar_t *matvar, enum matio_types data_t
 static int    WriteType(mat_t *mat,matvar_t *matvar);
 static int    WriteCellArrayField(mat_t *mat,matvar_t *matvar );
 static int    WriteStructField(mat_t *mat,matvar_t *matvar);
-static int    WriteData(mat_t *mat,void *data,int N,enum matio_types data_type);
+static size_t WriteData(mat_t *mat,void *data,size_t N,enum matio_types data_type);
 static size_t Mat_WriteEmptyVariable5(mat_t *mat,const char *name,int rank,
                   size_t *dims);
+static int    Mat_WriteVariable5(mat_t *mat,matvar_t *matvar);
+static size_t BufWrite5(mat_t *mat,const void *data,size_t size,size_t count);
+static int    BufFlush5(mat_t *mat);
+static size_t CountBytes5(mat_t *mat,int (*write)(mat_t*,matvar_t*),
+                  matvar_t *matvar);
+static int    ElementSize5(mat_t *mat,int (*write)(mat_t*,matvar_t*),
+                  matvar_t *matvar);
+#if defined(HAVE_ZLIB)
+static size_t BufDeflate5(mat_t *mat,z_streamp z,int flush);
+static size_t BufDeflateData5(mat_t *mat,z_streamp z,const void *data,
+                  size_t nbytes);
+#endif
 static void   Mat_VarReadNumeric5(mat_t *mat,matvar_t *matvar,void *data,size_t N);
 #if defined(HAVE_ZLIB)
 static size_t WriteCompressedCharData(mat_t *mat,z_streamp z,void *data,int N,
                   enum matio_types data_type);
-static size_t WriteCompressedData(mat_t *mat,z_streamp z,void *data,int N,
+static size_t WriteCompressedData(mat_t *mat,z_streamp z,void *data,size_t N,
                   enum matio_types data_type);
 static size_t WriteCompressedTypeArrayFlags(mat_t *mat,matvar_t *matvar,
                   z_streamp z);
@@ -297,7 +315,6 @@ GetEmptyMatrixMaxBufSize(const char *name,int rank)
     return nBytes;
 }
 
-#if defined(HAVE_ZLIB)
 /** @brief determines the number of bytes needed to store the given variable
  *
  * @ingroup mat_internal
@@ -334,7 +351,6 @@ GetMatrixMaxBufSize(matvar_t *matvar)
 
     return nBytes;
 }
-#endif
 
 /** @if mat_devman
  * @brief Creates a new Matlab MAT version 5 file
@@ -385,6 +401,19 @@ Mat_Create5(const char *matname,const char *hdr_str)
     mat->refs_id       = -1;
 #endif
     mat->dir           = NULL;
+    mat->map           = NULL;
+    mat->map_size      = 0;
+    mat->zbuf          = NULL;
+    mat->zbuf_size     = MAT_BUFFER_SIZE;
+    mat->writer        = NULL;
+    mat->write_threads = 0;
+    mat->compression_level    = -1;
+    mat->compression_strategy = MAT_STRATEGY_DEFAULT;
+    mat->wbuf          = NULL;
+    mat->wbuf_size     = MAT_WRITE_BUFFER_SIZE;
+    mat->wbuf_len      = 0;
+    mat->wbytes        = 0;
+    mat->wcount        = 0;
 
     t = time(NULL);
     mat->fp       = fp;
@@ -418,6 +447,208 @@ Mat_Create5(const char *matname,const char *hdr_str)
     return mat;
 }
 
+/** @if mat_devman
+ * @brief Writes to the output buffer of the MAT file
+ *
+ * Variables are written through a buffer of @c mat->wbuf_size bytes,
+ * instead of one fwrite per tag, and data larger than the buffer is
+ * written directly. In a dry run
+ * (@c mat->wcount non-zero) the bytes are only counted, see
+ * CountBytes5. The buffer is flushed by BufFlush5.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param data Data to write
+ * @param size Size in bytes of each element
+ * @param count Number of elements
+ * @return Number of elements written
+ * @endif
+ */
+static size_t
+BufWrite5(mat_t *mat,const void *data,size_t size,size_t count)
+{
+    size_t nbytes = size*count;
+
+    mat->wbytes += nbytes;
+    if ( mat->wcount || 0 == nbytes )
+        return count;
+
+    if ( NULL == mat->wbuf )
+        mat->wbuf = malloc(mat->wbuf_size);
+    if ( NULL == mat->wbuf || nbytes > mat->wbuf_size - mat->wbuf_len ) {
+        if ( BufFlush5(mat) )
+            return 0;
+        if ( NULL == mat->wbuf || nbytes >= mat->wbuf_size )
+            return fwrite(data,size,count,(FILE*)mat->fp);
+    }
+    memcpy((mat_uint8_t*)mat->wbuf + mat->wbuf_len,data,nbytes);
+    mat->wbuf_len += nbytes;
+
+    return count;
+}
+
+/** @if mat_devman
+ * @brief Writes the output buffer of the MAT file to the file
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @retval 0 on success
+ * @endif
+ */
+static int
+BufFlush5(mat_t *mat)
+{
+    size_t nbytes = mat->wbuf_len;
+
+    mat->wbuf_len = 0;
+    if ( nbytes > 0 && nbytes != fwrite(mat->wbuf,1,nbytes,(FILE*)mat->fp) )
+        return 1;
+
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Counts the bytes that a write function writes
+ *
+ * Runs the write function as a dry run, so that the size of a matrix
+ * element is written before the element, without seeking back to it.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param write Function that writes the matrix element
+ * @param matvar pointer to the mat variable
+ * @return Number of bytes the function writes
+ * @endif
+ */
+static size_t
+CountBytes5(mat_t *mat,int (*write)(mat_t*,matvar_t*),matvar_t *matvar)
+{
+    size_t wbytes = mat->wbytes, nbytes;
+    int wcount = mat->wcount;
+
+    mat->wcount = 1;
+    mat->wbytes = 0;
+    write(mat,matvar);
+    nbytes = mat->wbytes;
+    mat->wcount = wcount;
+    mat->wbytes = wbytes;
+
+    return nbytes;
+}
+
+/** @if mat_devman
+ * @brief Returns the size of a cell or struct field element to write
+ *
+ * The dry run of a variable caches the size of each of its nested
+ * elements, so that an element isn't counted again at every level of
+ * nesting. The cached size is used once, an element without one,
+ * e.g. one that occurs twice in the variable, is counted.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param write Function that writes the element
+ * @param matvar pointer to the element
+ * @return Number of bytes of the element after its size
+ * @endif
+ */
+static int
+ElementSize5(mat_t *mat,int (*write)(mat_t*,matvar_t*),matvar_t *matvar)
+{
+    size_t nbytes;
+
+    if ( NULL != matvar->internal && matvar->internal->wnbytes > 0 ) {
+        nbytes = matvar->internal->wnbytes;
+        matvar->internal->wnbytes = 0;
+    } else {
+        nbytes = CountBytes5(mat,write,matvar) - 8;
+    }
+
+    return (int)nbytes;
+}
+
+#if defined(HAVE_ZLIB)
+/** @if mat_devman
+ * @brief Compresses the input of a zlib stream to the output buffer
+ *
+ * Deflates the input of @c z straight into the free space of the
+ * output buffer of the MAT file, and writes the buffer to the file
+ * when it is full, so that compressed variables are written in
+ * chunks of @c mat->wbuf_size bytes.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param z zlib stream
+ * @param flush zlib flush mode
+ * @return Number of compressed bytes
+ * @endif
+ */
+static size_t
+BufDeflate5(mat_t *mat,z_streamp z,int flush)
+{
+    size_t byteswritten = 0, nbytes;
+    int err;
+
+    if ( NULL == mat->wbuf )
+        mat->wbuf = malloc(mat->wbuf_size);
+    if ( NULL == mat->wbuf ) {
+        mat_uint8_t buf[1024];
+
+        do {
+            z->next_out  = buf;
+            z->avail_out = sizeof(buf);
+            err = deflate(z,flush);
+            byteswritten += fwrite(buf,1,sizeof(buf)-z->avail_out,(FILE*)mat->fp);
+        } while ( Z_STREAM_END != err && z->avail_out == 0 );
+        mat->wbytes += byteswritten;
+        return byteswritten;
+    }
+
+    do {
+        if ( mat->wbuf_len == mat->wbuf_size && BufFlush5(mat) )
+            break;
+        nbytes = mat->wbuf_size - mat->wbuf_len;
+        z->next_out  = (Bytef*)mat->wbuf + mat->wbuf_len;
+        z->avail_out = (uInt)nbytes;
+        err = deflate(z,flush);
+        nbytes -= z->avail_out;
+        mat->wbuf_len += nbytes;
+        byteswritten  += nbytes;
+    } while ( Z_STREAM_END != err && z->avail_out == 0 );
+    mat->wbytes += byteswritten;
+
+    return byteswritten;
+}
+
+/** @if mat_devman
+ * @brief Compresses a data buffer into the output buffer
+ *
+ * Like BufDeflate5 with Z_NO_FLUSH for @c nbytes bytes of @c data. The
+ * input of zlib is limited to UINT_MAX bytes per call, so larger data
+ * is compressed in chunks.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param z zlib stream
+ * @param data Data to compress
+ * @param nbytes Number of bytes of data
+ * @return Number of compressed bytes
+ * @endif
+ */
+static size_t
+BufDeflateData5(mat_t *mat,z_streamp z,const void *data,size_t nbytes)
+{
+    const mat_uint8_t *ptr = (const mat_uint8_t*)data;
+    size_t byteswritten = 0;
+
+    while ( nbytes > 0 ) {
+        uInt n = (nbytes > UINT_MAX) ? UINT_MAX : (uInt)nbytes;
+
+        z->next_in  = (Bytef*)ptr;
+        z->avail_in = n;
+        byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
+        ptr    += n;
+        nbytes -= n;
+    }
+
+    return byteswritten;
+}
+#endif
+
 /** @if mat_devman
  * @brief Writes @c data as character data
  *
@@ -445,13 +676,13 @@ WriteCharData(mat_t *mat, void *data, int N,enum matio_types data_type)
         case MAT_T_UINT16:
         {
             nBytes = N*2;
-            fwrite(&data_type,4,1,(FILE*)mat->fp);
-            fwrite(&nBytes,4,1,(FILE*)mat->fp);
+            BufWrite5(mat,&data_type,4,1);
+            BufWrite5(mat,&nBytes,4,1);
             if ( NULL != data && N > 0 )
-                fwrite(data,2,N,(FILE*)mat->fp);
+                BufWrite5(mat,data,2,N);
             if ( nBytes % 8 )
                 for ( i = nBytes % 8; i < 8; i++ )
-                    fwrite(&pad1,1,1,(FILE*)mat->fp);
+                    BufWrite5(mat,&pad1,1,1);
             break;
         }
         case MAT_T_INT8:
@@ -463,19 +694,19 @@ WriteCharData(mat_t *mat, void *data, int N,enum matio_types data_type)
             /* Matlab can't read MAT_C_CHAR as uint8, needs uint16 */
             nBytes = N*2;
             data_type = MAT_T_UINT16;
-            fwrite(&data_type,4,1,(FILE*)mat->fp);
-            fwrite(&nBytes,4,1,(FILE*)mat->fp);
+            BufWrite5(mat,&data_type,4,1);
+            BufWrite5(mat,&nBytes,4,1);
             ptr = (mat_uint8_t*)data;
             if ( NULL == ptr )
                 break;
             for ( i = 0; i < N; i++ ) {
                 c = (mat_uint16_t)*(char *)ptr;
-                fwrite(&c,2,1,(FILE*)mat->fp);
+                BufWrite5(mat,&c,2,1);
                 ptr++;
             }
             if ( nBytes % 8 )
                 for ( i = nBytes % 8; i < 8; i++ )
-                    fwrite(&pad1,1,1,(FILE*)mat->fp);
+                    BufWrite5(mat,&pad1,1,1);
             break;
         }
         case MAT_T_UTF8:
@@ -483,14 +714,14 @@ WriteCharData(mat_t *mat, void *data, int N,enum matio_types data_type)
             mat_uint8_t *ptr;
 
             nBytes = N;
-            fwrite(&data_type,4,1,(FILE*)mat->fp);
-            fwrite(&nBytes,4,1,(FILE*)mat->fp);
+            BufWrite5(mat,&data_type,4,1);
+            BufWrite5(mat,&nBytes,4,1);
             ptr = (mat_uint8_t*)data;
             if ( NULL != ptr && nBytes > 0 )
-                fwrite(ptr,1,nBytes,(FILE*)mat->fp);
+                BufWrite5(mat,ptr,1,nBytes);
             if ( nBytes % 8 )
                 for ( i = nBytes % 8; i < 8; i++ )
-                    fwrite(&pad1,1,1,(FILE*)mat->fp);
+                    BufWrite5(mat,&pad1,1,1);
             break;
         }
         case MAT_T_UNKNOWN:
@@ -500,8 +731,8 @@ WriteCharData(mat_t *mat, void *data, int N,enum matio_types data_type)
              */
             nBytes = N*2;
             data_type = MAT_T_UINT16;
-            fwrite(&data_type,4,1,(FILE*)mat->fp);
-            fwrite(&nBytes,4,1,(FILE*)mat->fp);
+            BufWrite5(mat,&data_type,4,1);
+            BufWrite5(mat,&nBytes,4,1);
             break;
         }
         default:
@@ -532,8 +763,7 @@ WriteCompressedCharData(mat_t *mat,z_streamp z,void *data,int N,
     enum matio_types data_type)
 {
     int data_size, data_tag[2], byteswritten = 0;
-    int buf_size = 1024;
-    mat_uint8_t   buf[1024], pad[8] = {0,};
+    mat_uint8_t   pad[8] = {0,};
 
     if ( mat == NULL || mat->fp == NULL )
         return 0;
@@ -548,12 +778,7 @@ WriteCompressedCharData(mat_t *mat,z_streamp z,void *data,int N,
             data_tag[1] = N*data_size;
             z->next_in  = ZLIB_BYTE_PTR(data_tag);
             z->avail_in = 8;
-            do {
-                z->next_out  = buf;
-                z->avail_out = buf_size;
-                deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(buf,1,buf_size-z->avail_out,(FILE*)mat->fp);
-            } while ( z->avail_out == 0 );
+            byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
 
             /* exit early if this is an empty data */
             if ( NULL == data || N < 1 )
@@ -561,22 +786,12 @@ WriteCompressedCharData(mat_t *mat,z_streamp z,void *data,int N,
 
             z->next_in  = (Bytef*)data;
             z->avail_in = data_size*N;
-            do {
-                z->next_out  = buf;
-                z->avail_out = buf_size;
-                deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(buf,1,buf_size-z->avail_out,(FILE*)mat->fp);
-            } while ( z->avail_out == 0 );
+            byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
             /* Add/Compress padding to pad to 8-byte boundary */
             if ( N*data_size % 8 ) {
                 z->next_in  = pad;
                 z->avail_in = 8 - (N*data_size % 8);
-                do {
-                    z->next_out  = buf;
-                    z->avail_out = buf_size;
-                    deflate(z,Z_NO_FLUSH);
-                    byteswritten += fwrite(buf,1,buf_size-z->avail_out,(FILE*)mat->fp);
-                } while ( z->avail_out == 0 );
+                byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
             }
             break;
         case MAT_T_UNKNOWN:
@@ -586,12 +801,7 @@ WriteCompressedCharData(mat_t *mat,z_streamp z,void *data,int N,
             data_tag[1] = N*data_size;
             z->next_in  = ZLIB_BYTE_PTR(data_tag);
             z->avail_in = 8;
-            do {
-                z->next_out  = buf;
-                z->avail_out = buf_size;
-                deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(buf,1,buf_size-z->avail_out,(FILE*)mat->fp);
-            } while ( z->avail_out == 0 );
+            byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
             break;
         default:
             break;
@@ -609,75 +819,363 @@ WriteCompressedCharData(mat_t *mat,z_streamp z,void *data,int N,
  * @param data_type data type of the data
  * @return number of bytes written
  */
-static int
-WriteData(mat_t *mat,void *data,int N,enum matio_types data_type)
+static size_t
+WriteData(mat_t *mat,void *data,size_t N,enum matio_types data_type)
 {
-    int nBytes = 0, data_size;
+    size_t nBytes = 0, data_size;
+    mat_uint32_t tag_nbytes;
 
     if ( mat == NULL || mat->fp == NULL )
         return 0;
 
-    data_size = Mat_SizeOf(data_type);
-    nBytes    = N*data_size;
-    fwrite(&data_type,4,1,(FILE*)mat->fp);
-    fwrite(&nBytes,4,1,(FILE*)mat->fp);
+    data_size  = Mat_SizeOf(data_type);
+    nBytes     = N*data_size;
+    tag_nbytes = (mat_uint32_t)nBytes;
+    BufWrite5(mat,&data_type,4,1);
+    BufWrite5(mat,&tag_nbytes,4,1);
 
     if ( data != NULL && N > 0 )
-        fwrite(data,data_size,N,(FILE*)mat->fp);
+        BufWrite5(mat,data,data_size,N);
 
     return nBytes;
 }
 
+#if defined(HAVE_ZLIB)
+/** @if mat_devman
+ * @brief Gets the zlib strategy of a compression strategy
+ *
+ * @ingroup mat_internal
+ * @param strategy Compression strategy
+ * @return zlib strategy
+ * @endif
+ */
+static int
+DeflateStrategy5(enum matio_compression_strategy strategy)
+{
+    switch ( strategy ) {
+        case MAT_STRATEGY_FILTERED:
+            return Z_FILTERED;
+        case MAT_STRATEGY_HUFFMAN_ONLY:
+            return Z_HUFFMAN_ONLY;
+        case MAT_STRATEGY_RLE:
+            return Z_RLE;
+        default:
+            return Z_DEFAULT_STRATEGY;
+    }
+}
+
+/** @if mat_devman
+ * @brief Picks the compression level and strategy of a variable
+ *
+ * Compresses a sample of the data of a numeric variable with each
+ * candidate setting, from the fastest to the slowest, and picks the
+ * first one that compresses the sample within 5% of the best one.
+ * Other variables, and small data, get the default level and
+ * strategy.
+ * @ingroup mat_internal
+ * @param matvar MAT variable pointer
+ * @param level Compression level, set on return
+ * @param strategy Compression strategy, set on return
+ * @endif
+ */
+static void
+DeflateAuto5(const matvar_t *matvar,int *level,
+    enum matio_compression_strategy *strategy)
+{
+    /* Candidate settings, from the fastest to the slowest */
+    static const int levels[] = {6,6,1,6,6};
+    static const enum matio_compression_strategy strategies[] = {
+        MAT_STRATEGY_HUFFMAN_ONLY,MAT_STRATEGY_RLE,MAT_STRATEGY_DEFAULT,
+        MAT_STRATEGY_FILTERED,MAT_STRATEGY_DEFAULT};
+    uLong sizes[5];
+    mat_uint8_t buf[16384];
+    const void *data = matvar->data;
+    size_t nbytes = matvar->nbytes, i, best = 0;
+
+    *level    = Z_DEFAULT_COMPRESSION;
+    *strategy = MAT_STRATEGY_DEFAULT;
+
+    if ( matvar->class_type < MAT_C_DOUBLE || matvar->class_type > MAT_C_UINT64 )
+        return;
+    if ( NULL != data && matvar->isComplex )
+        data = ((const mat_complex_split_t*)data)->Re;
+    if ( NULL == data || nbytes < 4096 )
+        return;
+    if ( nbytes > MAT_AUTO_SAMPLE_SIZE )
+        nbytes = MAT_AUTO_SAMPLE_SIZE;
+
+    for ( i = 0; i < 5; i++ ) {
+        z_stream z;
+        int err;
+
+        memset(&z,0,sizeof(z));
+        if ( Z_OK != deflateInit2(&z,levels[i],Z_DEFLATED,-MAX_WBITS,8,
+                                  DeflateStrategy5(strategies[i])) )
+            return;
+        z.next_in  = (Bytef*)data;
+        z.avail_in = (uInt)nbytes;
+        do {
+            z.next_out  = buf;
+            z.avail_out = sizeof(buf);
+            err = deflate(&z,Z_FINISH);
+        } while ( Z_OK == err );
+        sizes[i] = z.total_out;
+        (void)deflateEnd(&z);
+        if ( Z_STREAM_END != err )
+            return;
+        if ( sizes[i] < sizes[best] )
+            best = i;
+    }
+
+    for ( i = 0; i < 5; i++ ) {
+        if ( sizes[i]*100 <= sizes[best]*105 )
+            break;
+    }
+    *level    = levels[i];
+    *strategy = strategies[i];
+}
+#endif
+
+#if defined(HAVE_ZLIB) && defined(HAVE_PTHREAD)
+/** @if mat_devman
+ * @brief A block of data compressed by ParallelDeflate5
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+struct DeflateBlock5 {
+    mat_uint8_t *out;           /**< Compressed data, NULL on error */
+    size_t nbytes;              /**< Number of compressed bytes */
+    uLong adler;                /**< Adler-32 checksum of the block */
+};
+
+/** @if mat_devman
+ * @brief State shared by the threads of ParallelDeflate5
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+struct ParallelDeflate5 {
+    const mat_uint8_t *data;    /**< Data to compress */
+    size_t nbytes;              /**< Number of bytes of data */
+    int level;                  /**< zlib compression level */
+    int strategy;               /**< zlib strategy */
+    size_t first;               /**< Index of the first block of the batch */
+    size_t nblocks;             /**< Number of blocks in the batch */
+    size_t next;                /**< Index in the batch of the next block */
+    struct DeflateBlock5 *blocks; /**< Compressed blocks of the batch */
+    pthread_mutex_t lock;       /**< Protects next */
+};
+
+/** @if mat_devman
+ * @brief Compresses one block of data to raw deflate data
+ *
+ * The block is primed with the 32 KiB of data before it, and ends
+ * with a sync flush, so that the blocks can be concatenated into one
+ * deflate stream.
+ * @ingroup mat_internal
+ * @param p Shared state
+ * @param i Index of the block
+ * @param b Compressed block
+ * @endif
+ */
+static void
+DeflateBlock5(struct ParallelDeflate5 *p,size_t i,struct DeflateBlock5 *b)
+{
+    z_stream z;
+    size_t start, len, dict, size;
+
+    start = i*MAT_DEFLATE_BLOCK_SIZE;
+    len   = p->nbytes - start;
+    if ( len > MAT_DEFLATE_BLOCK_SIZE )
+        len = MAT_DEFLATE_BLOCK_SIZE;
+    b->out    = NULL;
+    b->nbytes = 0;
+    b->adler  = adler32(adler32(0L,Z_NULL,0),p->data+start,(uInt)len);
+
+    memset(&z,0,sizeof(z));
+    if ( Z_OK != deflateInit2(&z,p->level,Z_DEFLATED,-MAX_WBITS,8,p->strategy) )
+        return;
+    dict = start < 32768 ? start : 32768;
+    if ( dict > 0 &&
+         Z_OK != deflateSetDictionary(&z,p->data+start-dict,(uInt)dict) ) {
+        deflateEnd(&z);
+        return;
+    }
+    size = deflateBound(&z,len) + 16;
+    b->out = (mat_uint8_t*)malloc(size);
+    if ( NULL != b->out ) {
+        z.next_in   = (Bytef*)(p->data+start);
+        z.avail_in  = (uInt)len;
+        z.next_out  = b->out;
+        z.avail_out = (uInt)size;
+        if ( Z_OK == deflate(&z,Z_SYNC_FLUSH) && 0 == z.avail_in &&
+             0 < z.avail_out ) {
+            b->nbytes = size - z.avail_out;
+        } else {
+            free(b->out);
+            b->out = NULL;
+        }
+    }
+    deflateEnd(&z);
+}
+
+/** @if mat_devman
+ * @brief Compresses the blocks of a batch until none is left
+ *
+ * @ingroup mat_internal
+ * @param arg Shared state
+ * @return NULL
+ * @endif
+ */
+static void *
+DeflateWorker5(void *arg)
+{
+    struct ParallelDeflate5 *p = (struct ParallelDeflate5*)arg;
+    size_t i;
+
+    for ( ;; ) {
+        pthread_mutex_lock(&p->lock);
+        i = p->next++;
+        pthread_mutex_unlock(&p->lock);
+        if ( i >= p->nblocks )
+            break;
+        DeflateBlock5(p,p->first+i,p->blocks+i);
+    }
+    return NULL;
+}
+
+/** @if mat_devman
+ * @brief Compresses data in parallel into a zlib stream
+ *
+ * Splits the data into blocks of MAT_DEFLATE_BLOCK_SIZE bytes that
+ * are compressed on @c nthreads threads, a batch of blocks at a time,
+ * and writes them to the file in order. The zlib stream @c z is
+ * flushed to a byte boundary first, and its checksum is combined with
+ * the checksums of the blocks, so that it can go on compressing after
+ * the data. The data left when a block fails is compressed through
+ * @c z.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param z zlib stream
+ * @param data Data to compress
+ * @param nbytes Number of bytes of data
+ * @param nthreads Number of threads
+ * @return Number of compressed bytes written
+ * @endif
+ */
+static size_t
+ParallelDeflate5(mat_t *mat,z_streamp z,const mat_uint8_t *data,size_t nbytes,
+    int nthreads)
+{
+    struct ParallelDeflate5 p;
+    pthread_t *threads;
+    size_t byteswritten = 0, total, done = 0, batch, i;
+    int nstarted, err = 0;
+
+    threads = (pthread_t*)malloc(nthreads*sizeof(*threads));
+    batch   = 4*(size_t)nthreads;
+    p.blocks = (struct DeflateBlock5*)malloc(batch*sizeof(*p.blocks));
+    if ( NULL == threads || NULL == p.blocks ) {
+        free(threads);
+        free(p.blocks);
+        return BufDeflateData5(mat,z,data,nbytes);
+    }
+
+    /* End the output of z on a byte boundary, without back references */
+    z->next_in  = NULL;
+    z->avail_in = 0;
+    byteswritten += BufDeflate5(mat,z,Z_FULL_FLUSH);
+
+    p.data     = data;
+    p.nbytes   = nbytes;
+    p.level    = mat->compression_level;
+    p.strategy = DeflateStrategy5(mat->compression_strategy);
+    pthread_mutex_init(&p.lock,NULL);
+    total = (nbytes + MAT_DEFLATE_BLOCK_SIZE - 1)/MAT_DEFLATE_BLOCK_SIZE;
+    while ( done < total && !err ) {
+        p.first   = done;
+        p.nblocks = total - done < batch ? total - done : batch;
+        p.next    = 0;
+        nstarted  = 0;
+        for ( ; nstarted < nthreads - 1; nstarted++ ) {
+            if ( pthread_create(threads+nstarted,NULL,DeflateWorker5,&p) )
+                break;
+        }
+        (void)DeflateWorker5(&p);
+        for ( i = 0; i < (size_t)nstarted; i++ )
+            pthread_join(threads[i],NULL);
+        for ( i = 0; i < p.nblocks; i++ ) {
+            struct DeflateBlock5 *b = p.blocks+i;
+            if ( !err && NULL != b->out ) {
+                size_t len = nbytes - (done+i)*MAT_DEFLATE_BLOCK_SIZE;
+                if ( len > MAT_DEFLATE_BLOCK_SIZE )
+                    len = MAT_DEFLATE_BLOCK_SIZE;
+                byteswritten += BufWrite5(mat,b->out,1,b->nbytes);
+                z->adler = adler32_combine(z->adler,b->adler,(z_off_t)len);
+            } else if ( !err ) {
+                err = 1;
+                done += i;
+            }
+            free(b->out);
+        }
+        if ( !err )
+            done += p.nblocks;
+    }
+    pthread_mutex_destroy(&p.lock);
+    free(threads);
+    free(p.blocks);
+
+    /* Compress the data after a failed block through z */
+    if ( done < total )
+        byteswritten += BufDeflateData5(mat,z,data+done*MAT_DEFLATE_BLOCK_SIZE,
+                            nbytes - done*MAT_DEFLATE_BLOCK_SIZE);
+    return byteswritten;
+}
+#endif
+
 #if defined(HAVE_ZLIB)
 /* Compresses the data buffer and writes it to the file */
 static size_t
-WriteCompressedData(mat_t *mat,z_streamp z,void *data,int N,
+WriteCompressedData(mat_t *mat,z_streamp z,void *data,size_t N,
     enum matio_types data_type)
 {
-    int nBytes = 0, data_size, data_tag[2], byteswritten = 0;
-    int buf_size = 1024;
-    mat_uint8_t buf[1024], pad[8] = {0,};
+    size_t nBytes, data_size, byteswritten = 0;
+    mat_uint32_t data_tag[2];
+    mat_uint8_t pad[8] = {0,};
 
     if ( mat == NULL || mat->fp == NULL )
         return 0;
 
     data_size   = Mat_SizeOf(data_type);
+    nBytes      = N*data_size;
     data_tag[0] = data_type;
-    data_tag[1] = data_size*N;
+    data_tag[1] = (mat_uint32_t)nBytes;
     z->next_in  = ZLIB_BYTE_PTR(data_tag);
     z->avail_in = 8;
-    do {
-        z->next_out  = buf;
-        z->avail_out = buf_size;
-        deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(buf,1,buf_size-z->avail_out,(FILE*)mat->fp);
-    } while ( z->avail_out == 0 );
+    byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
 
     /* exit early if this is an empty data */
     if ( NULL == data || N < 1 )
         return byteswritten;
 
-    z->next_in  = (Bytef*)data;
-    z->avail_in = N*data_size;
-    do {
-        z->next_out  = buf;
-        z->avail_out = buf_size;
-        deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(buf,1,buf_size-z->avail_out,(FILE*)mat->fp);
-    } while ( z->avail_out == 0 );
+#if defined(HAVE_PTHREAD)
+    if ( mat->write_threads > 1 &&
+         nBytes >= 2*(size_t)MAT_DEFLATE_BLOCK_SIZE ) {
+        byteswritten += ParallelDeflate5(mat,z,(const mat_uint8_t*)data,
+                            nBytes,mat->write_threads);
+    } else
+#endif
+    {
+        byteswritten += BufDeflateData5(mat,z,data,nBytes);
+    }
     /* Add/Compress padding to pad to 8-byte boundary */
-    if ( N*data_size % 8 ) {
+    if ( nBytes % 8 ) {
         z->next_in  = pad;
-        z->avail_in = 8 - (N*data_size % 8);
-        do {
-            z->next_out  = buf;
-            z->avail_out = buf_size;
-            deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(buf,1,buf_size-z->avail_out,(FILE*)mat->fp);
-        } while ( z->avail_out == 0 );
+        z->avail_in = 8 - (nBytes % 8);
+        byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
     }
-    nBytes = byteswritten;
-    return nBytes;
+    return byteswritten;
 }
 #endif
 
@@ -1482,25 +1980,27 @@ WriteType(mat_t *mat,matvar_t *matvar)
         case MAT_C_INT8:
         case MAT_C_UINT8:
         {
+            size_t data_bytes;
+
             if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data = (mat_complex_split_t*)matvar->data;
 
                 if ( NULL == matvar->data )
                     complex_data = &null_complex_data;
 
-                nBytes=WriteData(mat,complex_data->Re,nelems,matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( j = nBytes % 8; j < 8; j++ )
-                        fwrite(&pad1,1,1,(FILE*)mat->fp);
-                nBytes=WriteData(mat,complex_data->Im,nelems,matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( j = nBytes % 8; j < 8; j++ )
-                        fwrite(&pad1,1,1,(FILE*)mat->fp);
+                data_bytes=WriteData(mat,complex_data->Re,nelems,matvar->data_type);
+                if ( data_bytes % 8 )
+                    for ( j = data_bytes % 8; j < 8; j++ )
+                        BufWrite5(mat,&pad1,1,1);
+                data_bytes=WriteData(mat,complex_data->Im,nelems,matvar->data_type);
+                if ( data_bytes % 8 )
+                    for ( j = data_bytes % 8; j < 8; j++ )
+                        BufWrite5(mat,&pad1,1,1);
             } else {
-                nBytes=WriteData(mat,matvar->data,nelems,matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( j = nBytes % 8; j < 8; j++ )
-                        fwrite(&pad1,1,1,(FILE*)mat->fp);
+                data_bytes=WriteData(mat,matvar->data,nelems,matvar->data_type);
+                if ( data_bytes % 8 )
+                    for ( j = data_bytes % 8; j < 8; j++ )
+                        BufWrite5(mat,&pad1,1,1);
             }
             break;
         }
@@ -1540,19 +2040,19 @@ WriteType(mat_t *mat,matvar_t *matvar)
             /* Check for a structure with no fields */
             if ( nfields < 1 ) {
 #if 0
-                fwrite(&fieldname_type,2,1,(FILE*)mat->fp);
-                fwrite(&fieldname_data_size,2,1,(FILE*)mat->fp);
+                BufWrite5(mat,&fieldname_type,2,1);
+                BufWrite5(mat,&fieldname_data_size,2,1);
 #else
                 fieldname = (fieldname_data_size<<16) | fieldname_type;
-                fwrite(&fieldname,4,1,(FILE*)mat->fp);
+                BufWrite5(mat,&fieldname,4,1);
 #endif
                 fieldname_size = 1;
-                fwrite(&fieldname_size,4,1,(FILE*)mat->fp);
-                fwrite(&array_name_type,2,1,(FILE*)mat->fp);
-                fwrite(&pad1,1,1,(FILE*)mat->fp);
-                fwrite(&pad1,1,1,(FILE*)mat->fp);
+                BufWrite5(mat,&fieldname_size,4,1);
+                BufWrite5(mat,&array_name_type,2,1);
+                BufWrite5(mat,&pad1,1,1);
+                BufWrite5(mat,&pad1,1,1);
                 nBytes = 0;
-                fwrite(&nBytes,4,1,(FILE*)mat->fp);
+                BufWrite5(mat,&nBytes,4,1);
                 break;
             }
 
@@ -1566,23 +2066,23 @@ WriteType(mat_t *mat,matvar_t *matvar)
             while ( nfields*fieldname_size % 8 != 0 )
                 fieldname_size++;
 #if 0
-            fwrite(&fieldname_type,2,1,(FILE*)mat->fp);
-            fwrite(&fieldname_data_size,2,1,(FILE*)mat->fp);
+            BufWrite5(mat,&fieldname_type,2,1);
+            BufWrite5(mat,&fieldname_data_size,2,1);
 #else
             fieldname = (fieldname_data_size<<16) | fieldname_type;
-            fwrite(&fieldname,4,1,(FILE*)mat->fp);
+            BufWrite5(mat,&fieldname,4,1);
 #endif
-            fwrite(&fieldname_size,4,1,(FILE*)mat->fp);
-            fwrite(&array_name_type,2,1,(FILE*)mat->fp);
-            fwrite(&pad1,1,1,(FILE*)mat->fp);
-            fwrite(&pad1,1,1,(FILE*)mat->fp);
+            BufWrite5(mat,&fieldname_size,4,1);
+            BufWrite5(mat,&array_name_type,2,1);
+            BufWrite5(mat,&pad1,1,1);
+            BufWrite5(mat,&pad1,1,1);
             nBytes = nfields*fieldname_size;
-            fwrite(&nBytes,4,1,(FILE*)mat->fp);
+            BufWrite5(mat,&nBytes,4,1);
             padzero = (char*)calloc(fieldname_size,1);
             for ( i = 0; i < nfields; i++ ) {
                 size_t len = strlen(matvar->internal->fieldnames[i]);
-                fwrite(matvar->internal->fieldnames[i],1,len,(FILE*)mat->fp);
-                fwrite(padzero,1,fieldname_size-len,(FILE*)mat->fp);
+                BufWrite5(mat,matvar->internal->fieldnames[i],1,len);
+                BufWrite5(mat,padzero,1,fieldname_size-len);
             }
             free(padzero);
             SafeMul(&nelems_x_nfields, nelems, nfields);
@@ -1597,29 +2097,29 @@ WriteType(mat_t *mat,matvar_t *matvar)
             nBytes = WriteData(mat,sparse->ir,sparse->nir,MAT_T_INT32);
             if ( nBytes % 8 )
                 for ( j = nBytes % 8; j < 8; j++ )
-                    fwrite(&pad1,1,1,(FILE*)mat->fp);
+                    BufWrite5(mat,&pad1,1,1);
             nBytes = WriteData(mat,sparse->jc,sparse->njc,MAT_T_INT32);
             if ( nBytes % 8 )
                 for ( j = nBytes % 8; j < 8; j++ )
-                    fwrite(&pad1,1,1,(FILE*)mat->fp);
+                    BufWrite5(mat,&pad1,1,1);
             if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data = (mat_complex_split_t*)sparse->data;
                 nBytes = WriteData(mat,complex_data->Re,sparse->ndata,
                                    matvar->data_type);
                 if ( nBytes % 8 )
                     for ( j = nBytes % 8; j < 8; j++ )
-                        fwrite(&pad1,1,1,(FILE*)mat->fp);
+                        BufWrite5(mat,&pad1,1,1);
                 nBytes = WriteData(mat,complex_data->Im,sparse->ndata,
                                    matvar->data_type);
                 if ( nBytes % 8 )
                     for ( j = nBytes % 8; j < 8; j++ )
-                        fwrite(&pad1,1,1,(FILE*)mat->fp);
+                        BufWrite5(mat,&pad1,1,1);
             } else {
                 nBytes = WriteData(mat,sparse->data,sparse->ndata,
                                    matvar->data_type);
                 if ( nBytes % 8 )
                     for ( j = nBytes % 8; j < 8; j++ )
-                        fwrite(&pad1,1,1,(FILE*)mat->fp);
+                        BufWrite5(mat,&pad1,1,1);
             }
         }
         case MAT_C_FUNCTION:
@@ -1648,22 +2148,20 @@ WriteCellArrayField(mat_t *mat,matvar_t *matvar)
     int array_flags_size = 8, pad4 = 0, matrix_type = MAT_T_MATRIX;
     const mat_int8_t pad1 = 0;
     int nBytes, i, nzmax = 0;
-    long start = 0, end = 0;
+    size_t start;
 
     if ( matvar == NULL || mat == NULL )
         return 1;
 
-#if 0
-    nBytes = GetMatrixMaxBufSize(matvar);
-#endif
-
-    fwrite(&matrix_type,4,1,(FILE*)mat->fp);
-    fwrite(&pad4,4,1,(FILE*)mat->fp);
+    BufWrite5(mat,&matrix_type,4,1);
     if ( MAT_C_EMPTY == matvar->class_type ) {
         /* exit early if this is an empty data */
+        BufWrite5(mat,&pad4,4,1);
         return 0;
     }
-    start = ftell((FILE*)mat->fp);
+    nBytes = mat->wcount ? 0 : ElementSize5(mat,WriteCellArrayField,matvar);
+    BufWrite5(mat,&nBytes,4,1);
+    start = mat->wbytes;
 
     /* Array Flags */
     array_flags = matvar->class_type & CLASS_TYPE_MASK;
@@ -1678,56 +2176,50 @@ WriteCellArrayField(mat_t *mat,matvar_t *matvar)
 
     if ( mat->byteswap )
         array_flags = Mat_int32Swap((mat_int32_t*)&array_flags);
-    fwrite(&array_flags_type,4,1,(FILE*)mat->fp);
-    fwrite(&array_flags_size,4,1,(FILE*)mat->fp);
-    fwrite(&array_flags,4,1,(FILE*)mat->fp);
-    fwrite(&nzmax,4,1,(FILE*)mat->fp);
+    BufWrite5(mat,&array_flags_type,4,1);
+    BufWrite5(mat,&array_flags_size,4,1);
+    BufWrite5(mat,&array_flags,4,1);
+    BufWrite5(mat,&nzmax,4,1);
     /* Rank and Dimension */
     nBytes = matvar->rank * 4;
-    fwrite(&dims_array_type,4,1,(FILE*)mat->fp);
-    fwrite(&nBytes,4,1,(FILE*)mat->fp);
+    BufWrite5(mat,&dims_array_type,4,1);
+    BufWrite5(mat,&nBytes,4,1);
     for ( i = 0; i < matvar->rank; i++ ) {
         mat_int32_t dim;
         dim = matvar->dims[i];
-        fwrite(&dim,4,1,(FILE*)mat->fp);
+        BufWrite5(mat,&dim,4,1);
     }
     if ( matvar->rank % 2 != 0 )
-        fwrite(&pad4,4,1,(FILE*)mat->fp);
+        BufWrite5(mat,&pad4,4,1);
     /* Name of variable */
     if ( !matvar->name ) {
-        fwrite(&array_name_type,2,1,(FILE*)mat->fp);
-        fwrite(&pad1,1,1,(FILE*)mat->fp);
-        fwrite(&pad1,1,1,(FILE*)mat->fp);
-        fwrite(&pad4,4,1,(FILE*)mat->fp);
+        BufWrite5(mat,&array_name_type,2,1);
+        BufWrite5(mat,&pad1,1,1);
+        BufWrite5(mat,&pad1,1,1);
+        BufWrite5(mat,&pad4,4,1);
     } else if ( strlen(matvar->name) <= 4 ) {
         mat_int16_t array_name_len = (mat_int16_t)strlen(matvar->name);
-        fwrite(&array_name_type,2,1,(FILE*)mat->fp);
-        fwrite(&array_name_len,2,1,(FILE*)mat->fp);
-        fwrite(matvar->name,1,array_name_len,(FILE*)mat->fp);
+        BufWrite5(mat,&array_name_type,2,1);
+        BufWrite5(mat,&array_name_len,2,1);
+        BufWrite5(mat,matvar->name,1,array_name_len);
         for ( i = array_name_len; i < 4; i++ )
-            fwrite(&pad1,1,1,(FILE*)mat->fp);
+            BufWrite5(mat,&pad1,1,1);
     } else {
         mat_int32_t array_name_len = (mat_int32_t)strlen(matvar->name);
-        fwrite(&array_name_type,2,1,(FILE*)mat->fp);
-        fwrite(&pad1,1,1,(FILE*)mat->fp);
-        fwrite(&pad1,1,1,(FILE*)mat->fp);
-        fwrite(&array_name_len,4,1,(FILE*)mat->fp);
-        fwrite(matvar->name,1,array_name_len,(FILE*)mat->fp);
+        BufWrite5(mat,&array_name_type,2,1);
+        BufWrite5(mat,&pad1,1,1);
+        BufWrite5(mat,&pad1,1,1);
+        BufWrite5(mat,&array_name_len,4,1);
+        BufWrite5(mat,matvar->name,1,array_name_len);
         if ( array_name_len % 8 )
             for ( i = array_name_len % 8; i < 8; i++ )
-                fwrite(&pad1,1,1,(FILE*)mat->fp);
+                BufWrite5(mat,&pad1,1,1);
     }
 
     WriteType(mat,matvar);
-    end = ftell((FILE*)mat->fp);
-    if ( start != -1L && end != -1L ) {
-        nBytes = (int)(end-start);
-        (void)fseek((FILE*)mat->fp,(long)-(nBytes+4),SEEK_CUR);
-        fwrite(&nBytes,4,1,(FILE*)mat->fp);
-        (void)fseek((FILE*)mat->fp,end,SEEK_SET);
-    } else {
-        Mat_Critical("Couldn't determine file position");
-    }
+    /* Cache the size for the write after the dry run */
+    if ( mat->wcount && NULL != matvar->internal )
+        matvar->internal->wnbytes = mat->wbytes - start;
 
     return 0;
 }
@@ -1749,9 +2241,7 @@ WriteCompressedTypeArrayFlags(mat_t *mat,matvar_t *matvar,z_streamp z)
     int array_flags_size = 8;
     int nBytes, i, nzmax = 0;
 
-    mat_uint32_t comp_buf[512];
     mat_uint32_t uncomp_buf[512] = {0,};
-    int buf_size = 512;
     size_t byteswritten = 0;
 
     if ( MAT_C_EMPTY == matvar->class_type ) {
@@ -1790,30 +2280,15 @@ WriteCompressedTypeArrayFlags(mat_t *mat,matvar_t *matvar,z_streamp z)
 
     z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
     z->avail_in = (6+i)*sizeof(*uncomp_buf);
-    do {
-        z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-        z->avail_out = buf_size*sizeof(*comp_buf);
-        deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(comp_buf,1,buf_size*sizeof(*comp_buf)-z->avail_out,
-            (FILE*)mat->fp);
-    } while ( z->avail_out == 0 );
+    byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
     /* Name of variable */
     uncomp_buf[0] = array_name_type;
     uncomp_buf[1] = 0;
     z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
     z->avail_in = 8;
-    do {
-        z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-        z->avail_out = buf_size*sizeof(*comp_buf);
-        deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(comp_buf,1,buf_size*sizeof(*comp_buf)-z->avail_out,
-            (FILE*)mat->fp);
-    } while ( z->avail_out == 0 );
-
-    matvar->internal->datapos = ftell((FILE*)mat->fp);
-    if ( matvar->internal->datapos == -1L ) {
-        Mat_Critical("Couldn't determine file position");
-    }
+    byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
+
+    matvar->internal->datapos = (long)mat->wbytes;
 
     byteswritten += WriteCompressedType(mat,matvar,z);
     return byteswritten;
@@ -1829,7 +2304,6 @@ WriteCompressedTypeArrayFlags(mat_t *mat,matvar_t *matvar,z_streamp z)
 static size_t
 WriteCompressedType(mat_t *mat,matvar_t *matvar,z_streamp z)
 {
-    mat_uint32_t comp_buf[512];
     mat_uint32_t uncomp_buf[512] = {0,};
     size_t byteswritten = 0, nelems = 1;
 
@@ -1892,7 +2366,6 @@ WriteCompressedType(mat_t *mat,matvar_t *matvar,z_streamp z)
         }
         case MAT_C_STRUCT:
         {
-            int buf_size = 512;
             mat_int16_t fieldname_type = MAT_T_INT32;
             mat_int16_t fieldname_data_size = 4;
             unsigned char *padzero;
@@ -1911,13 +2384,7 @@ WriteCompressedType(mat_t *mat,matvar_t *matvar,z_streamp z)
                 uncomp_buf[3] = 0;
                 z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
                 z->avail_in = 16;
-                do {
-                    z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                    z->avail_out = buf_size*sizeof(*comp_buf);
-                    deflate(z,Z_NO_FLUSH);
-                    byteswritten += fwrite(comp_buf,1,buf_size*
-                        sizeof(*comp_buf)-z->avail_out,(FILE*)mat->fp);
-                } while ( z->avail_out == 0 );
+                byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
                 break;
             }
 
@@ -1938,26 +2405,14 @@ WriteCompressedType(mat_t *mat,matvar_t *matvar,z_streamp z)
             padzero = (unsigned char*)calloc(fieldname_size,1);
             z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
             z->avail_in = 16;
-            do {
-                z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                z->avail_out = buf_size*sizeof(*comp_buf);
-                deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(comp_buf,1,
-                    buf_size*sizeof(*comp_buf)-z->avail_out,(FILE*)mat->fp);
-            } while ( z->avail_out == 0 );
+            byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
             for ( i = 0; i < nfields; i++ ) {
                 size_t len = strlen(matvar->internal->fieldnames[i]);
                 memset(padzero,'\0',fieldname_size);
                 memcpy(padzero,matvar->internal->fieldnames[i],len);
                 z->next_in  = ZLIB_BYTE_PTR(padzero);
                 z->avail_in = fieldname_size;
-                do {
-                    z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                    z->avail_out = buf_size*sizeof(*comp_buf);
-                    deflate(z,Z_NO_FLUSH);
-                    byteswritten += fwrite(comp_buf,1,
-                        buf_size*sizeof(*comp_buf)-z->avail_out,(FILE*)mat->fp);
-                } while ( z->avail_out == 0 );
+                byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
             }
             free(padzero);
             SafeMul(&nelems_x_nfields, nelems, nfields);
@@ -2005,9 +2460,7 @@ WriteCompressedType(mat_t *mat,matvar_t *matvar,z_streamp z)
 static size_t
 WriteCompressedCellArrayField(mat_t *mat,matvar_t *matvar,z_streamp z)
 {
-    mat_uint32_t comp_buf[512];
     mat_uint32_t uncomp_buf[512] = {0,};
-    int buf_size = 512;
     size_t byteswritten = 0;
 
     if ( NULL == matvar || NULL == mat || NULL == z)
@@ -2021,13 +2474,7 @@ WriteCompressedCellArrayField(mat_t *mat,matvar_t *matvar,z_streamp z)
     }
     z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
     z->avail_in = 8;
-    do {
-        z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-        z->avail_out = buf_size*sizeof(*comp_buf);
-        deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(comp_buf,1,buf_size*sizeof(*comp_buf)-z->avail_out,
-            (FILE*)mat->fp);
-    } while ( z->avail_out == 0 );
+    byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
 
     byteswritten += WriteCompressedTypeArrayFlags(mat,matvar,z);
     return byteswritten;
@@ -2049,7 +2496,7 @@ WriteStructField(mat_t *mat,matvar_t *matvar)
     int array_flags_type = MAT_T_UINT32, dims_array_type = MAT_T_INT32;
     int array_flags_size = 8, pad4 = 0, matrix_type = MAT_T_MATRIX;
     int nBytes, i, nzmax = 0;
-    long start = 0, end = 0;
+    size_t start;
 
     if ( mat == NULL )
         return 1;
@@ -2060,13 +2507,15 @@ WriteStructField(mat_t *mat,matvar_t *matvar)
         return 0;
     }
 
-    fwrite(&matrix_type,4,1,(FILE*)mat->fp);
-    fwrite(&pad4,4,1,(FILE*)mat->fp);
+    BufWrite5(mat,&matrix_type,4,1);
     if ( MAT_C_EMPTY == matvar->class_type ) {
         /* exit early if this is an empty data */
+        BufWrite5(mat,&pad4,4,1);
         return 0;
     }
-    start = ftell((FILE*)mat->fp);
+    nBytes = mat->wcount ? 0 : ElementSize5(mat,WriteStructField,matvar);
+    BufWrite5(mat,&nBytes,4,1);
+    start = mat->wbytes;
 
     /* Array Flags */
     array_flags = matvar->class_type & CLASS_TYPE_MASK;
@@ -2081,36 +2530,30 @@ WriteStructField(mat_t *mat,matvar_t *matvar)
 
     if ( mat->byteswap )
         array_flags = Mat_int32Swap((mat_int32_t*)&array_flags);
-    fwrite(&array_flags_type,4,1,(FILE*)mat->fp);
-    fwrite(&array_flags_size,4,1,(FILE*)mat->fp);
-    fwrite(&array_flags,4,1,(FILE*)mat->fp);
-    fwrite(&nzmax,4,1,(FILE*)mat->fp);
+    BufWrite5(mat,&array_flags_type,4,1);
+    BufWrite5(mat,&array_flags_size,4,1);
+    BufWrite5(mat,&array_flags,4,1);
+    BufWrite5(mat,&nzmax,4,1);
     /* Rank and Dimension */
     nBytes = matvar->rank * 4;
-    fwrite(&dims_array_type,4,1,(FILE*)mat->fp);
-    fwrite(&nBytes,4,1,(FILE*)mat->fp);
+    BufWrite5(mat,&dims_array_type,4,1);
+    BufWrite5(mat,&nBytes,4,1);
     for ( i = 0; i < matvar->rank; i++ ) {
         mat_int32_t dim;
         dim = matvar->dims[i];
-        fwrite(&dim,4,1,(FILE*)mat->fp);
+        BufWrite5(mat,&dim,4,1);
     }
     if ( matvar->rank % 2 != 0 )
-        fwrite(&pad4,4,1,(FILE*)mat->fp);
+        BufWrite5(mat,&pad4,4,1);
 
     /* Name of variable */
-    fwrite(&array_name_type,4,1,(FILE*)mat->fp);
-    fwrite(&pad4,4,1,(FILE*)mat->fp);
+    BufWrite5(mat,&array_name_type,4,1);
+    BufWrite5(mat,&pad4,4,1);
 
     WriteType(mat,matvar);
-    end = ftell((FILE*)mat->fp);
-    if ( start != -1L && end != -1L ) {
-        nBytes = (int)(end-start);
-        (void)fseek((FILE*)mat->fp,(long)-(nBytes+4),SEEK_CUR);
-        fwrite(&nBytes,4,1,(FILE*)mat->fp);
-        (void)fseek((FILE*)mat->fp,end,SEEK_SET);
-    } else {
-        Mat_Critical("Couldn't determine file position");
-    }
+    /* Cache the size for the write after the dry run */
+    if ( mat->wcount && NULL != matvar->internal )
+        matvar->internal->wnbytes = mat->wbytes - start;
 
     return 0;
 }
@@ -2127,9 +2570,7 @@ WriteStructField(mat_t *mat,matvar_t *matvar)
 static size_t
 WriteCompressedStructField(mat_t *mat,matvar_t *matvar,z_streamp z)
 {
-    mat_uint32_t comp_buf[512];
     mat_uint32_t uncomp_buf[512] = {0,};
-    int buf_size = 512;
     size_t byteswritten = 0;
 
     if ( NULL == mat || NULL == z)
@@ -2149,13 +2590,7 @@ WriteCompressedStructField(mat_t *mat,matvar_t *matvar,z_streamp z)
     }
     z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
     z->avail_in = 8;
-    do {
-        z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-        z->avail_out = buf_size*sizeof(*comp_buf);
-        deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(comp_buf,1,buf_size*sizeof(*comp_buf)-z->avail_out,
-            (FILE*)mat->fp);
-    } while ( z->avail_out == 0 );
+    byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
 
     byteswritten += WriteCompressedTypeArrayFlags(mat,matvar,z);
     return byteswritten;
@@ -2171,53 +2606,53 @@ Mat_WriteEmptyVariable5(mat_t *mat,const char *name,int rank,size_t *dims)
     int array_flags_size = 8, pad4 = 0, nBytes, i;
     const mat_int8_t pad1 = 0;
     size_t byteswritten = 0;
-    long start = 0, end = 0;
 
-    fwrite(&matrix_type,4,1,(FILE*)mat->fp);
-    fwrite(&pad4,4,1,(FILE*)mat->fp);
-    start = ftell((FILE*)mat->fp);
+    /* The size of an empty variable is known */
+    nBytes = (int)GetEmptyMatrixMaxBufSize(name,rank);
+    BufWrite5(mat,&matrix_type,4,1);
+    BufWrite5(mat,&nBytes,4,1);
 
     /* Array Flags */
     array_flags = MAT_C_DOUBLE;
 
     if ( mat->byteswap )
         array_flags = Mat_int32Swap((mat_int32_t*)&array_flags);
-    byteswritten += fwrite(&array_flags_type,4,1,(FILE*)mat->fp);
-    byteswritten += fwrite(&array_flags_size,4,1,(FILE*)mat->fp);
-    byteswritten += fwrite(&array_flags,4,1,(FILE*)mat->fp);
-    byteswritten += fwrite(&pad4,4,1,(FILE*)mat->fp);
+    byteswritten += BufWrite5(mat,&array_flags_type,4,1);
+    byteswritten += BufWrite5(mat,&array_flags_size,4,1);
+    byteswritten += BufWrite5(mat,&array_flags,4,1);
+    byteswritten += BufWrite5(mat,&pad4,4,1);
     /* Rank and Dimension */
     nBytes = rank * 4;
-    byteswritten += fwrite(&dims_array_type,4,1,(FILE*)mat->fp);
-    byteswritten += fwrite(&nBytes,4,1,(FILE*)mat->fp);
+    byteswritten += BufWrite5(mat,&dims_array_type,4,1);
+    byteswritten += BufWrite5(mat,&nBytes,4,1);
     for ( i = 0; i < rank; i++ ) {
         mat_int32_t dim;
         dim = dims[i];
-        byteswritten += fwrite(&dim,4,1,(FILE*)mat->fp);
+        byteswritten += BufWrite5(mat,&dim,4,1);
     }
     if ( rank % 2 != 0 )
-        byteswritten += fwrite(&pad4,4,1,(FILE*)mat->fp);
+        byteswritten += BufWrite5(mat,&pad4,4,1);
 
     if ( NULL == name ) {
         /* Name of variable */
-        byteswritten += fwrite(&array_name_type,4,1,(FILE*)mat->fp);
-        byteswritten += fwrite(&pad4,4,1,(FILE*)mat->fp);
+        byteswritten += BufWrite5(mat,&array_name_type,4,1);
+        byteswritten += BufWrite5(mat,&pad4,4,1);
     } else {
         mat_int32_t array_name_len = (mat_int32_t)strlen(name);
         /* Name of variable */
         if ( array_name_len <= 4 ) {
             array_name_type = (array_name_len << 16) | array_name_type;
-            byteswritten += fwrite(&array_name_type,4,1,(FILE*)mat->fp);
-            byteswritten += fwrite(name,1,array_name_len,(FILE*)mat->fp);
+            byteswritten += BufWrite5(mat,&array_name_type,4,1);
+            byteswritten += BufWrite5(mat,name,1,array_name_len);
             for ( i = array_name_len; i < 4; i++ )
-                byteswritten += fwrite(&pad1,1,1,(FILE*)mat->fp);
+                byteswritten += BufWrite5(mat,&pad1,1,1);
         } else {
-            byteswritten += fwrite(&array_name_type,4,1,(FILE*)mat->fp);
-            byteswritten += fwrite(&array_name_len,4,1,(FILE*)mat->fp);
-            byteswritten += fwrite(name,1,array_name_len,(FILE*)mat->fp);
+            byteswritten += BufWrite5(mat,&array_name_type,4,1);
+            byteswritten += BufWrite5(mat,&array_name_len,4,1);
+            byteswritten += BufWrite5(mat,name,1,array_name_len);
             if ( array_name_len % 8 )
                 for ( i = array_name_len % 8; i < 8; i++ )
-                    byteswritten += fwrite(&pad1,1,1,(FILE*)mat->fp);
+                    byteswritten += BufWrite5(mat,&pad1,1,1);
         }
     }
 
@@ -2225,17 +2660,7 @@ Mat_WriteEmptyVariable5(mat_t *mat,const char *name,int rank,size_t *dims)
     byteswritten += nBytes;
     if ( nBytes % 8 )
         for ( i = nBytes % 8; i < 8; i++ )
-            byteswritten += fwrite(&pad1,1,1,(FILE*)mat->fp);
-
-    end = ftell((FILE*)mat->fp);
-    if ( start != -1L && end != -1L ) {
-        nBytes = (int)(end-start);
-        (void)fseek((FILE*)mat->fp,(long)-(nBytes+4),SEEK_CUR);
-        fwrite(&nBytes,4,1,(FILE*)mat->fp);
-        (void)fseek((FILE*)mat->fp,end,SEEK_SET);
-    } else {
-        Mat_Critical("Couldn't determine file position");
-    }
+            byteswritten += BufWrite5(mat,&pad1,1,1);
 
     return byteswritten;
 }
@@ -2250,16 +2675,13 @@ Mat_WriteCompressedEmptyVariable5(mat_t *mat,const char *name,int rank,
     int array_flags_size = 8;
     int nBytes, i;
 
-    mat_uint32_t comp_buf[512];
     mat_uint32_t uncomp_buf[512] = {0,};
     int buf_size = 512;
-    size_t byteswritten = 0, buf_size_bytes;
+    size_t byteswritten = 0;
 
     if ( NULL == mat || NULL == z)
         return 1;
 
-    buf_size_bytes = buf_size*sizeof(*comp_buf);
-
     /* Array Flags */
     array_flags = MAT_C_DOUBLE;
 
@@ -2267,12 +2689,7 @@ Mat_WriteCompressedEmptyVariable5(mat_t *mat,const char *name,int rank,
     uncomp_buf[1] = (int)GetEmptyMatrixMaxBufSize(name,rank);
     z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
     z->avail_in = 8;
-    do {
-        z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-        z->avail_out = buf_size_bytes;
-        deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(comp_buf,1,buf_size_bytes-z->avail_out,(FILE*)mat->fp);
-    } while ( z->avail_out == 0 );
+    byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
     uncomp_buf[0] = array_flags_type;
     uncomp_buf[1] = array_flags_size;
     uncomp_buf[2] = array_flags;
@@ -2294,12 +2711,7 @@ Mat_WriteCompressedEmptyVariable5(mat_t *mat,const char *name,int rank,
 
     z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
     z->avail_in = (6+i)*sizeof(*uncomp_buf);
-    do {
-        z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-        z->avail_out = buf_size_bytes;
-        deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(comp_buf,1,buf_size_bytes-z->avail_out,(FILE*)mat->fp);
-    } while ( z->avail_out == 0 );
+    byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
     /* Name of variable */
     if ( NULL == name ) {
         mat_int16_t array_name_type = MAT_T_INT8;
@@ -2307,12 +2719,7 @@ Mat_WriteCompressedEmptyVariable5(mat_t *mat,const char *name,int rank,
         uncomp_buf[1] = 0;
         z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
         z->avail_in = 8;
-        do {
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->avail_out = buf_size_bytes;
-            deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,buf_size_bytes-z->avail_out,(FILE*)mat->fp);
-        } while ( z->avail_out == 0 );
+        byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
     } else if ( strlen(name) <= 4 ) {
         mat_int16_t array_name_len = (mat_int16_t)strlen(name);
         mat_int16_t array_name_type = MAT_T_INT8;
@@ -2325,13 +2732,7 @@ Mat_WriteCompressedEmptyVariable5(mat_t *mat,const char *name,int rank,
 
         z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
         z->avail_in = 8;
-        do {
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->avail_out = buf_size_bytes;
-            deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,buf_size_bytes-z->avail_out,
-                (FILE*)mat->fp);
-        } while ( z->avail_out == 0 );
+        byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
     } else {
         mat_int32_t array_name_len = (mat_int32_t)strlen(name);
         mat_int32_t array_name_type = MAT_T_INT8;
@@ -2344,13 +2745,7 @@ Mat_WriteCompressedEmptyVariable5(mat_t *mat,const char *name,int rank,
             array_name_len += 8-(array_name_len % 8);
         z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
         z->avail_in = 8+array_name_len;
-        do {
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->avail_out = buf_size_bytes;
-            deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,buf_size_bytes-z->avail_out,
-                (FILE*)mat->fp);
-        } while ( z->avail_out == 0 );
+        byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
     }
 
     byteswritten += WriteCompressedData(mat,z,NULL,0,MAT_T_DOUBLE);
@@ -2371,7 +2766,8 @@ Mat_WriteCompressedEmptyVariable5(mat_t *mat,const char *name,int rank,
 static void
 Mat_VarReadNumeric5(mat_t *mat,matvar_t *matvar,void *data,size_t N)
 {
-    int nBytes = 0, data_in_tag = 0;
+    size_t nBytes = 0;
+    int data_in_tag = 0;
     enum matio_types packed_type = MAT_T_UNKNOWN;
     mat_uint32_t tag[2];
 
@@ -3418,13 +3814,416 @@ Mat_VarRead5(mat_t *mat, matvar_t *matvar)
     return;
 }
 
-#if defined(HAVE_ZLIB)
-#define GET_DATA_SLABN_RANK_LOOP \
-    do { \
-        for ( j = 1; j < rank; j++ ) { \
-            cnt[j]++; \
-            if ( (cnt[j] % edge[j]) == 0 ) { \
-                cnt[j] = 0; \
+/** @if mat_devman
+ * @brief Reads the data of a real numeric version 5 MAT variable
+ *
+ * Reads all the data of the variable into a pre-allocated buffer,
+ * converted to the type of @c class_type.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo5
+ * @param data Pointer to store the data, must have room for all the
+ *        elements of the variable
+ * @param class_type Class type of the data to store
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarReadDataAs5(mat_t *mat,matvar_t *matvar,void *data,
+    enum matio_classes class_type)
+{
+    int err;
+    size_t nelems = 1;
+    long fpos;
+    enum matio_classes stored_class_type;
+
+    if ( matvar->isComplex )
+        return 1;
+#if defined(HAVE_ZLIB)
+    else if ( NULL != matvar->internal->data )
+        return 1;
+#endif
+    err = SafeMulDims(matvar, &nelems);
+    if ( err ) {
+        Mat_Critical("Integer multiplication overflow");
+        return 1;
+    }
+    if ( 0 == nelems )
+        return 0;
+    fpos = ftell((FILE*)mat->fp);
+    if ( fpos == -1L ) {
+        Mat_Critical("Couldn't determine file position");
+        return 1;
+    }
+
+    /* Mat_VarReadNumeric5 converts to the type of the class */
+    stored_class_type = matvar->class_type;
+    matvar->class_type = class_type;
+    (void)fseek((FILE*)mat->fp,matvar->internal->datapos,SEEK_SET);
+    Mat_VarReadNumeric5(mat,matvar,data,nelems);
+    matvar->class_type = stored_class_type;
+    (void)fseek((FILE*)mat->fp,fpos,SEEK_SET);
+
+    return 0;
+}
+
+
+#if defined(HAVE_ZLIB) && defined(HAVE_PTHREAD)
+/** @if mat_devman
+ * @brief State shared by the threads of Mat_VarReadDataAsParallel5
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+struct ParallelRead5 {
+    mat_t *mat;                 /**< MAT file, only read by the threads */
+    int fd;                     /**< File descriptor for positional reads */
+    matvar_t **matvars;         /**< Variables to read */
+    void **data;                /**< Buffers to store the data */
+    const enum matio_classes *class_types; /**< Class to convert to */
+    size_t n;                   /**< Number of variables */
+    size_t next;                /**< Index of the next variable to read */
+    int err;                    /**< Non-zero if a variable failed */
+    pthread_mutex_t lock;       /**< Protects next and err */
+};
+
+/** @if mat_devman
+ * @brief Refills the input of a zlib stream from a positional read
+ *
+ * Reads the next compressed bytes at @c pos, without using (or
+ * moving) the position of the file pointer. From a memory mapped
+ * file the input refers to the mapping.
+ * @ingroup mat_internal
+ * @param p Shared state
+ * @param z zlib stream
+ * @param pos File position of the next compressed byte, updated
+ * @param end File position after the last compressed byte
+ * @param buf Input buffer
+ * @param size Size of the input buffer in bytes
+ * @return Number of bytes available to inflate
+ * @endif
+ */
+static size_t
+ParallelFill5(struct ParallelRead5 *p,z_streamp z,long *pos,long end,
+    mat_uint8_t *buf,size_t size)
+{
+    size_t nbytes;
+    ssize_t nread;
+
+    if ( *pos >= end )
+        return 0;
+    nbytes = (size_t)(end - *pos);
+
+    if ( NULL != p->mat->map ) {
+        if ( (size_t)end > p->mat->map_size )
+            return 0;
+        if ( nbytes > UINT_MAX )
+            nbytes = UINT_MAX;
+        z->next_in = ZLIB_BYTE_PTR((mat_uint8_t*)p->mat->map + *pos);
+    } else {
+        if ( nbytes > size )
+            nbytes = size;
+        do {
+            nread = pread(p->fd,buf,nbytes,(off_t)*pos);
+        } while ( nread < 0 && EINTR == errno );
+        if ( nread <= 0 )
+            return 0;
+        nbytes = (size_t)nread;
+        z->next_in = ZLIB_BYTE_PTR(buf);
+    }
+
+    z->avail_in = (uInt)nbytes;
+    *pos += (long)nbytes;
+
+    return nbytes;
+}
+
+/** @if mat_devman
+ * @brief Inflates a number of bytes from a positional read
+ *
+ * @ingroup mat_internal
+ * @param p Shared state
+ * @param z zlib stream
+ * @param pos File position of the next compressed byte, updated
+ * @param end File position after the last compressed byte
+ * @param buf Input buffer
+ * @param size Size of the input buffer in bytes
+ * @param out Buffer to store the inflated data
+ * @param nbytes Number of bytes to inflate
+ * @retval 0 on success
+ * @endif
+ */
+static int
+ParallelInflate5(struct ParallelRead5 *p,z_streamp z,long *pos,long end,
+    mat_uint8_t *buf,size_t size,void *out,size_t nbytes)
+{
+    int err;
+
+    while ( nbytes > 0 ) {
+        uInt n = (nbytes > UINT_MAX) ? UINT_MAX : (uInt)nbytes;
+
+        z->next_out  = ZLIB_BYTE_PTR(out);
+        z->avail_out = n;
+        while ( z->avail_out ) {
+            if ( !z->avail_in && 0 == ParallelFill5(p,z,pos,end,buf,size) )
+                return 1;
+            err = inflate(z,Z_NO_FLUSH);
+            if ( err == Z_STREAM_END ) {
+                if ( z->avail_out )
+                    return 1;
+            } else if ( err != Z_OK && err != Z_BUF_ERROR ) {
+                return 1;
+            }
+        }
+        out = (mat_uint8_t*)out + n;
+        nbytes -= n;
+    }
+
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Inflates and converts the data of a compressed numeric variable
+ *
+ * Continues the zlib stream of the variable, positioned after the
+ * name by Mat_VarReadNextInfo, with positional reads of the file.
+ * Neither the file pointer nor the R API is used, so the function can
+ * run on any thread; errors are returned instead of reported.
+ * @ingroup mat_internal
+ * @param p Shared state
+ * @param matvar Compressed variable
+ * @param data Buffer to store the data
+ * @param class_type MAT_C_DOUBLE or MAT_C_INT32
+ * @param buf Input buffer
+ * @param size Size of the input and conversion buffers in bytes
+ * @param tmp Conversion buffer
+ * @retval 0 on success
+ * @endif
+ */
+static int
+ParallelReadNumeric5(struct ParallelRead5 *p,matvar_t *matvar,void *data,
+    enum matio_classes class_type,mat_uint8_t *buf,size_t size,void *tmp)
+{
+    z_streamp z = matvar->internal->z;
+    long pos = matvar->internal->datapos;
+    long end = matvar->internal->fpos + matvar->internal->fnbytes;
+    mat_uint32_t tag[2];
+    enum matio_types data_type, out_type;
+    size_t nelems = 1, data_size, out_size, nbytes, n, i;
+    int byteswap = p->mat->byteswap;
+
+    if ( SafeMulDims(matvar,&nelems) )
+        return 1;
+    if ( 0 == nelems )
+        return 0;
+    out_type = (MAT_C_DOUBLE == class_type) ? MAT_T_DOUBLE : MAT_T_INT32;
+    out_size = Mat_SizeOf(out_type);
+
+    if ( ParallelInflate5(p,z,&pos,end,buf,size,tag,8) )
+        return 1;
+    if ( byteswap )
+        (void)Mat_uint32Swap(tag);
+    if ( tag[0] & 0xffff0000 ) {
+        /* Data packed in the tag */
+        data_type = TYPE_FROM_TAG(tag[0]);
+        nbytes    = (tag[0] & 0xffff0000) >> 16;
+        data_size = Mat_SizeOf(data_type);
+        if ( 0 == data_size || nbytes / data_size < nelems )
+            return 1;
+        return ConvertData(data,out_type,tag+1,data_type,nelems,byteswap);
+    }
+    if ( byteswap )
+        (void)Mat_uint32Swap(tag+1);
+    data_type = TYPE_FROM_TAG(tag[0]);
+    nbytes    = tag[1];
+    data_size = Mat_SizeOf(data_type);
+    if ( 0 == data_size || nbytes / data_size < nelems )
+        return 1;
+
+    if ( out_type == data_type && !byteswap ) {
+        /* Inflate straight into the buffer */
+        return ParallelInflate5(p,z,&pos,end,buf,size,data,nelems*data_size);
+    }
+
+    /* Inflate a block at a time and convert it, the byte swap is done
+     * in the same pass */
+    n = size / data_size;
+    for ( i = 0; i < nelems; i += n ) {
+        if ( n > nelems - i )
+            n = nelems - i;
+        if ( ParallelInflate5(p,z,&pos,end,buf,size,tmp,n*data_size) ||
+             ConvertData((mat_uint8_t*)data+i*out_size,out_type,tmp,
+                         data_type,n,byteswap) )
+            return 1;
+    }
+
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Thread function of Mat_VarReadDataAsParallel5
+ *
+ * Reads the variables, one at a time, until all are taken.
+ * @ingroup mat_internal
+ * @param arg Shared state
+ * @return NULL
+ * @endif
+ */
+static void *
+ParallelWorker5(void *arg)
+{
+    struct ParallelRead5 *p = (struct ParallelRead5*)arg;
+    mat_uint8_t *buf;
+    void *tmp;
+    size_t i, size = p->mat->zbuf_size;
+    int err;
+
+    buf = (mat_uint8_t*)malloc(size);
+    tmp = malloc(size);
+    for ( ;; ) {
+        pthread_mutex_lock(&p->lock);
+        i = p->next++;
+        pthread_mutex_unlock(&p->lock);
+        if ( i >= p->n )
+            break;
+        if ( NULL == buf || NULL == tmp )
+            err = 1;
+        else
+            err = ParallelReadNumeric5(p,p->matvars[i],p->data[i],
+                                       p->class_types[i],buf,size,tmp);
+        if ( err ) {
+            pthread_mutex_lock(&p->lock);
+            p->err = 1;
+            pthread_mutex_unlock(&p->lock);
+        }
+    }
+    free(buf);
+    free(tmp);
+
+    return NULL;
+}
+#endif
+
+/** @if mat_devman
+ * @brief Reads the data of several numeric variables
+ *
+ * The compressed variables converted to MAT_C_DOUBLE or MAT_C_INT32
+ * are inflated concurrently on up to @c nthreads threads. Each zlib
+ * stream is independent and the compressed data is read with
+ * positional reads, so the threads share nothing but the list of
+ * variables. The other variables are read one at a time with
+ * Mat_VarReadDataAs after the threads are done.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvars Variables from Mat_VarReadNextInfo, not read yet
+ * @param data Buffers to store the data of each variable
+ * @param class_types Class to convert the data of each variable to
+ * @param n Number of variables
+ * @param nthreads Maximum number of threads
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarReadDataAsParallel5(mat_t *mat,matvar_t **matvars,void **data,
+    const enum matio_classes *class_types,size_t n,int nthreads)
+{
+    size_t i;
+    int err = 0;
+    char *parallel;
+#if defined(HAVE_ZLIB) && defined(HAVE_PTHREAD)
+    struct ParallelRead5 p;
+    matvar_t **jobs_matvars;
+    void **jobs_data;
+    enum matio_classes *jobs_class_types;
+    pthread_t *threads;
+    int nstarted = 0;
+#endif
+
+    if ( 0 == n )
+        return 0;
+    parallel = (char*)calloc(n,1);
+    if ( NULL == parallel )
+        return 1;
+
+#if defined(HAVE_ZLIB) && defined(HAVE_PTHREAD)
+    p.n = 0;
+    for ( i = 0; i < n; i++ ) {
+        matvar_t *matvar = matvars[i];
+        if ( nthreads > 1 && NULL != matvar &&
+             MAT_COMPRESSION_ZLIB == matvar->compression &&
+             NULL != matvar->internal->z && NULL == matvar->internal->data &&
+             !matvar->isComplex && MAT_C_SPARSE != matvar->class_type &&
+             (MAT_C_DOUBLE == class_types[i] || MAT_C_INT32 == class_types[i]) ) {
+            parallel[i] = 1;
+            p.n++;
+        }
+    }
+
+    if ( p.n > 1 ) {
+        jobs_matvars     = (matvar_t**)malloc(p.n*sizeof(*jobs_matvars));
+        jobs_data        = (void**)malloc(p.n*sizeof(*jobs_data));
+        jobs_class_types = (enum matio_classes*)malloc(p.n*sizeof(*jobs_class_types));
+        threads = (pthread_t*)malloc(nthreads*sizeof(*threads));
+        if ( NULL != jobs_matvars && NULL != jobs_data &&
+             NULL != jobs_class_types && NULL != threads ) {
+            size_t j = 0;
+            for ( i = 0; i < n; i++ ) {
+                if ( parallel[i] ) {
+                    jobs_matvars[j]     = matvars[i];
+                    jobs_data[j]        = data[i];
+                    jobs_class_types[j] = class_types[i];
+                    j++;
+                }
+            }
+            p.mat         = mat;
+            p.fd          = fileno((FILE*)mat->fp);
+            p.matvars     = jobs_matvars;
+            p.data        = jobs_data;
+            p.class_types = jobs_class_types;
+            p.next        = 0;
+            p.err         = 0;
+            pthread_mutex_init(&p.lock,NULL);
+            if ( (size_t)nthreads > p.n )
+                nthreads = (int)p.n;
+            for ( ; nstarted < nthreads; nstarted++ ) {
+                if ( pthread_create(threads+nstarted,NULL,ParallelWorker5,&p) )
+                    break;
+            }
+            /* Read what is left if a thread couldn't be started */
+            if ( nstarted < nthreads )
+                (void)ParallelWorker5(&p);
+            for ( i = 0; i < (size_t)nstarted; i++ )
+                pthread_join(threads[i],NULL);
+            pthread_mutex_destroy(&p.lock);
+            err = p.err;
+        } else {
+            memset(parallel,0,n);
+        }
+        free(jobs_matvars);
+        free(jobs_data);
+        free(jobs_class_types);
+        free(threads);
+    } else {
+        memset(parallel,0,n);
+    }
+#endif
+
+    for ( i = 0; i < n && !err; i++ ) {
+        if ( !parallel[i] )
+            err = Mat_VarReadDataAs(mat,matvars[i],data[i],class_types[i]);
+    }
+    free(parallel);
+
+    return err;
+}
+
+#if defined(HAVE_ZLIB)
+#define GET_DATA_SLABN_RANK_LOOP \
+    do { \
+        for ( j = 1; j < rank; j++ ) { \
+            cnt[j]++; \
+            if ( (cnt[j] % edge[j]) == 0 ) { \
+                cnt[j] = 0; \
                 if ( (I % dimp[j]) != 0 ) { \
                     ptr_in += dimp[j]-(I % dimp[j])+dimp[j-1]*start[j]; \
                     I += dimp[j]-(I % dimp[j]) + dimp[j-1]*start[j]; \
@@ -3862,10 +4661,10 @@ GetDataSlab(void *data_in, void *data_out, enum matio_classes class_type,
 #define GET_DATA_LINEAR \
     do { \
         ptr_in += start; \
-        if ( !stride ) { \
+        if ( stride == 1 ) { \
             memcpy(ptr, ptr_in, (size_t)edge*data_size); \
         } else { \
-            int i; \
+            size_t i; \
             for ( i = 0; i < edge; i++ ) \
                 memcpy(ptr++, ptr_in+i*stride, data_size); \
         } \
@@ -3873,7 +4672,7 @@ GetDataSlab(void *data_in, void *data_out, enum matio_classes class_type,
 
 static int
 GetDataLinear(void *data_in, void *data_out, enum matio_classes class_type,
-    enum matio_types data_type, int start, int stride, int edge)
+    enum matio_types data_type, size_t start, size_t stride, size_t edge)
 {
     int err = 0;
     size_t data_size = Mat_SizeOf(data_type);
@@ -4204,8 +5003,8 @@ Mat_VarReadData5(mat_t *mat,matvar_t *matvar,void *data,
  * @retval 0 on success
  */
 int
-Mat_VarReadDataLinear5(mat_t *mat,matvar_t *matvar,void *data,int start,
-                      int stride,int edge)
+Mat_VarReadDataLinear5(mat_t *mat,matvar_t *matvar,void *data,size_t start,
+                      size_t stride,size_t edge)
 {
     int err = 0, real_bytes = 0;
     mat_int32_t tag[2];
@@ -4349,6 +5148,122 @@ Mat_VarReadDataLinear5(mat_t *mat,matvar_t *matvar,void *data,int start,
     return err;
 }
 
+/** @if mat_devman
+ * @brief Writes an uncompressed variable through the output buffer
+ *
+ * The size of the variable is counted in a dry run and written
+ * before the variable, see CountBytes5.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar pointer to the mat variable
+ * @retval 0 on success
+ * @endif
+ */
+static int
+Mat_WriteVariable5(mat_t *mat,matvar_t *matvar)
+{
+    mat_uint32_t array_flags;
+    int array_flags_type = MAT_T_UINT32, dims_array_type = MAT_T_INT32;
+    int array_flags_size = 8, pad4 = 0, matrix_type = MAT_T_MATRIX;
+    int nBytes, i, nzmax = 0;
+    enum matio_classes class_type = matvar->class_type;
+
+    BufWrite5(mat,&matrix_type,4,1);
+    nBytes = mat->wcount ? 0 : (int)(CountBytes5(mat,Mat_WriteVariable5,matvar) - 8);
+    BufWrite5(mat,&nBytes,4,1);
+
+    /* Array Flags */
+    array_flags = matvar->class_type & CLASS_TYPE_MASK;
+    if ( matvar->isComplex )
+        array_flags |= MAT_F_COMPLEX;
+    if ( matvar->isGlobal )
+        array_flags |= MAT_F_GLOBAL;
+    if ( matvar->isLogical )
+        array_flags |= MAT_F_LOGICAL;
+    if ( matvar->class_type == MAT_C_SPARSE )
+        nzmax = ((mat_sparse_t *)matvar->data)->nzmax;
+
+    BufWrite5(mat,&array_flags_type,4,1);
+    BufWrite5(mat,&array_flags_size,4,1);
+    BufWrite5(mat,&array_flags,4,1);
+    BufWrite5(mat,&nzmax,4,1);
+    /* Rank and Dimension */
+    nBytes = matvar->rank * 4;
+    BufWrite5(mat,&dims_array_type,4,1);
+    BufWrite5(mat,&nBytes,4,1);
+    for ( i = 0; i < matvar->rank; i++ ) {
+        mat_int32_t dim;
+        dim = matvar->dims[i];
+        BufWrite5(mat,&dim,4,1);
+    }
+    if ( matvar->rank % 2 != 0 )
+        BufWrite5(mat,&pad4,4,1);
+    /* Name of variable */
+    if ( strlen(matvar->name) <= 4 ) {
+        mat_int32_t  array_name_type = MAT_T_INT8;
+        mat_int32_t array_name_len   = (mat_int32_t)strlen(matvar->name);
+        mat_int8_t  pad1 = 0;
+
+        array_name_type = (array_name_len << 16) | array_name_type;
+        BufWrite5(mat,&array_name_type,4,1);
+        BufWrite5(mat,matvar->name,1,array_name_len);
+        for ( i = array_name_len; i < 4; i++ )
+            BufWrite5(mat,&pad1,1,1);
+    } else {
+        mat_int32_t array_name_type = MAT_T_INT8;
+        mat_int32_t array_name_len  = (mat_int32_t)strlen(matvar->name);
+        mat_int8_t  pad1 = 0;
+
+        BufWrite5(mat,&array_name_type,4,1);
+        BufWrite5(mat,&array_name_len,4,1);
+        BufWrite5(mat,matvar->name,1,array_name_len);
+        if ( array_name_len % 8 )
+            for ( i = array_name_len % 8; i < 8; i++ )
+                BufWrite5(mat,&pad1,1,1);
+    }
+
+    if ( NULL != matvar->internal ) {
+        if ( !mat->wcount )
+            matvar->internal->datapos = (long)mat->wbytes;
+    } else {
+        /* Must be empty */
+        matvar->class_type = MAT_C_EMPTY;
+    }
+    WriteType(mat,matvar);
+    /* A dry run leaves the variable as it is */
+    if ( mat->wcount )
+        matvar->class_type = class_type;
+
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Checks that a variable fits in a version 5 MAT file
+ *
+ * The sizes in the tags of a version 5 MAT file are 32-bit and the
+ * dimensions are 32-bit signed integers. This limits the variable,
+ * uncompressed, to 4 GB and each dimension to INT_MAX elements.
+ * @ingroup mat_internal
+ * @param matvar pointer to the mat variable
+ * @retval 0 if the variable can be written
+ * @endif
+ */
+int
+Mat_VarCheckSize5(matvar_t *matvar)
+{
+    int i;
+
+    if ( NULL == matvar )
+        return 1;
+
+    for ( i = 0; NULL != matvar->dims && i < matvar->rank; i++ ) {
+        if ( matvar->dims[i] > INT_MAX )
+            return 1;
+    }
+
+    return GetMatrixMaxBufSize(matvar) > 0xffffffffUL;
+}
+
 /** @if mat_devman
  * @brief Writes a matlab variable to a version 5 matlab file
  *
@@ -4378,101 +5293,54 @@ Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress)
     if ( NULL == matvar || NULL == matvar->name )
         return -1;
 
+    /* Write at the end of the file through the output buffer */
+    mat->wbytes = ftell((FILE*)mat->fp);
+    if ( -1L == (long)mat->wbytes )
+        return -1;
+
 #if defined(HAVE_ZLIB)
     if ( compress == MAT_COMPRESSION_NONE ) {
 #else
     {
 #endif
-        fwrite(&matrix_type,4,1,(FILE*)mat->fp);
-        fwrite(&pad4,4,1,(FILE*)mat->fp);
-        start = ftell((FILE*)mat->fp);
-
-        /* Array Flags */
-        array_flags = matvar->class_type & CLASS_TYPE_MASK;
-        if ( matvar->isComplex )
-            array_flags |= MAT_F_COMPLEX;
-        if ( matvar->isGlobal )
-            array_flags |= MAT_F_GLOBAL;
-        if ( matvar->isLogical )
-            array_flags |= MAT_F_LOGICAL;
-        if ( matvar->class_type == MAT_C_SPARSE )
-            nzmax = ((mat_sparse_t *)matvar->data)->nzmax;
-
-        fwrite(&array_flags_type,4,1,(FILE*)mat->fp);
-        fwrite(&array_flags_size,4,1,(FILE*)mat->fp);
-        fwrite(&array_flags,4,1,(FILE*)mat->fp);
-        fwrite(&nzmax,4,1,(FILE*)mat->fp);
-        /* Rank and Dimension */
-        nBytes = matvar->rank * 4;
-        fwrite(&dims_array_type,4,1,(FILE*)mat->fp);
-        fwrite(&nBytes,4,1,(FILE*)mat->fp);
-        for ( i = 0; i < matvar->rank; i++ ) {
-            mat_int32_t dim;
-            dim = matvar->dims[i];
-            fwrite(&dim,4,1,(FILE*)mat->fp);
-        }
-        if ( matvar->rank % 2 != 0 )
-            fwrite(&pad4,4,1,(FILE*)mat->fp);
-        /* Name of variable */
-        if ( strlen(matvar->name) <= 4 ) {
-            mat_int32_t  array_name_type = MAT_T_INT8;
-            mat_int32_t array_name_len   = (mat_int32_t)strlen(matvar->name);
-            mat_int8_t  pad1 = 0;
-#if 0
-            fwrite(&array_name_type,2,1,(FILE*)mat->fp);
-            fwrite(&array_name_len,2,1,(FILE*)mat->fp);
-#else
-            array_name_type = (array_name_len << 16) | array_name_type;
-            fwrite(&array_name_type,4,1,(FILE*)mat->fp);
-#endif
-            fwrite(matvar->name,1,array_name_len,(FILE*)mat->fp);
-            for ( i = array_name_len; i < 4; i++ )
-                fwrite(&pad1,1,1,(FILE*)mat->fp);
-        } else {
-            mat_int32_t array_name_type = MAT_T_INT8;
-            mat_int32_t array_name_len  = (mat_int32_t)strlen(matvar->name);
-            mat_int8_t  pad1 = 0;
-
-            fwrite(&array_name_type,4,1,(FILE*)mat->fp);
-            fwrite(&array_name_len,4,1,(FILE*)mat->fp);
-            fwrite(matvar->name,1,array_name_len,(FILE*)mat->fp);
-            if ( array_name_len % 8 )
-                for ( i = array_name_len % 8; i < 8; i++ )
-                    fwrite(&pad1,1,1,(FILE*)mat->fp);
-        }
-
-        if ( NULL != matvar->internal ) {
-            matvar->internal->datapos = ftell((FILE*)mat->fp);
-            if ( matvar->internal->datapos == -1L ) {
-                Mat_Critical("Couldn't determine file position");
-            }
-        } else {
-            /* Must be empty */
-            matvar->class_type = MAT_C_EMPTY;
-        }
-        WriteType(mat,matvar);
+        Mat_WriteVariable5(mat,matvar);
+        if ( BufFlush5(mat) )
+            return -1;
+        return 0;
 #if defined(HAVE_ZLIB)
     } else if ( compress == MAT_COMPRESSION_ZLIB ) {
-        mat_uint32_t comp_buf[512];
         mat_uint32_t uncomp_buf[512] = {0,};
         int buf_size = 512, err;
         size_t byteswritten = 0;
         z_streamp z;
+        int level = mat->compression_level;
+        enum matio_compression_strategy strategy = mat->compression_strategy;
+
+        /* Pick the settings of the variable, they are restored after
+         * the variable is written */
+        if ( MAT_COMPRESSION_LEVEL_AUTO == level )
+            DeflateAuto5(matvar,&mat->compression_level,
+                &mat->compression_strategy);
 
         z = (z_streamp)calloc(1,sizeof(*z));
-        if ( z == NULL )
+        if ( z == NULL ) {
+            mat->compression_level    = level;
+            mat->compression_strategy = strategy;
             return -1;
-        err = deflateInit(z,Z_DEFAULT_COMPRESSION);
+        }
+        err = deflateInit2(z,mat->compression_level,Z_DEFLATED,MAX_WBITS,8,
+                  DeflateStrategy5(mat->compression_strategy));
         if ( err != Z_OK ) {
             free(z);
-            Mat_Critical("deflateInit returned %s",zError(err));
+            mat->compression_level    = level;
+            mat->compression_strategy = strategy;
             return -1;
         }
 
         matrix_type = MAT_T_COMPRESSED;
-        fwrite(&matrix_type,4,1,(FILE*)mat->fp);
-        fwrite(&pad4,4,1,(FILE*)mat->fp);
-        start = ftell((FILE*)mat->fp);
+        BufWrite5(mat,&matrix_type,4,1);
+        BufWrite5(mat,&pad4,4,1);
+        start = (long)mat->wbytes;
 
         /* Array Flags */
         array_flags = matvar->class_type & CLASS_TYPE_MASK;
@@ -4489,13 +5357,7 @@ Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress)
         uncomp_buf[1] = (int)GetMatrixMaxBufSize(matvar);
         z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
         z->avail_in = 8;
-        do {
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->avail_out = buf_size*sizeof(*comp_buf);
-            deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,
-                buf_size*sizeof(*comp_buf)-z->avail_out,(FILE*)mat->fp);
-        } while ( z->avail_out == 0 );
+        byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
         uncomp_buf[0] = array_flags_type;
         uncomp_buf[1] = array_flags_size;
         uncomp_buf[2] = array_flags;
@@ -4516,13 +5378,7 @@ Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress)
 
         z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
         z->avail_in = (6+i)*sizeof(*uncomp_buf);
-        do {
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->avail_out = buf_size*sizeof(*comp_buf);
-            deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,
-                buf_size*sizeof(*comp_buf)-z->avail_out,(FILE*)mat->fp);
-        } while ( z->avail_out == 0 );
+        byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
         /* Name of variable */
         if ( strlen(matvar->name) <= 4 ) {
             mat_int16_t array_name_len = (mat_int16_t)strlen(matvar->name);
@@ -4536,13 +5392,7 @@ Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress)
 
             z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
             z->avail_in = 8;
-            do {
-                z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                z->avail_out = buf_size*sizeof(*comp_buf);
-                deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(comp_buf,1,
-                    buf_size*sizeof(*comp_buf)-z->avail_out,(FILE*)mat->fp);
-            } while ( z->avail_out == 0 );
+            byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
         } else {
             mat_int32_t array_name_len = (mat_int32_t)strlen(matvar->name);
             mat_int32_t array_name_type = MAT_T_INT8;
@@ -4555,19 +5405,10 @@ Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress)
                 array_name_len += 8-(array_name_len % 8);
             z->next_in  = ZLIB_BYTE_PTR(uncomp_buf);
             z->avail_in = 8+array_name_len;
-            do {
-                z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                z->avail_out = buf_size*sizeof(*comp_buf);
-                deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(comp_buf,1,
-                    buf_size*sizeof(*comp_buf)-z->avail_out,(FILE*)mat->fp);
-            } while ( z->avail_out == 0 );
+            byteswritten += BufDeflate5(mat,z,Z_NO_FLUSH);
         }
         if ( NULL != matvar->internal ) {
-            matvar->internal->datapos = ftell((FILE*)mat->fp);
-            if ( matvar->internal->datapos == -1L ) {
-                Mat_Critical("Couldn't determine file position");
-            }
+            matvar->internal->datapos = (long)mat->wbytes;
         } else {
             /* Must be empty */
             matvar->class_type = MAT_C_EMPTY;
@@ -4575,13 +5416,7 @@ Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress)
         WriteCompressedType(mat,matvar,z);
         z->next_in  = NULL;
         z->avail_in = 0;
-        do {
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->avail_out = buf_size*sizeof(*comp_buf);
-            err = deflate(z,Z_FINISH);
-            byteswritten += fwrite(comp_buf,1,
-                buf_size*sizeof(*comp_buf)-z->avail_out,(FILE*)mat->fp);
-        } while ( err != Z_STREAM_END && z->avail_out == 0 );
+        byteswritten += BufDeflate5(mat,z,Z_FINISH);
 #if 0
         if ( byteswritten % 8 )
             for ( i = 0; i < 8-(byteswritten % 8); i++ )
@@ -4589,31 +5424,78 @@ Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress)
 #endif
         (void)deflateEnd(z);
         free(z);
+        mat->compression_level    = level;
+        mat->compression_strategy = strategy;
 #endif
     }
-    end = ftell((FILE*)mat->fp);
-    if ( start != -1L && end != -1L ) {
-        nBytes = (int)(end-start);
-        (void)fseek((FILE*)mat->fp,(long)-(nBytes+4),SEEK_CUR);
+    end = (long)mat->wbytes;
+    nBytes = (int)(end-start);
+    if ( (size_t)(end-start+4) <= mat->wbuf_len ) {
+        /* The variable is still in the output buffer */
+        memcpy((mat_uint8_t*)mat->wbuf+mat->wbuf_len-(end-start+4),&nBytes,4);
+        if ( BufFlush5(mat) )
+            return -1;
+    } else {
+        if ( BufFlush5(mat) )
+            return -1;
+        (void)fseek((FILE*)mat->fp,start-4,SEEK_SET);
         fwrite(&nBytes,4,1,(FILE*)mat->fp);
         (void)fseek((FILE*)mat->fp,end,SEEK_SET);
-    } else {
-        Mat_Critical("Couldn't determine file position");
     }
 
     return 0;
 }
 
+/** @if mat_devman
+ * @brief Checks if a predicate rejects the next MAT variable
+ *
+ * @ingroup mat_internal
+ * @param pred Predicate on the variable name or NULL
+ * @param name Name of the variable, may be NULL
+ * @param user_data Data passed to the predicate
+ * @param[out] skipped Set to 1 if the variable is rejected, or -1 if
+ *             the predicate also stops the scan
+ * @retval 1 if the variable is rejected, else 0
+ * @endif
+ */
+static int
+SkipNextInfo5(mat_iter_pred_t pred,const char *name,const void *user_data,
+    int *skipped)
+{
+    int accept;
+
+    if ( NULL == pred )
+        return 0;
+
+    accept = pred(name,user_data);
+    if ( accept > 0 )
+        return 0;
+
+    *skipped = accept < 0 ? -1 : 1;
+
+    return 1;
+}
+
 /** @if mat_devman
  * @brief Reads the header information for the next MAT variable
  *
+ * If a predicate is given and it rejects the name of the variable,
+ * the nested struct/cell fields are not read, the file is positioned
+ * past the variable and NULL is returned with @c skipped set.
  * @ingroup mat_internal
  * @param mat MAT file pointer
+ * @param pred Predicate on the variable name or NULL
+ * @param user_data Data passed to the predicate
+ * @param shallow If non-zero, the nested struct/cell fields and
+ *        function handles are not read
+ * @param[out] skipped Set to 1 if the variable was rejected by pred,
+ *             or -1 if pred also stopped the scan
  * @return pointer to the MAT variable or NULL
  * @endif
  */
-matvar_t *
-Mat_VarReadNextInfo5( mat_t *mat )
+static matvar_t *
+ReadNextInfo5(mat_t *mat,mat_iter_pred_t pred,const void *user_data,
+    int shallow,int *skipped)
 {
     int err;
     mat_int32_t data_type, nBytes;
@@ -4647,6 +5529,8 @@ Mat_VarReadNextInfo5( mat_t *mat )
 
             matvar               = Mat_VarCalloc();
             matvar->compression  = MAT_COMPRESSION_ZLIB;
+            matvar->internal->fpos    = fpos;
+            matvar->internal->fnbytes = nBytes+8;
 
             matvar->internal->z = (z_streamp)calloc(1,sizeof(z_stream));
             err = inflateInit(matvar->internal->z);
@@ -4751,15 +5635,20 @@ Mat_VarReadNextInfo5( mat_t *mat )
                         }
                     }
                 }
-                if ( matvar->class_type == MAT_C_STRUCT )
-                    (void)ReadNextStructField(mat,matvar);
-                else if ( matvar->class_type == MAT_C_CELL )
-                    (void)ReadNextCell(mat,matvar);
+                if ( !SkipNextInfo5(pred,matvar->name,user_data,skipped) &&
+                     !shallow ) {
+                    if ( matvar->class_type == MAT_C_STRUCT )
+                        (void)ReadNextStructField(mat,matvar);
+                    else if ( matvar->class_type == MAT_C_CELL )
+                        (void)ReadNextCell(mat,matvar);
+                }
                 (void)fseek((FILE*)mat->fp,-(int)matvar->internal->z->avail_in,SEEK_CUR);
                 matvar->internal->datapos = ftell((FILE*)mat->fp);
                 if ( matvar->internal->datapos == -1L ) {
                     Mat_Critical("Couldn't determine file position");
                 }
+            } else {
+                (void)SkipNextInfo5(pred,NULL,user_data,skipped);
             }
             (void)fseek((FILE*)mat->fp,nBytes+8+fpos,SEEK_SET);
             break;
@@ -4776,6 +5665,8 @@ Mat_VarReadNextInfo5( mat_t *mat )
             size_t bytesread = 0;
 
             matvar = Mat_VarCalloc();
+            matvar->internal->fpos    = fpos;
+            matvar->internal->fnbytes = nBytes+8;
 
             /* Read array flags and the dimensions tag */
             bytesread += fread(buf,4,6,(FILE*)mat->fp);
@@ -4838,12 +5729,15 @@ Mat_VarReadNextInfo5( mat_t *mat )
                     }
                 }
             }
-            if ( matvar->class_type == MAT_C_STRUCT )
-                (void)ReadNextStructField(mat,matvar);
-            else if ( matvar->class_type == MAT_C_CELL )
-                (void)ReadNextCell(mat,matvar);
-            else if ( matvar->class_type == MAT_C_FUNCTION )
-                (void)ReadNextFunctionHandle(mat,matvar);
+            if ( !SkipNextInfo5(pred,matvar->name,user_data,skipped) &&
+                 !shallow ) {
+                if ( matvar->class_type == MAT_C_STRUCT )
+                    (void)ReadNextStructField(mat,matvar);
+                else if ( matvar->class_type == MAT_C_CELL )
+                    (void)ReadNextCell(mat,matvar);
+                else if ( matvar->class_type == MAT_C_FUNCTION )
+                    (void)ReadNextFunctionHandle(mat,matvar);
+            }
             matvar->internal->datapos = ftell((FILE*)mat->fp);
             if ( matvar->internal->datapos == -1L ) {
                 Mat_Critical("Couldn't determine file position");
@@ -4857,5 +5751,75 @@ Mat_VarReadNextInfo5( mat_t *mat )
             return NULL;
     }
 
+    if ( *skipped ) {
+        Mat_VarFree(matvar);
+        matvar = NULL;
+    }
+
+    return matvar;
+}
+
+/** @if mat_devman
+ * @brief Reads the header information for the next MAT variable
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @return pointer to the MAT variable or NULL
+ * @endif
+ */
+matvar_t *
+Mat_VarReadNextInfo5( mat_t *mat )
+{
+    int skipped = 0;
+
+    return ReadNextInfo5(mat,NULL,NULL,0,&skipped);
+}
+
+/** @if mat_devman
+ * @brief Reads the header information for the next MAT variable
+ *        without reading nested struct/cell fields
+ *
+ * Only the array flags, dimensions and name of the variable are
+ * read.  Struct fields, cell elements and function handles are not
+ * decoded and compressed variables are only inflated up to the name.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @return pointer to the MAT variable or NULL
+ * @endif
+ */
+matvar_t *
+Mat_VarReadNextInfoShallow5( mat_t *mat )
+{
+    int skipped = 0;
+
+    return ReadNextInfo5(mat,NULL,NULL,1,&skipped);
+}
+
+/** @if mat_devman
+ * @brief Reads the header information for the next MAT variable
+ *        accepted by a predicate
+ *
+ * Variables whose name is rejected by the predicate are skipped by
+ * seeking past their tag without reading (or inflating) their data,
+ * until the predicate stops the scan.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param pred Predicate on the variable name
+ * @param user_data Data passed to the predicate
+ * @return pointer to the MAT variable or NULL
+ * @endif
+ */
+matvar_t *
+Mat_VarReadNextInfoPredicate5(mat_t *mat,mat_iter_pred_t pred,
+    const void *user_data)
+{
+    matvar_t *matvar;
+    int skipped;
+
+    do {
+        skipped = 0;
+        matvar = ReadNextInfo5(mat,pred,user_data,0,&skipped);
+    } while ( NULL == matvar && skipped > 0 );
+
     return matvar;
 }
@@ -36,11 +36,20 @@
 EXTERN mat_t    *Mat_Create5(const char *matname,const char *hdr_str);
 
 EXTERN matvar_t *Mat_VarReadNextInfo5( mat_t *mat );
+EXTERN matvar_t *Mat_VarReadNextInfoShallow5( mat_t *mat );
+EXTERN matvar_t *Mat_VarReadNextInfoPredicate5(mat_t *mat,mat_iter_pred_t pred,
+                     const void *user_data);
 EXTERN void      Mat_VarRead5(mat_t *mat, matvar_t *matvar);
+EXTERN int       Mat_VarReadDataAs5(mat_t *mat,matvar_t *matvar,void *data,
+                     enum matio_classes class_type);
+EXTERN int       Mat_VarReadDataAsParallel5(mat_t *mat,matvar_t **matvars,
+                     void **data,const enum matio_classes *class_types,
+                     size_t n,int nthreads);
 EXTERN int       Mat_VarReadData5(mat_t *mat,matvar_t *matvar,void *data,
                      int *start,int *stride,int *edge);
 EXTERN int       Mat_VarReadDataLinear5(mat_t *mat,matvar_t *matvar,void *data,
-                     int start,int stride,int edge);
+                     size_t start,size_t stride,size_t edge);
+EXTERN int       Mat_VarCheckSize5(matvar_t *matvar);
 EXTERN int       Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress);
 
 #endif
@@ -0,0 +1,1505 @@
+/** @file mat73.c
+ * Matlab MAT version 7.3 file functions
+ * @ingroup MAT
+ */
+/*
+ * Copyright (c) 2005-2019, Christopher C. Hulbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The version 7.3 MAT file is a HDF5 file with a 512 byte user block
+ * that holds the MAT file header. Each variable is a dataset or a
+ * group in the root group, with the MATLAB class in the attribute
+ * MATLAB_class and the dimensions in reverse order. Cell arrays and
+ * the fields of structure arrays are datasets of object references
+ * to the elements in the group #refs#. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include "matio_private.h"
+#include "mat73.h"
+
+#if defined(MAT73) && MAT73
+
+#if H5_VERSION_GE(1,10,0)
+#   define H5RDEREF(obj_id,ref) H5Rdereference2((obj_id),H5P_DEFAULT,H5R_OBJECT,(ref))
+#else
+#   define H5RDEREF(obj_id,ref) H5Rdereference((obj_id),H5R_OBJECT,(ref))
+#endif
+
+#if H5_VERSION_GE(1,12,0)
+#   define H5RECLAIM(type_id,space_id,buf) H5Treclaim((type_id),(space_id),H5P_DEFAULT,(buf))
+#else
+#   define H5RECLAIM(type_id,space_id,buf) H5Dvlen_reclaim((type_id),(space_id),H5P_DEFAULT,(buf))
+#endif
+
+/* Upper limit in bytes of the chunk cache of a dataset, see SetChunkCache73 */
+#define MAT73_CHUNK_CACHE_SIZE 67108864
+
+/* Upper limit of the number of slots of the chunk cache of a dataset */
+#define MAT73_CHUNK_CACHE_SLOTS 1000000
+
+static const struct {
+    const char *name;
+    enum matio_classes class_type;
+} ClassNames73[] = {
+    {"double",          MAT_C_DOUBLE},
+    {"single",          MAT_C_SINGLE},
+    {"int64",           MAT_C_INT64},
+    {"uint64",          MAT_C_UINT64},
+    {"int32",           MAT_C_INT32},
+    {"uint32",          MAT_C_UINT32},
+    {"int16",           MAT_C_INT16},
+    {"uint16",          MAT_C_UINT16},
+    {"int8",            MAT_C_INT8},
+    {"uint8",           MAT_C_UINT8},
+    {"logical",         MAT_C_UINT8},
+    {"char",            MAT_C_CHAR},
+    {"cell",            MAT_C_CELL},
+    {"struct",          MAT_C_STRUCT},
+    {"function_handle", MAT_C_FUNCTION}
+};
+
+static hid_t     ClassTypeToH5T(enum matio_classes class_type);
+static enum matio_classes ClassTypeFromH5T(hid_t type_id);
+static int       ReadClassType73(hid_t obj_id,matvar_t *matvar);
+static int       ReadAttrUInt64(hid_t obj_id,const char *name,
+                     mat_uint64_t *value);
+static int       ReadDims73(hid_t dset_id,matvar_t *matvar);
+static hid_t     SetChunkCache73(mat_t *mat,hid_t dset_id);
+static int       ReadFieldNames73(hid_t obj_id,matvar_t *matvar);
+static matvar_t *ReadObjectInfo73(mat_t *mat,hid_t obj_id,const char *name);
+static int       ReadDatasetInfo73(mat_t *mat,matvar_t *matvar);
+static int       ReadCellInfo73(mat_t *mat,matvar_t *matvar);
+static int       ReadGroupInfo73(mat_t *mat,matvar_t *matvar);
+static int       ReadStructInfo73(mat_t *mat,matvar_t *matvar);
+static int       ReadData73(hid_t dset_id,hid_t mem_type_id,hid_t mem_space_id,
+                     hid_t file_space_id,int isComplex,void *data);
+static int       ReadSparse73(matvar_t *matvar);
+static int       SelectLinear73(hid_t space_id,int rank,const hsize_t *dims,
+                     int k,hsize_t *start,hsize_t *count,hsize_t first,
+                     hsize_t n,int *nsel);
+
+/*
+ *===================================================================
+ *                 Private Functions
+ *===================================================================
+ */
+
+/** @brief Returns the HDF5 memory type of a class
+ *
+ * @ingroup mat_internal
+ * @param class_type class type of the data
+ * @return the native HDF5 type, or -1 if the class is not numeric
+ */
+static hid_t
+ClassTypeToH5T(enum matio_classes class_type)
+{
+    switch ( class_type ) {
+        case MAT_C_DOUBLE:
+            return H5T_NATIVE_DOUBLE;
+        case MAT_C_SINGLE:
+            return H5T_NATIVE_FLOAT;
+        case MAT_C_INT64:
+            return H5T_NATIVE_INT64;
+        case MAT_C_UINT64:
+            return H5T_NATIVE_UINT64;
+        case MAT_C_INT32:
+            return H5T_NATIVE_INT32;
+        case MAT_C_UINT32:
+            return H5T_NATIVE_UINT32;
+        case MAT_C_INT16:
+            return H5T_NATIVE_INT16;
+        case MAT_C_UINT16:
+            return H5T_NATIVE_UINT16;
+        case MAT_C_INT8:
+            return H5T_NATIVE_INT8;
+        case MAT_C_UINT8:
+            return H5T_NATIVE_UINT8;
+        default:
+            return -1;
+    }
+}
+
+/** @brief Returns the class of the data of a dataset without a MATLAB class
+ *
+ * @ingroup mat_internal
+ * @param type_id HDF5 type of the dataset
+ * @return the class type, or MAT_C_EMPTY if it is not supported
+ */
+static enum matio_classes
+ClassTypeFromH5T(hid_t type_id)
+{
+    size_t size = H5Tget_size(type_id);
+
+    switch ( H5Tget_class(type_id) ) {
+        case H5T_FLOAT:
+            return (size == sizeof(float)) ? MAT_C_SINGLE : MAT_C_DOUBLE;
+        case H5T_INTEGER:
+        {
+            int is_signed = (H5T_SGN_NONE != H5Tget_sign(type_id));
+
+            switch ( size ) {
+                case 1:
+                    return is_signed ? MAT_C_INT8 : MAT_C_UINT8;
+                case 2:
+                    return is_signed ? MAT_C_INT16 : MAT_C_UINT16;
+                case 4:
+                    return is_signed ? MAT_C_INT32 : MAT_C_UINT32;
+                case 8:
+                    return is_signed ? MAT_C_INT64 : MAT_C_UINT64;
+                default:
+                    return MAT_C_EMPTY;
+            }
+        }
+        case H5T_COMPOUND:
+        {
+            enum matio_classes class_type = MAT_C_EMPTY;
+            hid_t member_id;
+
+            if ( H5Tget_nmembers(type_id) < 1 )
+                return MAT_C_EMPTY;
+            member_id = H5Tget_member_type(type_id,0);
+            if ( member_id >= 0 ) {
+                class_type = ClassTypeFromH5T(member_id);
+                H5Tclose(member_id);
+            }
+            return class_type;
+        }
+        case H5T_REFERENCE:
+            return MAT_C_CELL;
+        default:
+            return MAT_C_EMPTY;
+    }
+}
+
+/** @brief Reads the MATLAB class of a dataset or group
+ *
+ * Sets the class type and the logical flag of the variable from the
+ * MATLAB_class attribute. A MATLAB object, or a class that is not
+ * known, is read as MAT_C_OPAQUE.
+ * @ingroup mat_internal
+ * @param obj_id HDF5 dataset or group
+ * @param matvar MAT variable
+ * @retval 0 if the object has a MATLAB class
+ */
+static int
+ReadClassType73(hid_t obj_id,matvar_t *matvar)
+{
+    hid_t attr_id, type_id, mem_type_id;
+    size_t size, i;
+    char *name;
+    int err = 1;
+
+    if ( 0 >= H5Aexists(obj_id,"MATLAB_class") )
+        return 1;
+
+    attr_id = H5Aopen(obj_id,"MATLAB_class",H5P_DEFAULT);
+    if ( attr_id < 0 )
+        return 1;
+    type_id = H5Aget_type(attr_id);
+    size = H5Tget_size(type_id);
+    name = (char*)calloc(size+1,1);
+    mem_type_id = H5Tcopy(H5T_C_S1);
+    if ( NULL != name && mem_type_id >= 0 && H5T_STRING == H5Tget_class(type_id) &&
+         !H5Tis_variable_str(type_id) && 0 <= H5Tset_size(mem_type_id,size) &&
+         0 <= H5Aread(attr_id,mem_type_id,name) ) {
+        matvar->class_type = MAT_C_OPAQUE;
+        for ( i = 0; i < sizeof(ClassNames73)/sizeof(ClassNames73[0]); i++ ) {
+            if ( 0 == strcmp(name,ClassNames73[i].name) ) {
+                matvar->class_type = ClassNames73[i].class_type;
+                matvar->isLogical  = (0 == strcmp(name,"logical"));
+                break;
+            }
+        }
+        err = 0;
+    }
+    if ( mem_type_id >= 0 )
+        H5Tclose(mem_type_id);
+    free(name);
+    H5Tclose(type_id);
+    H5Aclose(attr_id);
+
+    return err;
+}
+
+/** @brief Reads a scalar integer attribute
+ *
+ * @ingroup mat_internal
+ * @param obj_id HDF5 dataset or group
+ * @param name Name of the attribute
+ * @param[out] value Value of the attribute
+ * @retval 0 if the object has the attribute
+ */
+static int
+ReadAttrUInt64(hid_t obj_id,const char *name,mat_uint64_t *value)
+{
+    hid_t attr_id;
+    int err;
+
+    if ( 0 >= H5Aexists(obj_id,name) )
+        return 1;
+
+    attr_id = H5Aopen(obj_id,name,H5P_DEFAULT);
+    if ( attr_id < 0 )
+        return 1;
+    err = (0 > H5Aread(attr_id,H5T_NATIVE_UINT64,value));
+    H5Aclose(attr_id);
+
+    return err;
+}
+
+/** @brief Reads the dimensions of a dataset
+ *
+ * The dimensions of a HDF5 dataset are in the reverse order of the
+ * MATLAB dimensions. The dimensions of an empty variable, with the
+ * attribute MATLAB_empty, are stored in the dataset.
+ * @ingroup mat_internal
+ * @param dset_id HDF5 dataset
+ * @param matvar MAT variable
+ * @retval 0 on success
+ */
+static int
+ReadDims73(hid_t dset_id,matvar_t *matvar)
+{
+    hid_t space_id;
+    hsize_t dims[H5S_MAX_RANK];
+    mat_uint64_t empty = 0;
+    int rank, k;
+
+    space_id = H5Dget_space(dset_id);
+    if ( space_id < 0 )
+        return 1;
+    rank = H5Sget_simple_extent_ndims(space_id);
+    if ( rank < 0 || rank > H5S_MAX_RANK ||
+         rank != H5Sget_simple_extent_dims(space_id,dims,NULL) ) {
+        H5Sclose(space_id);
+        return 1;
+    }
+
+    (void)ReadAttrUInt64(dset_id,"MATLAB_empty",&empty);
+    if ( empty ) {
+        hssize_t npoints = H5Sget_simple_extent_npoints(space_id);
+        mat_uint64_t *empty_dims;
+
+        H5Sclose(space_id);
+        if ( npoints < 2 ) {
+            matvar->rank = 2;
+            matvar->dims = (size_t*)calloc(2,sizeof(*matvar->dims));
+            return (NULL == matvar->dims);
+        }
+        empty_dims = (mat_uint64_t*)malloc((size_t)npoints*sizeof(*empty_dims));
+        if ( NULL == empty_dims )
+            return 1;
+        if ( 0 > H5Dread(dset_id,H5T_NATIVE_UINT64,H5S_ALL,H5S_ALL,
+                         H5P_DEFAULT,empty_dims) ) {
+            free(empty_dims);
+            return 1;
+        }
+        matvar->rank = (int)npoints;
+        matvar->dims = (size_t*)malloc(matvar->rank*sizeof(*matvar->dims));
+        if ( NULL != matvar->dims ) {
+            for ( k = 0; k < matvar->rank; k++ )
+                matvar->dims[k] = (size_t)empty_dims[k];
+        }
+        free(empty_dims);
+        return (NULL == matvar->dims);
+    }
+    H5Sclose(space_id);
+
+    if ( rank < 2 ) {
+        /* Not written by MATLAB, read as a column vector */
+        matvar->rank = 2;
+        matvar->dims = (size_t*)malloc(2*sizeof(*matvar->dims));
+        if ( NULL == matvar->dims )
+            return 1;
+        matvar->dims[0] = (rank == 1) ? (size_t)dims[0] : 1;
+        matvar->dims[1] = 1;
+        return 0;
+    }
+
+    matvar->rank = rank;
+    matvar->dims = (size_t*)malloc(rank*sizeof(*matvar->dims));
+    if ( NULL == matvar->dims )
+        return 1;
+    for ( k = 0; k < rank; k++ )
+        matvar->dims[k] = (size_t)dims[rank-k-1];
+
+    return 0;
+}
+
+/** @brief Sizes the chunk cache of a chunked dataset
+ *
+ * The default chunk cache of HDF5 (1 MB) is smaller than the chunks
+ * of most large datasets, so every read of a part of such a chunk
+ * would read and inflate the whole chunk again. The dataset is
+ * reopened with a chunk cache that holds a row of chunks along the
+ * slowest varying HDF5 dimension, the last MATLAB dimension, up to
+ * MAT73_CHUNK_CACHE_SIZE bytes. This keeps the chunks in the cache
+ * while the data is read in column-major order, e.g. with
+ * Mat_VarReadDataLinear73.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param dset_id HDF5 dataset, closed if it is reopened
+ * @return the dataset to use, or -1 if it could not be reopened
+ */
+static hid_t
+SetChunkCache73(mat_t *mat,hid_t dset_id)
+{
+    hid_t dcpl_id, dapl_id, space_id, type_id;
+    hsize_t dims[H5S_MAX_RANK], chunk[H5S_MAX_RANK];
+    size_t nbytes, nchunks = 1, nslots, cache_slots, cache_nbytes, i, j;
+    double w0;
+    ssize_t len;
+    char *name;
+    int rank;
+
+    dcpl_id = H5Dget_create_plist(dset_id);
+    if ( dcpl_id < 0 )
+        return dset_id;
+    rank = -1;
+    if ( H5D_CHUNKED == H5Pget_layout(dcpl_id) )
+        rank = H5Pget_chunk(dcpl_id,H5S_MAX_RANK,chunk);
+    H5Pclose(dcpl_id);
+    if ( rank < 1 )
+        return dset_id;
+
+    space_id = H5Dget_space(dset_id);
+    if ( space_id < 0 )
+        return dset_id;
+    if ( rank != H5Sget_simple_extent_dims(space_id,dims,NULL) )
+        rank = -1;
+    H5Sclose(space_id);
+    type_id = H5Dget_type(dset_id);
+    if ( rank < 1 || type_id < 0 )
+        return dset_id;
+    nbytes = H5Tget_size(type_id);
+    H5Tclose(type_id);
+
+    for ( i = 0; i < (size_t)rank; i++ ) {
+        nbytes *= chunk[i];
+        if ( i > 0 && chunk[i] > 0 )
+            nchunks *= (dims[i] + chunk[i] - 1) / chunk[i];
+    }
+    if ( nbytes == 0 )
+        return dset_id;
+    if ( nchunks > MAT73_CHUNK_CACHE_SIZE / nbytes )
+        nchunks = MAT73_CHUNK_CACHE_SIZE / nbytes;
+    if ( nchunks == 0 )
+        nchunks = 1;
+
+    /* Keep the default cache if it is large enough */
+    dapl_id = H5Dget_access_plist(dset_id);
+    if ( dapl_id < 0 ||
+         0 > H5Pget_chunk_cache(dapl_id,&cache_slots,&cache_nbytes,&w0) ||
+         nchunks*nbytes <= cache_nbytes ) {
+        if ( dapl_id >= 0 )
+            H5Pclose(dapl_id);
+        return dset_id;
+    }
+
+    /* A prime number of slots, about 100 per chunk in the cache */
+    nslots = 100*nchunks;
+    if ( nslots > MAT73_CHUNK_CACHE_SLOTS )
+        nslots = MAT73_CHUNK_CACHE_SLOTS;
+    for ( nslots |= 1; ; nslots += 2 ) {
+        for ( j = 3; j*j <= nslots && nslots % j; j += 2 )
+            ;
+        if ( j*j > nslots )
+            break;
+    }
+
+    /* The cache of a dataset that is still open would be kept */
+    len = H5Iget_name(dset_id,NULL,0);
+    name = (len > 0) ? (char*)malloc(len+1) : NULL;
+    if ( NULL != name && len == H5Iget_name(dset_id,name,len+1) &&
+         0 <= H5Pset_chunk_cache(dapl_id,nslots,nchunks*nbytes,w0) ) {
+        H5Dclose(dset_id);
+        dset_id = H5Dopen2(*(hid_t*)mat->fp,name,dapl_id);
+        if ( dset_id < 0 )
+            dset_id = H5Dopen2(*(hid_t*)mat->fp,name,H5P_DEFAULT);
+    }
+    free(name);
+    H5Pclose(dapl_id);
+
+    return dset_id;
+}
+
+/** @brief Reads the field names of a structure
+ *
+ * The field names, in order, are in the attribute MATLAB_fields, a
+ * variable length array of characters per field. Without the
+ * attribute, the names of the links in the group are used.
+ * @ingroup mat_internal
+ * @param obj_id HDF5 group, or dataset of an empty structure
+ * @param matvar MAT variable
+ * @retval 0 on success
+ */
+static int
+ReadFieldNames73(hid_t obj_id,matvar_t *matvar)
+{
+    hsize_t nfields = 0, i;
+    char **fieldnames;
+
+    if ( 0 < H5Aexists(obj_id,"MATLAB_fields") ) {
+        hid_t attr_id, space_id, type_id, super_id;
+        hvl_t *names_vl;
+        int err = 1;
+
+        attr_id = H5Aopen(obj_id,"MATLAB_fields",H5P_DEFAULT);
+        if ( attr_id < 0 )
+            return 1;
+        space_id = H5Aget_space(attr_id);
+        type_id  = H5Aget_type(attr_id);
+        super_id = H5Tget_super(type_id);
+        if ( space_id >= 0 && super_id >= 0 && 1 == H5Tget_size(super_id) &&
+             1 == H5Sget_simple_extent_ndims(space_id) ) {
+            (void)H5Sget_simple_extent_dims(space_id,&nfields,NULL);
+            names_vl = (hvl_t*)calloc(nfields ? (size_t)nfields : 1,
+                                      sizeof(*names_vl));
+            fieldnames = (char**)calloc(nfields ? (size_t)nfields : 1,
+                                        sizeof(*fieldnames));
+            if ( NULL != names_vl && NULL != fieldnames &&
+                 0 <= H5Aread(attr_id,type_id,names_vl) ) {
+                err = 0;
+                for ( i = 0; i < nfields; i++ ) {
+                    fieldnames[i] = (char*)calloc(names_vl[i].len+1,1);
+                    if ( NULL == fieldnames[i] ) {
+                        err = 1;
+                        break;
+                    }
+                    memcpy(fieldnames[i],names_vl[i].p,names_vl[i].len);
+                }
+                H5RECLAIM(type_id,space_id,names_vl);
+            }
+            free(names_vl);
+            matvar->internal->fieldnames = fieldnames;
+            matvar->internal->num_fields = (unsigned)nfields;
+        }
+        if ( super_id >= 0 )
+            H5Tclose(super_id);
+        if ( type_id >= 0 )
+            H5Tclose(type_id);
+        if ( space_id >= 0 )
+            H5Sclose(space_id);
+        H5Aclose(attr_id);
+        return err;
+    } else if ( H5I_GROUP == H5Iget_type(obj_id) ) {
+        H5G_info_t group_info;
+
+        if ( 0 > H5Gget_info(obj_id,&group_info) )
+            return 1;
+        nfields = group_info.nlinks;
+        fieldnames = (char**)calloc(nfields ? (size_t)nfields : 1,
+                                    sizeof(*fieldnames));
+        if ( NULL == fieldnames )
+            return 1;
+        matvar->internal->fieldnames = fieldnames;
+        matvar->internal->num_fields = (unsigned)nfields;
+        for ( i = 0; i < nfields; i++ ) {
+            ssize_t len = H5Lget_name_by_idx(obj_id,".",H5_INDEX_NAME,
+                              H5_ITER_INC,i,NULL,0,H5P_DEFAULT);
+            if ( len < 0 )
+                return 1;
+            fieldnames[i] = (char*)calloc(len+1,1);
+            if ( NULL == fieldnames[i] ||
+                 0 > H5Lget_name_by_idx(obj_id,".",H5_INDEX_NAME,
+                         H5_ITER_INC,i,fieldnames[i],len+1,H5P_DEFAULT) )
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+/** @brief Reads the information of a dataset or group
+ *
+ * Reads the class, dimensions and flags of the variable, and the
+ * information of the cells of a cell array and the fields of a
+ * structure. The data is not read. The variable keeps the HDF5
+ * object open until it is freed.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param obj_id HDF5 dataset or group, owned by the variable
+ * @param name Name of the variable, or NULL
+ * @return the MAT variable, or NULL on error
+ */
+static matvar_t *
+ReadObjectInfo73(mat_t *mat,hid_t obj_id,const char *name)
+{
+    matvar_t *matvar;
+    int err;
+
+    if ( obj_id < 0 )
+        return NULL;
+
+    matvar = Mat_VarCalloc();
+    if ( NULL == matvar ) {
+        H5Oclose(obj_id);
+        return NULL;
+    }
+    matvar->internal->id = obj_id;
+    if ( NULL != name ) {
+        matvar->name = strdup(name);
+        if ( NULL == matvar->name ) {
+            Mat_VarFree(matvar);
+            return NULL;
+        }
+    }
+
+    switch ( H5Iget_type(obj_id) ) {
+        case H5I_DATASET:
+            err = ReadDatasetInfo73(mat,matvar);
+            break;
+        case H5I_GROUP:
+            err = ReadGroupInfo73(mat,matvar);
+            break;
+        default:
+            err = 1;
+            break;
+    }
+
+    if ( err ) {
+        Mat_VarFree(matvar);
+        matvar = NULL;
+    }
+
+    return matvar;
+}
+
+/** @brief Reads the information of a variable stored as a dataset
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable, with the dataset in the internal id
+ * @retval 0 on success
+ */
+static int
+ReadDatasetInfo73(mat_t *mat,matvar_t *matvar)
+{
+    hid_t dset_id = matvar->internal->id, type_id, dcpl_id;
+    size_t nelems = 1;
+
+    type_id = H5Dget_type(dset_id);
+    if ( type_id < 0 )
+        return 1;
+    if ( ReadClassType73(dset_id,matvar) )
+        matvar->class_type = ClassTypeFromH5T(type_id);
+    if ( H5T_COMPOUND == H5Tget_class(type_id) )
+        matvar->isComplex = MAT_F_COMPLEX;
+    H5Tclose(type_id);
+
+    if ( ReadDims73(dset_id,matvar) || SafeMulDims(matvar,&nelems) )
+        return 1;
+
+    dcpl_id = H5Dget_create_plist(dset_id);
+    if ( dcpl_id >= 0 ) {
+        if ( H5Pget_nfilters(dcpl_id) > 0 )
+            matvar->compression = MAT_COMPRESSION_ZLIB;
+        H5Pclose(dcpl_id);
+    }
+
+    switch ( matvar->class_type ) {
+        case MAT_C_CELL:
+            matvar->data_type = MAT_T_CELL;
+            matvar->data_size = sizeof(matvar_t*);
+            if ( nelems > 0 )
+                return ReadCellInfo73(mat,matvar);
+            break;
+        case MAT_C_STRUCT:
+            /* Only an empty structure is stored as a dataset */
+            matvar->data_type = MAT_T_STRUCT;
+            matvar->data_size = sizeof(matvar_t*);
+            return ReadFieldNames73(dset_id,matvar);
+        case MAT_C_EMPTY:
+        case MAT_C_FUNCTION:
+        case MAT_C_OPAQUE:
+            if ( 0 == nelems ) {
+                /* E.g. the canonical empty array in #refs# */
+                matvar->class_type = MAT_C_DOUBLE;
+                matvar->data_type  = MAT_T_DOUBLE;
+                matvar->data_size  = sizeof(double);
+            }
+            break;
+        default:
+            matvar->data_type = ClassType2DataType(matvar->class_type);
+            matvar->data_size = Mat_SizeOfClass(matvar->class_type);
+            matvar->nbytes    = nelems*matvar->data_size;
+            if ( nelems > 0 ) {
+                matvar->internal->id = SetChunkCache73(mat,dset_id);
+                if ( matvar->internal->id < 0 )
+                    return 1;
+            }
+            break;
+    }
+
+    return 0;
+}
+
+/** @brief Reads the information of the cells of a cell array
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable, with the dataset of object references
+ *        in the internal id
+ * @retval 0 on success
+ */
+static int
+ReadCellInfo73(mat_t *mat,matvar_t *matvar)
+{
+    hid_t dset_id = matvar->internal->id;
+    hobj_ref_t *refs;
+    matvar_t **cells;
+    size_t nelems = 1, i;
+
+    if ( SafeMulDims(matvar,&nelems) ||
+         SafeMul(&matvar->nbytes,nelems,sizeof(matvar_t*)) )
+        return 1;
+
+    refs  = (hobj_ref_t*)malloc(nelems*sizeof(*refs));
+    cells = (matvar_t**)calloc(nelems,sizeof(*cells));
+    if ( NULL == refs || NULL == cells ||
+         0 > H5Dread(dset_id,H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,H5P_DEFAULT,refs) ) {
+        free(refs);
+        free(cells);
+        return 1;
+    }
+
+    matvar->data = cells;
+    for ( i = 0; i < nelems; i++ ) {
+        cells[i] = ReadObjectInfo73(mat,H5RDEREF(dset_id,refs+i),NULL);
+        if ( NULL == cells[i] )
+            break;
+    }
+    free(refs);
+
+    return (i < nelems);
+}
+
+/** @brief Reads the information of a variable stored as a group
+ *
+ * A group is a structure, or a sparse matrix with the number of rows
+ * in the attribute MATLAB_sparse and the datasets data, ir and jc.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable, with the group in the internal id
+ * @retval 0 on success
+ */
+static int
+ReadGroupInfo73(mat_t *mat,matvar_t *matvar)
+{
+    hid_t group_id = matvar->internal->id;
+    mat_uint64_t nrows = 0;
+
+    if ( ReadClassType73(group_id,matvar) )
+        matvar->class_type = MAT_C_STRUCT;
+
+    if ( 0 == ReadAttrUInt64(group_id,"MATLAB_sparse",&nrows) ) {
+        hid_t dset_id, space_id, type_id;
+        hssize_t njc = 0;
+
+        if ( MAT_C_DOUBLE != matvar->class_type &&
+             !(MAT_C_UINT8 == matvar->class_type && matvar->isLogical) )
+            return 1;
+
+        dset_id = H5Dopen2(group_id,"jc",H5P_DEFAULT);
+        if ( dset_id < 0 )
+            return 1;
+        space_id = H5Dget_space(dset_id);
+        if ( space_id >= 0 ) {
+            njc = H5Sget_simple_extent_npoints(space_id);
+            H5Sclose(space_id);
+        }
+        H5Dclose(dset_id);
+        if ( njc < 1 )
+            return 1;
+
+        if ( 0 < H5Lexists(group_id,"data",H5P_DEFAULT) ) {
+            dset_id = H5Dopen2(group_id,"data",H5P_DEFAULT);
+            if ( dset_id < 0 )
+                return 1;
+            type_id = H5Dget_type(dset_id);
+            if ( type_id >= 0 ) {
+                if ( H5T_COMPOUND == H5Tget_class(type_id) )
+                    matvar->isComplex = MAT_F_COMPLEX;
+                H5Tclose(type_id);
+            }
+            H5Dclose(dset_id);
+        }
+
+        matvar->class_type = MAT_C_SPARSE;
+        matvar->data_type  = MAT_T_DOUBLE;
+        matvar->data_size  = sizeof(mat_sparse_t);
+        matvar->rank = 2;
+        matvar->dims = (size_t*)malloc(2*sizeof(*matvar->dims));
+        if ( NULL == matvar->dims )
+            return 1;
+        matvar->dims[0] = (size_t)nrows;
+        matvar->dims[1] = (size_t)(njc - 1);
+        return 0;
+    }
+
+    switch ( matvar->class_type ) {
+        case MAT_C_STRUCT:
+            return ReadStructInfo73(mat,matvar);
+        default:
+            /* A function handle or an object, without data */
+            if ( MAT_C_FUNCTION != matvar->class_type )
+                matvar->class_type = MAT_C_OPAQUE;
+            matvar->rank = 2;
+            matvar->dims = (size_t*)malloc(2*sizeof(*matvar->dims));
+            if ( NULL == matvar->dims )
+                return 1;
+            matvar->dims[0] = 1;
+            matvar->dims[1] = 1;
+            return 0;
+    }
+}
+
+/** @brief Reads the information of the fields of a structure
+ *
+ * The fields of a 1x1 structure are the objects in the group. The
+ * fields of a structure array are datasets of object references, one
+ * per element of the array, without a MATLAB class.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable, with the group in the internal id
+ * @retval 0 on success
+ */
+static int
+ReadStructInfo73(mat_t *mat,matvar_t *matvar)
+{
+    hid_t group_id = matvar->internal->id, *field_ids;
+    hobj_ref_t *refs = NULL;
+    matvar_t **fields = NULL;
+    size_t nelems = 1, nfields, i, j;
+    int is_array = 0, err = 0;
+
+    matvar->data_type = MAT_T_STRUCT;
+    matvar->data_size = sizeof(matvar_t*);
+    if ( ReadFieldNames73(group_id,matvar) )
+        return 1;
+    nfields = matvar->internal->num_fields;
+
+    field_ids = (hid_t*)malloc((nfields ? nfields : 1)*sizeof(*field_ids));
+    if ( NULL == field_ids )
+        return 1;
+    for ( i = 0; i < nfields; i++ ) {
+        field_ids[i] = H5Oopen(group_id,matvar->internal->fieldnames[i],H5P_DEFAULT);
+        if ( field_ids[i] < 0 )
+            break;
+    }
+    if ( i < nfields ) {
+        while ( i-- > 0 )
+            H5Oclose(field_ids[i]);
+        free(field_ids);
+        return 1;
+    }
+
+    /* The dimensions of a structure array are those of its fields */
+    if ( nfields > 0 && H5I_DATASET == H5Iget_type(field_ids[0]) &&
+         0 >= H5Aexists(field_ids[0],"MATLAB_class") ) {
+        hid_t type_id = H5Dget_type(field_ids[0]);
+        if ( type_id >= 0 ) {
+            is_array = (H5T_REFERENCE == H5Tget_class(type_id));
+            H5Tclose(type_id);
+        }
+    }
+    if ( is_array ) {
+        err = ReadDims73(field_ids[0],matvar) || SafeMulDims(matvar,&nelems);
+    } else {
+        matvar->rank = 2;
+        matvar->dims = (size_t*)malloc(2*sizeof(*matvar->dims));
+        if ( NULL != matvar->dims ) {
+            matvar->dims[0] = 1;
+            matvar->dims[1] = 1;
+        } else {
+            err = 1;
+        }
+    }
+
+    if ( !err && nelems > 0 && nfields > 0 ) {
+        err = SafeMul(&matvar->nbytes,nelems*nfields,sizeof(matvar_t*));
+        fields = err ? NULL : (matvar_t**)calloc(nelems*nfields,sizeof(*fields));
+        if ( is_array )
+            refs = (hobj_ref_t*)malloc(nelems*sizeof(*refs));
+        matvar->data = fields;
+        if ( NULL == fields || (is_array && NULL == refs) )
+            err = 1;
+    }
+
+    for ( i = 0; i < nfields; i++ ) {
+        if ( err || 0 == nelems ) {
+            H5Oclose(field_ids[i]);
+        } else if ( is_array ) {
+            if ( H5I_DATASET != H5Iget_type(field_ids[i]) ||
+                 0 > H5Dread(field_ids[i],H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,
+                             H5P_DEFAULT,refs) ) {
+                err = 1;
+            } else {
+                for ( j = 0; j < nelems && !err; j++ ) {
+                    fields[j*nfields+i] = ReadObjectInfo73(mat,
+                        H5RDEREF(field_ids[i],refs+j),
+                        matvar->internal->fieldnames[i]);
+                    err = (NULL == fields[j*nfields+i]);
+                }
+            }
+            H5Oclose(field_ids[i]);
+        } else {
+            fields[i] = ReadObjectInfo73(mat,field_ids[i],
+                            matvar->internal->fieldnames[i]);
+            err = (NULL == fields[i]);
+        }
+    }
+    free(refs);
+    free(field_ids);
+
+    return err;
+}
+
+/** @brief Reads numeric data from a dataset
+ *
+ * The data is converted by HDF5 to @c mem_type_id. Complex data is a
+ * compound type with the members real and imag, read into the real
+ * and imaginary parts of a mat_complex_split_t.
+ * @ingroup mat_internal
+ * @param dset_id HDF5 dataset
+ * @param mem_type_id HDF5 type of the data in memory
+ * @param mem_space_id Memory dataspace, or H5S_ALL
+ * @param file_space_id Selection in the dataset, or H5S_ALL
+ * @param isComplex non-zero if the data is complex
+ * @param data Pointer to store the data
+ * @retval 0 on success
+ */
+static int
+ReadData73(hid_t dset_id,hid_t mem_type_id,hid_t mem_space_id,
+    hid_t file_space_id,int isComplex,void *data)
+{
+    if ( isComplex ) {
+        mat_complex_split_t *complex_data = (mat_complex_split_t*)data;
+        size_t size = H5Tget_size(mem_type_id);
+        hid_t h5_complex;
+        herr_t err;
+
+        h5_complex = H5Tcreate(H5T_COMPOUND,size);
+        if ( h5_complex < 0 )
+            return 1;
+        H5Tinsert(h5_complex,"real",0,mem_type_id);
+        err = H5Dread(dset_id,h5_complex,mem_space_id,file_space_id,
+                      H5P_DEFAULT,complex_data->Re);
+        H5Tclose(h5_complex);
+        if ( err < 0 )
+            return 1;
+
+        h5_complex = H5Tcreate(H5T_COMPOUND,size);
+        if ( h5_complex < 0 )
+            return 1;
+        H5Tinsert(h5_complex,"imag",0,mem_type_id);
+        err = H5Dread(dset_id,h5_complex,mem_space_id,file_space_id,
+                      H5P_DEFAULT,complex_data->Im);
+        H5Tclose(h5_complex);
+        return (err < 0);
+    }
+
+    return (0 > H5Dread(dset_id,mem_type_id,mem_space_id,file_space_id,
+                        H5P_DEFAULT,data));
+}
+
+/** @brief Reads the data of a sparse matrix
+ *
+ * The row indices and column offsets are read as 32-bit integers and
+ * the values as double, as from a version 5 MAT file.
+ * @ingroup mat_internal
+ * @param matvar MAT variable, with the group in the internal id
+ * @retval 0 on success
+ */
+static int
+ReadSparse73(matvar_t *matvar)
+{
+    hid_t group_id = matvar->internal->id;
+    const char *names[3] = {"jc","ir","data"};
+    mat_sparse_t *sparse;
+    int k;
+
+    sparse = (mat_sparse_t*)calloc(1,sizeof(*sparse));
+    if ( NULL == sparse )
+        return 1;
+    matvar->data = sparse;
+
+    for ( k = 0; k < 3; k++ ) {
+        hid_t dset_id, space_id;
+        hssize_t n = 0;
+        size_t size = (k < 2) ? sizeof(mat_int32_t) : sizeof(double);
+        void *buf;
+        int err;
+
+        /* The row indices and values are omitted without non-zeros */
+        if ( k > 0 && 0 >= H5Lexists(group_id,names[k],H5P_DEFAULT) ) {
+            dset_id = -1;
+        } else {
+            dset_id = H5Dopen2(group_id,names[k],H5P_DEFAULT);
+            if ( dset_id < 0 )
+                return 1;
+            space_id = H5Dget_space(dset_id);
+            if ( space_id >= 0 ) {
+                n = H5Sget_simple_extent_npoints(space_id);
+                H5Sclose(space_id);
+            }
+            if ( n < 0 || n > INT_MAX ) {
+                H5Dclose(dset_id);
+                return 1;
+            }
+        }
+
+        if ( 2 == k && matvar->isComplex ) {
+            mat_complex_split_t *complex_data = ComplexMalloc((n ? n : 1)*size);
+            buf = complex_data;
+            sparse->data = complex_data;
+        } else {
+            buf = calloc(n ? n : 1,size);
+            if ( 0 == k )
+                sparse->jc = (mat_int32_t*)buf;
+            else if ( 1 == k )
+                sparse->ir = (mat_int32_t*)buf;
+            else
+                sparse->data = buf;
+        }
+
+        err = (NULL == buf);
+        if ( !err && dset_id >= 0 && n > 0 )
+            err = ReadData73(dset_id,(k < 2) ? H5T_NATIVE_INT32 : H5T_NATIVE_DOUBLE,
+                      H5S_ALL,H5S_ALL,2 == k && matvar->isComplex,buf);
+        if ( dset_id >= 0 )
+            H5Dclose(dset_id);
+        if ( err )
+            return 1;
+
+        if ( 0 == k ) {
+            sparse->njc = (int)n;
+        } else if ( 1 == k ) {
+            sparse->nir   = (int)n;
+            sparse->nzmax = (int)n;
+        } else {
+            sparse->ndata = (int)n;
+        }
+    }
+
+    return 0;
+}
+
+/** @brief Selects a linear range of elements of a dataset
+ *
+ * Adds the elements @c first to @c first+n-1, in the C order of the
+ * dimensions @c k to @c rank-1 of the dataset (the column-major order
+ * of the MATLAB dimensions), to the selection of @c space_id as a
+ * union of at most 2*(rank-k)-1 hyperslabs. The indices of the
+ * dimensions before @c k are fixed in @c start.
+ * @ingroup mat_internal
+ * @param space_id Dataspace of the dataset
+ * @param rank Rank of the dataset
+ * @param dims Dimensions of the dataset
+ * @param k First dimension of the range
+ * @param start Start of the hyperslabs, with the fixed indices
+ * @param count Count of the hyperslabs, 1 for the fixed indices
+ * @param first Index of the first element, relative to the fixed indices
+ * @param n Number of elements
+ * @param nsel Number of hyperslabs selected so far
+ * @retval 0 on success
+ */
+static int
+SelectLinear73(hid_t space_id,int rank,const hsize_t *dims,int k,
+    hsize_t *start,hsize_t *count,hsize_t first,hsize_t n,int *nsel)
+{
+    hsize_t inner = 1, m;
+    int i;
+
+    for ( i = k+1; i < rank; i++ )
+        inner *= dims[i];
+
+    /* The end of a partial row */
+    if ( n > 0 && first % inner ) {
+        m = inner - first % inner;
+        if ( m > n )
+            m = n;
+        start[k] = first / inner;
+        count[k] = 1;
+        if ( SelectLinear73(space_id,rank,dims,k+1,start,count,
+                            first % inner,m,nsel) )
+            return 1;
+        first += m;
+        n     -= m;
+    }
+
+    /* Whole rows */
+    if ( n >= inner ) {
+        start[k] = first / inner;
+        count[k] = n / inner;
+        for ( i = k+1; i < rank; i++ ) {
+            start[i] = 0;
+            count[i] = dims[i];
+        }
+        if ( 0 > H5Sselect_hyperslab(space_id,*nsel ? H5S_SELECT_OR : H5S_SELECT_SET,
+                                     start,NULL,count,NULL) )
+            return 1;
+        (*nsel)++;
+        first += count[k]*inner;
+        n     -= count[k]*inner;
+    }
+
+    /* The beginning of a partial row */
+    if ( n > 0 ) {
+        start[k] = first / inner;
+        count[k] = 1;
+        if ( SelectLinear73(space_id,rank,dims,k+1,start,count,0,n,nsel) )
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ *===================================================================
+ *                 Public Functions
+ *===================================================================
+ */
+
+/** @if mat_devman
+ * @brief Creates a new Matlab MAT version 7.3 file
+ *
+ * Writing version 7.3 MAT files is not supported, only reading.
+ * @ingroup mat_internal
+ * @param matname Name of the new file
+ * @param hdr_str Header string
+ * @return NULL
+ * @endif
+ */
+mat_t *
+Mat_Create73(const char *matname,const char *hdr_str)
+{
+    Mat_Critical("Writing version 7.3 MAT files is not supported");
+    return NULL;
+}
+
+/** @if mat_devman
+ * @brief Reads the information of the next variable in a version 7.3 MAT file
+ *
+ * The variables are the links of the root group, in the order of
+ * their names. The groups #refs# and #subsystem# are skipped.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @return pointer to the MAT variable or NULL
+ * @endif
+ */
+matvar_t *
+Mat_VarReadNextInfo73(mat_t *mat)
+{
+    hid_t fid;
+
+    if ( NULL == mat || NULL == mat->fp )
+        return NULL;
+
+    fid = *(hid_t*)mat->fp;
+    while ( mat->next_index < mat->num_datasets ) {
+        hsize_t idx = mat->next_index++;
+        matvar_t *matvar;
+        ssize_t len;
+        char *name;
+
+        len = H5Lget_name_by_idx(fid,"/",H5_INDEX_NAME,H5_ITER_INC,idx,
+                                 NULL,0,H5P_DEFAULT);
+        if ( len < 0 )
+            return NULL;
+        name = (char*)malloc(len+1);
+        if ( NULL == name )
+            return NULL;
+        if ( 0 > H5Lget_name_by_idx(fid,"/",H5_INDEX_NAME,H5_ITER_INC,idx,
+                                    name,len+1,H5P_DEFAULT) ) {
+            free(name);
+            return NULL;
+        }
+        if ( '#' == name[0] ) {
+            free(name);
+            continue;
+        }
+
+        matvar = ReadObjectInfo73(mat,H5Oopen(fid,name,H5P_DEFAULT),name);
+        free(name);
+        return matvar;
+    }
+
+    return NULL;
+}
+
+/** @if mat_devman
+ * @brief Reads the data of a version 7.3 MAT variable
+ *
+ * Numeric data is converted to the type of the class of the
+ * variable, and character data to 8-bit characters, as from a
+ * version 5 MAT file.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo73
+ * @endif
+ */
+void
+Mat_VarRead73(mat_t *mat,matvar_t *matvar)
+{
+    size_t nelems = 1, i;
+
+    if ( NULL == mat || NULL == matvar || NULL == matvar->internal ||
+         SafeMulDims(matvar,&nelems) )
+        return;
+
+    switch ( matvar->class_type ) {
+        case MAT_C_DOUBLE:
+        case MAT_C_SINGLE:
+        case MAT_C_INT64:
+        case MAT_C_UINT64:
+        case MAT_C_INT32:
+        case MAT_C_UINT32:
+        case MAT_C_INT16:
+        case MAT_C_UINT16:
+        case MAT_C_INT8:
+        case MAT_C_UINT8:
+        {
+            void *data;
+
+            if ( NULL != matvar->data || 0 == nelems ||
+                 H5I_DATASET != H5Iget_type(matvar->internal->id) )
+                break;
+            matvar->data_type = ClassType2DataType(matvar->class_type);
+            matvar->data_size = Mat_SizeOfClass(matvar->class_type);
+            matvar->nbytes    = nelems*matvar->data_size;
+            if ( matvar->isComplex )
+                data = ComplexMalloc(matvar->nbytes);
+            else
+                data = malloc(matvar->nbytes);
+            if ( NULL == data ) {
+                Mat_Critical("Couldn't allocate memory for the data");
+                break;
+            }
+            if ( ReadData73(matvar->internal->id,ClassTypeToH5T(matvar->class_type),
+                            H5S_ALL,H5S_ALL,matvar->isComplex,data) ) {
+                if ( matvar->isComplex ) {
+                    free(((mat_complex_split_t*)data)->Re);
+                    free(((mat_complex_split_t*)data)->Im);
+                }
+                free(data);
+                break;
+            }
+            matvar->data = data;
+            break;
+        }
+        case MAT_C_CHAR:
+            matvar->data_type = MAT_T_UINT8;
+            matvar->data_size = 1;
+            matvar->nbytes    = nelems;
+            if ( NULL != matvar->data || 0 == nelems ||
+                 H5I_DATASET != H5Iget_type(matvar->internal->id) )
+                break;
+            matvar->data = calloc(nelems+1,1);
+            if ( NULL == matvar->data ) {
+                Mat_Critical("Couldn't allocate memory for the data");
+                break;
+            }
+            if ( 0 > H5Dread(matvar->internal->id,H5T_NATIVE_UINT8,H5S_ALL,
+                             H5S_ALL,H5P_DEFAULT,matvar->data) ) {
+                free(matvar->data);
+                matvar->data = NULL;
+            }
+            break;
+        case MAT_C_STRUCT:
+        {
+            matvar_t **fields = (matvar_t**)matvar->data;
+            size_t nfields = matvar->internal->num_fields;
+
+            if ( NULL == fields )
+                break;
+            for ( i = 0; i < nelems*nfields; i++ ) {
+                if ( NULL != fields[i] )
+                    Mat_VarRead73(mat,fields[i]);
+            }
+            break;
+        }
+        case MAT_C_CELL:
+        {
+            matvar_t **cells = (matvar_t**)matvar->data;
+
+            if ( NULL == cells )
+                break;
+            for ( i = 0; i < nelems; i++ ) {
+                if ( NULL != cells[i] )
+                    Mat_VarRead73(mat,cells[i]);
+            }
+            break;
+        }
+        case MAT_C_SPARSE:
+            if ( NULL == matvar->data && ReadSparse73(matvar) ) {
+                /* Free what was read */
+                int isComplex = matvar->isComplex;
+                matvar_t *tmp = Mat_VarCalloc();
+
+                if ( NULL != tmp ) {
+                    tmp->class_type = MAT_C_SPARSE;
+                    tmp->isComplex  = isComplex;
+                    tmp->data       = matvar->data;
+                    Mat_VarFree(tmp);
+                }
+                matvar->data = NULL;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/** @if mat_devman
+ * @brief Reads the data of a real numeric version 7.3 MAT variable
+ *
+ * Reads all the data of the variable into a pre-allocated buffer,
+ * converted by HDF5 to the type of @c class_type.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo73
+ * @param data Pointer to store the data, must have room for all the
+ *        elements of the variable
+ * @param class_type Class type of the data to store
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarReadDataAs73(mat_t *mat,matvar_t *matvar,void *data,
+    enum matio_classes class_type)
+{
+    hid_t mem_type_id = ClassTypeToH5T(class_type);
+    size_t nelems = 1;
+
+    if ( NULL == mat || NULL == matvar || NULL == matvar->internal ||
+         NULL == data || mem_type_id < 0 || matvar->isComplex ||
+         ClassTypeToH5T(matvar->class_type) < 0 || SafeMulDims(matvar,&nelems) )
+        return 1;
+    if ( 0 == nelems )
+        return 0;
+    if ( H5I_DATASET != H5Iget_type(matvar->internal->id) )
+        return 1;
+
+    return ReadData73(matvar->internal->id,mem_type_id,H5S_ALL,H5S_ALL,0,data);
+}
+
+/** @if mat_devman
+ * @brief Reads a slab of data from a version 7.3 MAT variable
+ *
+ * The slab is read as a hyperslab of the dataset, so that HDF5 only
+ * reads and inflates the chunks that hold the slab.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo73
+ * @param data Pointer to store the data in (must be pre-allocated)
+ * @param start Index to start reading data in each dimension
+ * @param stride Read every @c stride elements in each dimension
+ * @param edge Number of elements to read in each dimension
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarReadData73(mat_t *mat,matvar_t *matvar,void *data,
+    int *start,int *stride,int *edge)
+{
+    hsize_t dset_start[H5S_MAX_RANK], dset_stride[H5S_MAX_RANK];
+    hsize_t dset_edge[H5S_MAX_RANK], dims[H5S_MAX_RANK], nelems = 1;
+    hid_t mem_type_id, dset_id, space_id, mem_space_id;
+    int rank, k, err;
+
+    if ( NULL == mat || NULL == matvar || NULL == matvar->internal ||
+         NULL == data || NULL == start || NULL == stride || NULL == edge )
+        return 1;
+    mem_type_id = ClassTypeToH5T(matvar->class_type);
+    dset_id = matvar->internal->id;
+    if ( mem_type_id < 0 || H5I_DATASET != H5Iget_type(dset_id) )
+        return 1;
+
+    space_id = H5Dget_space(dset_id);
+    if ( space_id < 0 )
+        return 1;
+    rank = H5Sget_simple_extent_ndims(space_id);
+    if ( rank < 1 || rank != matvar->rank ||
+         rank != H5Sget_simple_extent_dims(space_id,dims,NULL) ) {
+        H5Sclose(space_id);
+        return 1;
+    }
+    for ( k = 0; k < rank; k++ ) {
+        if ( start[k] < 0 || stride[k] < 1 || edge[k] < 0 ||
+             (edge[k] > 0 && (hsize_t)start[k] +
+              (hsize_t)(edge[k]-1)*(hsize_t)stride[k] >= dims[rank-k-1]) ) {
+            H5Sclose(space_id);
+            return 1;
+        }
+        dset_start[rank-k-1]  = start[k];
+        dset_stride[rank-k-1] = stride[k];
+        dset_edge[rank-k-1]   = edge[k];
+        nelems *= edge[k];
+    }
+    if ( 0 == nelems ) {
+        H5Sclose(space_id);
+        return 0;
+    }
+
+    mem_space_id = H5Screate_simple(1,&nelems,NULL);
+    err = (mem_space_id < 0 ||
+           0 > H5Sselect_hyperslab(space_id,H5S_SELECT_SET,dset_start,
+                                   dset_stride,dset_edge,NULL));
+    if ( !err )
+        err = ReadData73(dset_id,mem_type_id,mem_space_id,space_id,
+                         matvar->isComplex,data);
+    if ( mem_space_id >= 0 )
+        H5Sclose(mem_space_id);
+    H5Sclose(space_id);
+
+    return err;
+}
+
+/** @if mat_devman
+ * @brief Reads a subset of a version 7.3 MAT variable using a 1-D indexing
+ *
+ * With a stride of 1, the range of elements is selected as a union
+ * of hyperslabs (see SelectLinear73), otherwise as a list of points.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo73
+ * @param data Pointer to store the data in (must be pre-allocated)
+ * @param start Starting index
+ * @param stride Stride of data
+ * @param edge Number of elements to read
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarReadDataLinear73(mat_t *mat,matvar_t *matvar,void *data,
+    size_t start,size_t stride,size_t edge)
+{
+    hsize_t dims[H5S_MAX_RANK], sel_start[H5S_MAX_RANK], sel_count[H5S_MAX_RANK];
+    hsize_t nelems = 1, n = edge;
+    hid_t mem_type_id, dset_id, space_id, mem_space_id;
+    int rank, k, nsel = 0, err;
+
+    if ( NULL == mat || NULL == matvar || NULL == matvar->internal ||
+         NULL == data || stride < 1 )
+        return 1;
+    mem_type_id = ClassTypeToH5T(matvar->class_type);
+    dset_id = matvar->internal->id;
+    if ( mem_type_id < 0 || H5I_DATASET != H5Iget_type(dset_id) )
+        return 1;
+
+    space_id = H5Dget_space(dset_id);
+    if ( space_id < 0 )
+        return 1;
+    rank = H5Sget_simple_extent_ndims(space_id);
+    if ( rank < 1 || rank != H5Sget_simple_extent_dims(space_id,dims,NULL) ) {
+        H5Sclose(space_id);
+        return 1;
+    }
+    for ( k = 0; k < rank; k++ )
+        nelems *= dims[k];
+    if ( n > 0 && (hsize_t)start + (n-1)*(hsize_t)stride >= nelems ) {
+        H5Sclose(space_id);
+        return 1;
+    }
+    if ( 0 == n ) {
+        H5Sclose(space_id);
+        return 0;
+    }
+
+    if ( 1 == stride ) {
+        err = SelectLinear73(space_id,rank,dims,0,sel_start,sel_count,
+                             (hsize_t)start,n,&nsel);
+    } else {
+        hsize_t *coords = (hsize_t*)malloc((size_t)n*rank*sizeof(*coords));
+        hsize_t i, index;
+
+        err = (NULL == coords);
+        for ( i = 0; i < n && !err; i++ ) {
+            index = (hsize_t)start + i*(hsize_t)stride;
+            for ( k = rank-1; k >= 0; k-- ) {
+                coords[i*rank+k] = index % dims[k];
+                index /= dims[k];
+            }
+        }
+        if ( !err )
+            err = (0 > H5Sselect_elements(space_id,H5S_SELECT_SET,(size_t)n,coords));
+        free(coords);
+    }
+
+    mem_space_id = err ? -1 : H5Screate_simple(1,&n,NULL);
+    if ( !err && mem_space_id >= 0 )
+        err = ReadData73(dset_id,mem_type_id,mem_space_id,space_id,
+                         matvar->isComplex,data);
+    else
+        err = 1;
+    if ( mem_space_id >= 0 )
+        H5Sclose(mem_space_id);
+    H5Sclose(space_id);
+
+    return err;
+}
+
+/** @if mat_devman
+ * @brief Writes a matlab variable to a version 7.3 matlab file
+ *
+ * Writing version 7.3 MAT files is not supported, only reading.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar pointer to the mat variable
+ * @param compress option to compress the variable
+ * @retval 1
+ * @endif
+ */
+int
+Mat_VarWrite73(mat_t *mat,matvar_t *matvar,int compress)
+{
+    Mat_Critical("Writing version 7.3 MAT files is not supported");
+    return 1;
+}
+
+/** @if mat_devman
+ * @brief Writes/appends a matlab variable to a version 7.3 matlab file
+ *
+ * Writing version 7.3 MAT files is not supported, only reading.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar pointer to the mat variable
+ * @param compress option to compress the variable
+ * @param dim dimension to append data
+ * @retval 1
+ * @endif
+ */
+int
+Mat_VarWriteAppend73(mat_t *mat,matvar_t *matvar,int compress,int dim)
+{
+    Mat_Critical("Writing version 7.3 MAT files is not supported");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2008-2019, Christopher C. Hulbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MAT73_H
+#define MAT73_H
+
+#ifdef __cplusplus
+#   define EXTERN extern "C"
+#else
+#   define EXTERN extern
+#endif
+
+EXTERN mat_t    *Mat_Create73(const char *matname,const char *hdr_str);
+
+EXTERN matvar_t *Mat_VarReadNextInfo73(mat_t *mat);
+EXTERN void      Mat_VarRead73(mat_t *mat,matvar_t *matvar);
+EXTERN int       Mat_VarReadDataAs73(mat_t *mat,matvar_t *matvar,void *data,
+                     enum matio_classes class_type);
+EXTERN int       Mat_VarReadData73(mat_t *mat,matvar_t *matvar,void *data,
+                     int *start,int *stride,int *edge);
+EXTERN int       Mat_VarReadDataLinear73(mat_t *mat,matvar_t *matvar,void *data,
+                     size_t start,size_t stride,size_t edge);
+EXTERN int       Mat_VarWrite73(mat_t *mat,matvar_t *matvar,int compress);
+EXTERN int       Mat_VarWriteAppend73(mat_t *mat,matvar_t *matvar,int compress,
+                     int dim);
+
+#endif
@@ -65,7 +65,8 @@
  */
 enum mat_acc {
     MAT_ACC_RDONLY = 0,  /**< @brief Read only file access                */
-    MAT_ACC_RDWR   = 1   /**< @brief Read/Write file access               */
+    MAT_ACC_RDWR   = 1,  /**< @brief Read/Write file access               */
+    MAT_ACC_MMAP   = 2   /**< @brief Map a read only file into memory     */
 };
 
 /** @brief MAT file versions
@@ -158,6 +159,24 @@ enum matio_compression {
     MAT_COMPRESSION_ZLIB = 1    /**< @brief zlib compression */
 };
 
+/** @brief zlib compression strategy
+ *
+ * @ingroup MAT
+ * Strategy of the zlib compression, see Mat_SetCompression
+ */
+enum matio_compression_strategy {
+    MAT_STRATEGY_DEFAULT      = 0, /**< @brief Default strategy */
+    MAT_STRATEGY_FILTERED     = 1, /**< @brief For data with small random variations */
+    MAT_STRATEGY_HUFFMAN_ONLY = 2, /**< @brief Huffman coding only, no string matching */
+    MAT_STRATEGY_RLE          = 3  /**< @brief Run-length encoding only */
+};
+
+/** @brief Compression level that picks the level and strategy of
+ * each variable from a sample of its data, see Mat_SetCompression
+ * @ingroup MAT
+ */
+#define MAT_COMPRESSION_LEVEL_AUTO (-2)
+
 /** @brief matio lookup type
  *
  * @ingroup MAT
@@ -178,6 +197,13 @@ typedef struct mat_complex_split_t {
     void *Im; /**< Pointer to the imaginary part */
 } mat_complex_split_t;
 
+/** @brief Offset from the beginning of a MAT file
+ *
+ * A 64-bit offset, also on platforms where @c long has 32 bits
+ * @ingroup MAT
+ */
+typedef long long mat_off_t;
+
 struct _mat_t;
 /** @brief Matlab MAT File information
  * Contains information about a Matlab MAT file
@@ -230,6 +256,16 @@ typedef struct mat_sparse_t {
     void *data;              /**< Array of data elements */
 } mat_sparse_t;
 
+/** @brief Predicate on the name of a MAT variable
+ *
+ * Returns a positive value if the variable with the given name (which
+ * may be NULL) should be read, and 0 if it should be skipped. A
+ * negative value skips the variable and stops the scan, as if there
+ * were no more variables in the file.
+ * @ingroup MAT
+ */
+typedef int (*mat_iter_pred_t)(const char *name, const void *user_data);
+
 /** @cond 0 */
 #define MATIO_LOG_LEVEL_ERROR    1
 #define MATIO_LOG_LEVEL_CRITICAL 1 << 1
@@ -260,6 +296,8 @@ EXTERN void Mat_GetLibraryVersion(int *major,int *minor,int *release);
 /* EXTERN void   Mat_Warning(const char *format, ...) MATIO_FORMATATTR_PRINTF1; */
 EXTERN size_t Mat_SizeOf(enum matio_types data_type);
 EXTERN size_t Mat_SizeOfClass(int class_type);
+EXTERN int    Mat_ConvertData(void *dst,enum matio_types dst_type,
+                  const void *src,enum matio_types src_type,size_t n);
 
 /* MAT File functions */
 /** Create new Matlab MAT file */
@@ -273,6 +311,13 @@ EXTERN const char *Mat_GetHeader(mat_t *mat);
 EXTERN enum mat_ft Mat_GetVersion(mat_t *mat);
 EXTERN char      **Mat_GetDir(mat_t *mat, size_t *n);
 EXTERN int         Mat_Rewind(mat_t *mat);
+EXTERN int         Mat_Seek(mat_t *mat, long offset);
+EXTERN int         Mat_Seek64(mat_t *mat, mat_off_t offset);
+EXTERN int         Mat_SetBufferSize(mat_t *mat, size_t size);
+EXTERN int         Mat_SetWriteBufferSize(mat_t *mat, size_t size);
+EXTERN int         Mat_SetWriteThreads(mat_t *mat, int nthreads);
+EXTERN int         Mat_SetCompression(mat_t *mat, int level,
+                       enum matio_compression_strategy strategy);
 
 /* MAT variable functions */
 EXTERN matvar_t  *Mat_VarCalloc(void);
@@ -295,6 +340,10 @@ EXTERN matvar_t **Mat_VarGetCells(matvar_t *matvar,int *start,int *stride,
 EXTERN matvar_t **Mat_VarGetCellsLinear(matvar_t *matvar,int start,int stride,
                       int edge);
 EXTERN size_t     Mat_VarGetSize(matvar_t *matvar);
+EXTERN int        Mat_VarGetDataPtr(mat_t *mat,matvar_t *matvar,
+                      const void **data);
+EXTERN int        Mat_VarGetFilePos(const matvar_t *matvar,long *offset,
+                      long *nbytes);
 EXTERN unsigned   Mat_VarGetNumberOfFields(matvar_t *matvar);
 EXTERN int        Mat_VarAddStructField(matvar_t *matvar,const char *fieldname);
 EXTERN char * const *Mat_VarGetStructFieldnames(const matvar_t *matvar);
@@ -313,11 +362,21 @@ EXTERN matvar_t  *Mat_VarRead(mat_t *mat, const char *name);
 EXTERN int        Mat_VarReadData(mat_t *mat,matvar_t *matvar,void *data,
                       int *start,int *stride,int *edge);
 EXTERN int        Mat_VarReadDataAll(mat_t *mat,matvar_t *matvar);
+EXTERN int        Mat_VarReadDataAs(mat_t *mat,matvar_t *matvar,void *data,
+                      enum matio_classes class_type);
+EXTERN int        Mat_VarReadDataAsParallel(mat_t *mat,matvar_t **matvars,
+                      void **data,const enum matio_classes *class_types,
+                      size_t n,int nthreads);
 EXTERN int        Mat_VarReadDataLinear(mat_t *mat,matvar_t *matvar,void *data,
-                      int start,int stride,int edge);
+                      size_t start,size_t stride,size_t edge);
 EXTERN matvar_t  *Mat_VarReadInfo(mat_t *mat, const char *name);
 EXTERN matvar_t  *Mat_VarReadNext(mat_t *mat);
 EXTERN matvar_t  *Mat_VarReadNextInfo(mat_t *mat);
+EXTERN matvar_t  *Mat_VarReadNextPredicate(mat_t *mat,mat_iter_pred_t pred,
+                      const void *user_data);
+EXTERN matvar_t  *Mat_VarReadNextInfoPredicate(mat_t *mat,mat_iter_pred_t pred,
+                      const void *user_data);
+EXTERN matvar_t  *Mat_VarReadNextInfoShallow(mat_t *mat);
 EXTERN matvar_t  *Mat_VarSetCell(matvar_t *matvar,int index,matvar_t *cell);
 EXTERN matvar_t  *Mat_VarSetStructFieldByIndex(matvar_t *matvar,
                       size_t field_index,size_t index,matvar_t *field);
@@ -325,6 +384,9 @@ EXTERN matvar_t  *Mat_VarSetStructFieldByName(matvar_t *matvar,
                       const char *field_name,size_t index,matvar_t *field);
 EXTERN int        Mat_VarWrite(mat_t *mat,matvar_t *matvar,
                       enum matio_compression compress);
+EXTERN int        Mat_VarWriteAsync(mat_t *mat,matvar_t *matvar,
+                      enum matio_compression compress);
+EXTERN int        Mat_VarWriteFlush(mat_t *mat);
 EXTERN int        Mat_VarWriteAppend(mat_t *mat,matvar_t *matvar,
                       enum matio_compression compress,int dim);
 EXTERN int        Mat_VarWriteInfo(mat_t *mat,matvar_t *matvar);
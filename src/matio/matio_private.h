@@ -49,6 +49,21 @@
 #   define ZLIB_BYTE_PTR(a) ((Bytef *)(a))
 #endif
 
+/* Default size in bytes of the file buffer and of the input buffer
+ * for compressed data, see Mat_SetBufferSize */
+#define MAT_BUFFER_SIZE 262144
+
+/* Size in bytes of the blocks that large numeric data is split into
+ * to be compressed in parallel, see Mat_SetWriteThreads */
+#define MAT_DEFLATE_BLOCK_SIZE 1048576
+
+/* Size in bytes of the sample of the data that is compressed with
+ * each candidate setting by MAT_COMPRESSION_LEVEL_AUTO */
+#define MAT_AUTO_SAMPLE_SIZE 131072
+
+/* Default size in bytes of the output buffer, see Mat_SetWriteBufferSize */
+#define MAT_WRITE_BUFFER_SIZE 65536
+
 /** @if mat_devman
  * @brief Matlab MAT File information
  *
@@ -71,6 +86,19 @@ struct _mat_t {
     hid_t  refs_id;         /**< Id of the /#refs# group in HDF5 */
 #endif
     char **dir;             /**< Names of the datasets in the file */
+    void  *map;             /**< Memory mapping of the file, see MAT_ACC_MMAP */
+    size_t map_size;        /**< Size of the memory mapping in bytes */
+    void  *zbuf;            /**< Input buffer for compressed data */
+    size_t zbuf_size;       /**< Size of the input buffer in bytes */
+    void  *writer;          /**< Threads that compress variables, see Mat_SetWriteThreads */
+    int    write_threads;   /**< Threads to compress large data with, see Mat_SetWriteThreads */
+    int    compression_level; /**< zlib compression level, see Mat_SetCompression */
+    enum matio_compression_strategy compression_strategy; /**< zlib strategy */
+    void  *wbuf;            /**< Output buffer, see Mat_SetWriteBufferSize */
+    size_t wbuf_size;       /**< Size of the output buffer in bytes */
+    size_t wbuf_len;        /**< Number of bytes in the output buffer */
+    size_t wbytes;          /**< File position after the bytes written to the buffer */
+    int    wcount;          /**< Non-zero to only count the bytes written to the buffer */
 };
 
 /** @if mat_devman
@@ -84,7 +112,10 @@ struct matvar_internal {
     hobj_ref_t hdf5_ref;    /**< Reference */
     hid_t      id;          /**< Id */
 #endif
+    long       fpos;        /**< Offset from the beginning of the MAT file to the variable */
+    long       fnbytes;     /**< Number of bytes of the variable in the MAT file */
     long       datapos;     /**< Offset from the beginning of the MAT file to the data */
+    size_t     wnbytes;     /**< Number of bytes of the element counted in the dry run of a write, 0 if not counted */
     unsigned   num_fields;  /**< Number of fields */
     char     **fieldnames;  /**< Pointer to fieldnames */
 #if defined(HAVE_ZLIB)
@@ -108,34 +139,36 @@ EXTERN mat_int16_t   Mat_int16Swap(mat_int16_t  *a);
 EXTERN mat_uint16_t  Mat_uint16Swap(mat_uint16_t *a);
 
 /* read_data.c */
-EXTERN int ReadDoubleData(mat_t *mat,double  *data,enum matio_types data_type,
-               int len);
-EXTERN int ReadSingleData(mat_t *mat,float   *data,enum matio_types data_type,
-               int len);
+EXTERN int ConvertData(void *dst,enum matio_types dst_type,const void *src,
+               enum matio_types src_type,size_t n,int swap);
+EXTERN size_t ReadDoubleData(mat_t *mat,double  *data,enum matio_types data_type,
+                  size_t len);
+EXTERN size_t ReadSingleData(mat_t *mat,float   *data,enum matio_types data_type,
+                  size_t len);
 #ifdef HAVE_MAT_INT64_T
-EXTERN int ReadInt64Data (mat_t *mat,mat_int64_t *data,
-               enum matio_types data_type,int len);
+EXTERN size_t ReadInt64Data (mat_t *mat,mat_int64_t *data,
+                  enum matio_types data_type,size_t len);
 #endif /* HAVE_MAT_INT64_T */
 #ifdef HAVE_MAT_UINT64_T
-EXTERN int ReadUInt64Data(mat_t *mat,mat_uint64_t *data,
-               enum matio_types data_type,int len);
+EXTERN size_t ReadUInt64Data(mat_t *mat,mat_uint64_t *data,
+                  enum matio_types data_type,size_t len);
 #endif /* HAVE_MAT_UINT64_T */
-EXTERN int ReadInt32Data (mat_t *mat,mat_int32_t *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadUInt32Data(mat_t *mat,mat_uint32_t *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadInt16Data (mat_t *mat,mat_int16_t *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadUInt16Data(mat_t *mat,mat_uint16_t *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadInt8Data  (mat_t *mat,mat_int8_t  *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadUInt8Data (mat_t *mat,mat_uint8_t  *data,
-               enum matio_types data_type,int len);
+EXTERN size_t ReadInt32Data (mat_t *mat,mat_int32_t *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadUInt32Data(mat_t *mat,mat_uint32_t *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadInt16Data (mat_t *mat,mat_int16_t *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadUInt16Data(mat_t *mat,mat_uint16_t *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadInt8Data  (mat_t *mat,mat_int8_t  *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadUInt8Data (mat_t *mat,mat_uint8_t  *data,
+                  enum matio_types data_type,size_t len);
 EXTERN int ReadCharData  (mat_t *mat,char  *data,enum matio_types data_type,
                int len);
-EXTERN int ReadDataSlab1(mat_t *mat,void *data,enum matio_classes class_type,
-               enum matio_types data_type,int start,int stride,int edge);
+EXTERN size_t ReadDataSlab1(mat_t *mat,void *data,enum matio_classes class_type,
+               enum matio_types data_type,size_t start,size_t stride,size_t edge);
 EXTERN int ReadDataSlab2(mat_t *mat,void *data,enum matio_classes class_type,
                enum matio_types data_type,size_t *dims,int *start,int *stride,
                int *edge);
@@ -143,35 +176,35 @@ EXTERN int ReadDataSlabN(mat_t *mat,void *data,enum matio_classes class_type,
                enum matio_types data_type,int rank,size_t *dims,int *start,
                int *stride,int *edge);
 #if defined(HAVE_ZLIB)
-EXTERN int ReadCompressedDoubleData(mat_t *mat,z_streamp z,double  *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadCompressedSingleData(mat_t *mat,z_streamp z,float   *data,
-               enum matio_types data_type,int len);
+EXTERN size_t ReadCompressedDoubleData(mat_t *mat,z_streamp z,double  *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadCompressedSingleData(mat_t *mat,z_streamp z,float   *data,
+                  enum matio_types data_type,size_t len);
 #ifdef HAVE_MAT_INT64_T
-EXTERN int ReadCompressedInt64Data(mat_t *mat,z_streamp z,mat_int64_t *data,
-               enum matio_types data_type,int len);
+EXTERN size_t ReadCompressedInt64Data(mat_t *mat,z_streamp z,mat_int64_t *data,
+                  enum matio_types data_type,size_t len);
 #endif /* HAVE_MAT_INT64_T */
 #ifdef HAVE_MAT_UINT64_T
-EXTERN int ReadCompressedUInt64Data(mat_t *mat,z_streamp z,mat_uint64_t *data,
-               enum matio_types data_type,int len);
+EXTERN size_t ReadCompressedUInt64Data(mat_t *mat,z_streamp z,mat_uint64_t *data,
+                  enum matio_types data_type,size_t len);
 #endif /* HAVE_MAT_UINT64_T */
-EXTERN int ReadCompressedInt32Data(mat_t *mat,z_streamp z,mat_int32_t *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadCompressedUInt32Data(mat_t *mat,z_streamp z,mat_uint32_t *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadCompressedInt16Data(mat_t *mat,z_streamp z,mat_int16_t *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadCompressedUInt16Data(mat_t *mat,z_streamp z,mat_uint16_t *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadCompressedInt8Data(mat_t *mat,z_streamp z,mat_int8_t  *data,
-               enum matio_types data_type,int len);
-EXTERN int ReadCompressedUInt8Data(mat_t *mat,z_streamp z,mat_uint8_t  *data,
-               enum matio_types data_type,int len);
+EXTERN size_t ReadCompressedInt32Data(mat_t *mat,z_streamp z,mat_int32_t *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadCompressedUInt32Data(mat_t *mat,z_streamp z,mat_uint32_t *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadCompressedInt16Data(mat_t *mat,z_streamp z,mat_int16_t *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadCompressedUInt16Data(mat_t *mat,z_streamp z,mat_uint16_t *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadCompressedInt8Data(mat_t *mat,z_streamp z,mat_int8_t  *data,
+                  enum matio_types data_type,size_t len);
+EXTERN size_t ReadCompressedUInt8Data(mat_t *mat,z_streamp z,mat_uint8_t  *data,
+                  enum matio_types data_type,size_t len);
 EXTERN int ReadCompressedCharData(mat_t *mat,z_streamp z,char *data,
                enum matio_types data_type,int len);
-EXTERN int ReadCompressedDataSlab1(mat_t *mat,z_streamp z,void *data,
+EXTERN size_t ReadCompressedDataSlab1(mat_t *mat,z_streamp z,void *data,
                enum matio_classes class_type,enum matio_types data_type,
-               int start,int stride,int edge);
+               size_t start,size_t stride,size_t edge);
 EXTERN int ReadCompressedDataSlab2(mat_t *mat,z_streamp z,void *data,
                enum matio_classes class_type,enum matio_types data_type,
                size_t *dims,int *start,int *stride,int *edge);
@@ -180,9 +213,9 @@ EXTERN int ReadCompressedDataSlabN(mat_t *mat,z_streamp z,void *data,
                int rank,size_t *dims,int *start,int *stride,int *edge);
 
 /* inflate.c */
-EXTERN size_t InflateSkip(mat_t *mat, z_streamp z, int nbytes);
+EXTERN size_t InflateSkip(mat_t *mat, z_streamp z, size_t nbytes);
 EXTERN size_t InflateSkip2(mat_t *mat, matvar_t *matvar, int nbytes);
-EXTERN size_t InflateSkipData(mat_t *mat,z_streamp z,enum matio_types data_type,int len);
+EXTERN size_t InflateSkipData(mat_t *mat,z_streamp z,enum matio_types data_type,size_t len);
 EXTERN size_t InflateVarTag(mat_t *mat, matvar_t *matvar, void *buf);
 EXTERN size_t InflateArrayFlags(mat_t *mat, matvar_t *matvar, void *buf);
 EXTERN size_t InflateRankDims(mat_t *mat, matvar_t *matvar, void *buf, size_t nbytes, mat_uint32_t** dims);
@@ -190,7 +223,10 @@ EXTERN size_t InflateVarNameTag(mat_t *mat, matvar_t *matvar, void *buf);
 EXTERN size_t InflateVarName(mat_t *mat,matvar_t *matvar,void *buf,int N);
 EXTERN size_t InflateDataTag(mat_t *mat, matvar_t *matvar, void *buf);
 EXTERN size_t InflateDataType(mat_t *mat, z_stream *z, void *buf);
-EXTERN size_t InflateData(mat_t *mat, z_streamp z, void *buf, unsigned int nBytes);
+EXTERN size_t InflateData(mat_t *mat, z_streamp z, void *buf, size_t nBytes);
+EXTERN size_t InflateDataBlock(mat_t *mat, z_streamp z, void *buf, size_t nBytes,
+               size_t nAhead);
+EXTERN size_t InflateSync(mat_t *mat, z_streamp z);
 EXTERN size_t InflateFieldNameLength(mat_t *mat,matvar_t *matvar,void *buf);
 EXTERN size_t InflateFieldNamesTag(mat_t *mat,matvar_t *matvar,void *buf);
 EXTERN size_t InflateFieldNames(mat_t *mat,matvar_t *matvar,void *buf,int nfields,
@@ -37,6 +37,7 @@
  */
 
 /* Stefan Widgren 2014-01-04: Include files for rmatio package */
+#include <string.h>
 #include <R.h>
 #include "matio_private.h"
 
@@ -52,246 +53,279 @@
 /* #   include <zlib.h> */
 /* #endif */
 
+/* Size in bytes of the block that uncompressed data is read into
+ * before it's converted to the type of the output */
 #if !defined(READ_BLOCK_SIZE)
-#define READ_BLOCK_SIZE (256)
+#define READ_BLOCK_SIZE (16384)
 #endif
 
-#define READ_DATA_NOSWAP(T) \
-    do { \
-        if ( len <= READ_BLOCK_SIZE ) { \
-            bytesread += fread(v,data_size,len,(FILE*)mat->fp); \
-            for ( j = 0; j < len; j++ ) { \
-                data[j] = (T)v[j]; \
-            } \
-        } else { \
-            for ( i = 0; i < len-READ_BLOCK_SIZE; i+=READ_BLOCK_SIZE ) { \
-                bytesread += fread(v,data_size,READ_BLOCK_SIZE,(FILE*)mat->fp); \
-                for ( j = 0; j < READ_BLOCK_SIZE; j++ ) { \
-                    data[i+j] = (T)v[j]; \
-                } \
-            } \
-            if ( len > i ) { \
-                bytesread += fread(v,data_size,len-i,(FILE*)mat->fp); \
-                for ( j = 0; j < len-i; j++ ) { \
-                    data[i+j] = (T)v[j]; \
-                } \
-            }\
-        } \
-    } while (0)
+/*
+ * Byte swaps of single values, for the elements that don't fill a block
+ * of READ_CONVERT_LANES. A double is swapped as a 64-bit integer.
+ */
+#define SWAP_8(x)  (x)
+#define SWAP_16(x) ((mat_uint16_t)(((x) >> 8) | ((x) << 8)))
+#define SWAP_32(x) ((mat_uint32_t)(((x) >> 24) | (((x) >> 8) & 0xff00U) | \
+                                   (((x) & 0xff00U) << 8) | ((x) << 24)))
+#define SWAP_64(x) (((mat_uint64_t)SWAP_32((mat_uint32_t)(x)) << 32) | \
+                    (mat_uint64_t)SWAP_32((mat_uint32_t)((x) >> 32)))
+
+/* Converts n elements of one type in the file, read into a block, to
+ * the type of the output, with an optional byte swap */
+typedef void (*ReadConvertFunc)(void *dst,const void *src,size_t n,int swap);
+
+/* The elements are converted READ_CONVERT_LANES at a time by a function
+ * with restrict pointers and a loop with a fixed number of iterations */
+#define READ_CONVERT_LANES (16)
+
+/* GCC before version 12 only vectorizes at -O3, and version 12 at -O2
+ * only with the very cheap cost model, so the kernels ask for the
+ * vectorizer themselves */
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__INTEL_COMPILER)
+#define READ_CONVERT_VECTORIZE \
+    __attribute__((optimize("tree-vectorize","vect-cost-model=dynamic")))
+#else
+#define READ_CONVERT_VECTORIZE
+#endif
 
-#define READ_DATA(T, SwapFunc) \
-    do { \
-        if ( mat->byteswap ) { \
-            if ( len <= READ_BLOCK_SIZE ) { \
-                bytesread += fread(v,data_size,len,(FILE*)mat->fp); \
-                for ( j = 0; j < len; j++ ) { \
-                    data[j] = (T)SwapFunc(&v[j]); \
-                } \
-            } else { \
-                for ( i = 0; i < len-READ_BLOCK_SIZE; i+=READ_BLOCK_SIZE ) { \
-                    bytesread += fread(v,data_size,READ_BLOCK_SIZE,(FILE*)mat->fp); \
-                    for ( j = 0; j < READ_BLOCK_SIZE; j++ ) { \
-                        data[i+j] = (T)SwapFunc(&v[j]); \
-                    } \
+/* Compilers vectorize the swap of 16-bit elements with shifts, but turn
+ * the swaps of larger elements into a byte swap instruction, that they
+ * don't vectorize without a byte shuffle such as SSSE3 pshufb. Where
+ * READ_SWAP_LANES_##Bits is 1, SwapLanes##Bits instead byte swaps
+ * READ_CONVERT_LANES elements of Bits bits into a buffer with vector
+ * instructions, and the buffer is converted like a block in native
+ * order. SSE2 reorders the 16-bit words of a 32-bit element with
+ * shuffles and swaps their bytes with shifts, which for a 64-bit element
+ * is slower than the scalar swap. NEON reverses the bytes of the elements
+ * with one instruction. Other elements are swapped one at a time in the
+ * conversion loop. */
+#define READ_SWAP_LANES_NONE(Bits, U) \
+    static void \
+    SwapLanes##Bits(void * restrict t,const U * restrict u) \
+    { \
+        (void)t; \
+        (void)u; \
+    }
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SWAP_SSE2_16(x) _mm_or_si128(_mm_slli_epi16(x,8),_mm_srli_epi16(x,8))
+#define SWAP_SSE2_32(x) \
+    SWAP_SSE2_16(_mm_shufflehi_epi16(_mm_shufflelo_epi16(x,0xb1),0xb1))
+static void
+SwapLanes32(void * restrict t,const mat_uint32_t * restrict u)
+{
+    int j;
+    for ( j = 0; j < READ_CONVERT_LANES; j += 4 ) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(u+j));
+        _mm_storeu_si128((__m128i*)((mat_uint32_t*)t+j),SWAP_SSE2_32(x));
+    }
+}
+READ_SWAP_LANES_NONE(16, mat_uint16_t)
+READ_SWAP_LANES_NONE(64, mat_uint64_t)
+#define READ_SWAP_LANES_16 0
+#define READ_SWAP_LANES_32 1
+#define READ_SWAP_LANES_64 0
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define READ_SWAP_LANES(Bits, U) \
+    static void \
+    SwapLanes##Bits(void * restrict t,const U * restrict u) \
+    { \
+        int j; \
+        for ( j = 0; j < READ_CONVERT_LANES; j += 16/sizeof(U) ) \
+            vst1q_u8((uint8_t*)((U*)t+j), \
+                     vrev##Bits##q_u8(vld1q_u8((const uint8_t*)(u+j)))); \
+    }
+READ_SWAP_LANES(16, mat_uint16_t)
+READ_SWAP_LANES(32, mat_uint32_t)
+READ_SWAP_LANES(64, mat_uint64_t)
+#define READ_SWAP_LANES_16 1
+#define READ_SWAP_LANES_32 1
+#define READ_SWAP_LANES_64 1
+#else
+READ_SWAP_LANES_NONE(16, mat_uint16_t)
+READ_SWAP_LANES_NONE(32, mat_uint32_t)
+READ_SWAP_LANES_NONE(64, mat_uint64_t)
+#define READ_SWAP_LANES_16 0
+#define READ_SWAP_LANES_32 0
+#define READ_SWAP_LANES_64 0
+#endif
+READ_SWAP_LANES_NONE(8, mat_uint8_t)
+#define READ_SWAP_LANES_8 0
+
+/* Name converts from S, read as the unsigned type U of Bits bits when
+ * byte swapped, to D */
+#define READ_CONVERT(Name, S, U, D, Bits) \
+    static READ_CONVERT_VECTORIZE void \
+    Name##Lanes(D * restrict d,const S * restrict s) \
+    { \
+        int j; \
+        for ( j = 0; j < READ_CONVERT_LANES; j++ ) \
+            d[j] = (D)s[j]; \
+    } \
+    static READ_CONVERT_VECTORIZE void \
+    Name(void *dst,const void *src,size_t n,int swap) \
+    { \
+        D *d = (D*)dst; \
+        const S *s = (const S*)src; \
+        const U *u = (const U*)src; \
+        size_t i = 0; \
+        if ( swap && Bits > 8 ) { \
+            S v[READ_CONVERT_LANES]; \
+            U t; \
+            if ( READ_SWAP_LANES_##Bits ) { \
+                for ( ; i + READ_CONVERT_LANES <= n; \
+                      i += READ_CONVERT_LANES ) { \
+                    SwapLanes##Bits(v,u+i); \
+                    Name##Lanes(d+i,v); \
                 } \
-                if ( len > i ) { \
-                    bytesread += fread(v,data_size,len-i,(FILE*)mat->fp); \
-                    for ( j = 0; j < len-i; j++ ) { \
-                        data[i+j] = (T)SwapFunc(&v[j]); \
-                    } \
-                }\
+            } \
+            for ( ; i < n; i++ ) { \
+                t = SWAP_##Bits(u[i]); \
+                memcpy(v,&t,sizeof(t)); \
+                d[i] = (D)v[0]; \
             } \
         } else { \
-            READ_DATA_NOSWAP(T); \
+            for ( ; i + READ_CONVERT_LANES <= n; i += READ_CONVERT_LANES ) \
+                Name##Lanes(d+i,s+i); \
+            for ( ; i < n; i++ ) \
+                d[i] = (D)s[i]; \
         } \
-    } while (0)
+    }
 
 #ifdef HAVE_MAT_INT64_T
-#define READ_DATA_INT64(T) \
-    do { \
-        if ( MAT_T_INT64 == data_type ) { \
-            mat_int64_t v[READ_BLOCK_SIZE]; \
-            READ_DATA(T, Mat_int64Swap); \
-        } \
-    } while (0)
+#define READ_CONVERT_INT64(Name, D) \
+    READ_CONVERT(Name##FromInt64, mat_int64_t, mat_uint64_t, D, 64)
+#define READ_CONVERT_ENTRY_INT64(Name) [MAT_T_INT64] = Name##FromInt64,
 #else
-#define READ_DATA_INT64(T)
+#define READ_CONVERT_INT64(Name, D)
+#define READ_CONVERT_ENTRY_INT64(Name)
 #endif /* HAVE_MAT_INT64_T */
 
 #ifdef HAVE_MAT_UINT64_T
-#define READ_DATA_UINT64(T) \
-    do { \
-        if ( MAT_T_UINT64 == data_type ) { \
-            mat_uint64_t v[READ_BLOCK_SIZE]; \
-            READ_DATA(T, Mat_uint64Swap); \
-        } \
-    } while (0)
+#define READ_CONVERT_UINT64(Name, D) \
+    READ_CONVERT(Name##FromUInt64, mat_uint64_t, mat_uint64_t, D, 64)
+#define READ_CONVERT_ENTRY_UINT64(Name) [MAT_T_UINT64] = Name##FromUInt64,
 #else
-#define READ_DATA_UINT64(T)
+#define READ_CONVERT_UINT64(Name, D)
+#define READ_CONVERT_ENTRY_UINT64(Name)
 #endif /* HAVE_MAT_UINT64_T */
 
-#define READ_DATA_TYPE(T) \
-    do { \
-        switch ( data_type ) { \
-            case MAT_T_DOUBLE: \
-            { \
-                double v[READ_BLOCK_SIZE]; \
-                READ_DATA(T, Mat_doubleSwap); \
-                break; \
-            } \
-            case MAT_T_SINGLE: \
-            { \
-                float v[READ_BLOCK_SIZE]; \
-                READ_DATA(T, Mat_floatSwap); \
-                break; \
-            } \
-            case MAT_T_INT32: \
-            { \
-                mat_int32_t v[READ_BLOCK_SIZE]; \
-                READ_DATA(T, Mat_int32Swap); \
-                break; \
-            } \
-            case MAT_T_UINT32: \
-            { \
-                mat_uint32_t v[READ_BLOCK_SIZE]; \
-                READ_DATA(T, Mat_uint32Swap); \
-                break; \
-            } \
-            case MAT_T_INT16: \
-            { \
-                mat_int16_t v[READ_BLOCK_SIZE]; \
-                READ_DATA(T, Mat_int16Swap); \
-                break; \
-            } \
-            case MAT_T_UINT16: \
-            { \
-                mat_uint16_t v[READ_BLOCK_SIZE]; \
-                READ_DATA(T, Mat_uint16Swap); \
-                break; \
-            } \
-            case MAT_T_INT8: \
-            { \
-                mat_int8_t v[READ_BLOCK_SIZE]; \
-                READ_DATA_NOSWAP(T); \
-                break; \
-            } \
-            case MAT_T_UINT8: \
-            { \
-                mat_uint8_t v[READ_BLOCK_SIZE]; \
-                READ_DATA_NOSWAP(T); \
-                break; \
-            } \
-            default: \
-                READ_DATA_INT64(T); \
-                READ_DATA_UINT64(T); \
-                break; \
-        } \
-    } while (0)
+/* The conversions from each type in the file to the output type D,
+ * and the table Name of them indexed by the type in the file */
+#define READ_CONVERT_TABLE(Name, D) \
+    READ_CONVERT(Name##FromDouble, double, mat_uint64_t, D, 64) \
+    READ_CONVERT(Name##FromSingle, float, mat_uint32_t, D, 32) \
+    READ_CONVERT_INT64(Name, D) \
+    READ_CONVERT_UINT64(Name, D) \
+    READ_CONVERT(Name##FromInt32, mat_int32_t, mat_uint32_t, D, 32) \
+    READ_CONVERT(Name##FromUInt32, mat_uint32_t, mat_uint32_t, D, 32) \
+    READ_CONVERT(Name##FromInt16, mat_int16_t, mat_uint16_t, D, 16) \
+    READ_CONVERT(Name##FromUInt16, mat_uint16_t, mat_uint16_t, D, 16) \
+    READ_CONVERT(Name##FromInt8, mat_int8_t, mat_uint8_t, D, 8) \
+    READ_CONVERT(Name##FromUInt8, mat_uint8_t, mat_uint8_t, D, 8) \
+    static const ReadConvertFunc Name[MAT_T_UINT64+1] = { \
+        [MAT_T_DOUBLE] = Name##FromDouble, \
+        [MAT_T_SINGLE] = Name##FromSingle, \
+        READ_CONVERT_ENTRY_INT64(Name) \
+        READ_CONVERT_ENTRY_UINT64(Name) \
+        [MAT_T_INT32]  = Name##FromInt32, \
+        [MAT_T_UINT32] = Name##FromUInt32, \
+        [MAT_T_INT16]  = Name##FromInt16, \
+        [MAT_T_UINT16] = Name##FromUInt16, \
+        [MAT_T_INT8]   = Name##FromInt8, \
+        [MAT_T_UINT8]  = Name##FromUInt8 \
+    };
+
+READ_CONVERT_TABLE(ConvertToDouble, double)
+READ_CONVERT_TABLE(ConvertToSingle, float)
+#ifdef HAVE_MAT_INT64_T
+READ_CONVERT_TABLE(ConvertToInt64, mat_int64_t)
+#endif
+#ifdef HAVE_MAT_UINT64_T
+READ_CONVERT_TABLE(ConvertToUInt64, mat_uint64_t)
+#endif
+READ_CONVERT_TABLE(ConvertToInt32, mat_int32_t)
+READ_CONVERT_TABLE(ConvertToUInt32, mat_uint32_t)
+READ_CONVERT_TABLE(ConvertToInt16, mat_int16_t)
+READ_CONVERT_TABLE(ConvertToUInt16, mat_uint16_t)
+READ_CONVERT_TABLE(ConvertToInt8, mat_int8_t)
+READ_CONVERT_TABLE(ConvertToUInt8, mat_uint8_t)
+
+/** @brief Converts data in memory from one data type to another
+ *
+ * Like Mat_ConvertData, and byte swaps the input in the same pass if
+ * @c swap is non-zero.
+ * @ingroup mat_internal
+ * @param dst Pointer to store the output values (n*Mat_SizeOf(dst_type))
+ * @param dst_type Numeric data type of the output
+ * @param src Pointer to the input values
+ * @param src_type Numeric data type of the input
+ * @param n Number of elements to convert
+ * @param swap Non-zero to byte swap the input
+ * @retval 0 on success
+ */
+int
+ConvertData(void *dst,enum matio_types dst_type,const void *src,
+    enum matio_types src_type,size_t n,int swap)
+{
+    const ReadConvertFunc *convert;
 
-#if defined(HAVE_ZLIB)
-#define READ_COMPRESSED_DATA(T, SwapFunc) \
-    do { \
-        if ( mat->byteswap ) { \
-            for ( i = 0; i < len; i++ ) { \
-                InflateData(mat,z,&v,data_size); \
-                data[i] = (T)SwapFunc(&v); \
-            } \
-        } else { \
-            for ( i = 0; i < len; i++ ) { \
-                InflateData(mat,z,&v,data_size); \
-                data[i] = (T)v; \
-            } \
-        } \
-    } while (0)
+    if ( (dst == NULL) || (src == NULL) || src_type > MAT_T_UINT64 )
+        return 1;
 
+    switch ( dst_type ) {
+        case MAT_T_DOUBLE: convert = ConvertToDouble; break;
+        case MAT_T_SINGLE: convert = ConvertToSingle; break;
 #ifdef HAVE_MAT_INT64_T
-#define READ_COMPRESSED_DATA_INT64(T) \
-    do { \
-        if ( MAT_T_INT64 == data_type ) { \
-            mat_int64_t v; \
-            READ_COMPRESSED_DATA(T, Mat_int64Swap); \
-        } \
-    } while (0)
-#else
-#define READ_COMPRESSED_DATA_INT64(T)
-#endif /* HAVE_MAT_INT64_T */
-
+        case MAT_T_INT64:  convert = ConvertToInt64;  break;
+#endif
 #ifdef HAVE_MAT_UINT64_T
-#define READ_COMPRESSED_DATA_UINT64(T) \
-    do { \
-        if ( MAT_T_UINT64 == data_type ) { \
-            mat_uint64_t v; \
-            READ_COMPRESSED_DATA(T, Mat_uint64Swap); \
-        } \
-    } while (0)
-#else
-#define READ_COMPRESSED_DATA_UINT64(T)
-#endif /* HAVE_MAT_UINT64_T */
-
-#define READ_COMPRESSED_DATA_TYPE(T) \
-    do { \
-        switch ( data_type ) { \
-            case MAT_T_DOUBLE: \
-            { \
-                double v; \
-                READ_COMPRESSED_DATA(T, Mat_doubleSwap); \
-                break; \
-            } \
-            case MAT_T_SINGLE: \
-            { \
-                float v; \
-                READ_COMPRESSED_DATA(T, Mat_floatSwap); \
-                break; \
-            } \
-            case MAT_T_INT32: \
-            { \
-                mat_int32_t v; \
-                READ_COMPRESSED_DATA(T, Mat_int32Swap); \
-                break; \
-            } \
-            case MAT_T_UINT32: \
-            { \
-                mat_uint32_t v; \
-                READ_COMPRESSED_DATA(T, Mat_uint32Swap); \
-                break; \
-            } \
-            case MAT_T_INT16: \
-            { \
-                mat_int16_t v; \
-                READ_COMPRESSED_DATA(T, Mat_int16Swap); \
-                break; \
-            } \
-            case MAT_T_UINT16: \
-            { \
-                mat_uint16_t v; \
-                READ_COMPRESSED_DATA(T, Mat_uint16Swap); \
-                break; \
-            } \
-            case MAT_T_UINT8: \
-            { \
-                mat_uint8_t v; \
-                for ( i = 0; i < len; i++ ) { \
-                    InflateData(mat,z,&v,data_size); \
-                    data[i] = (T)v; \
-                } \
-                break; \
-            } \
-            case MAT_T_INT8: \
-            { \
-                mat_int8_t v; \
-                for ( i = 0; i < len; i++ ) { \
-                    InflateData(mat,z,&v,data_size); \
-                    data[i] = (T)v; \
-                } \
-                break; \
-            } \
-            default: \
-                READ_COMPRESSED_DATA_INT64(T); \
-                READ_COMPRESSED_DATA_UINT64(T); \
-                break; \
-        } \
-    } while (0)
+        case MAT_T_UINT64: convert = ConvertToUInt64; break;
 #endif
+        case MAT_T_INT32:  convert = ConvertToInt32;  break;
+        case MAT_T_UINT32: convert = ConvertToUInt32; break;
+        case MAT_T_INT16:  convert = ConvertToInt16;  break;
+        case MAT_T_UINT16: convert = ConvertToUInt16; break;
+        case MAT_T_INT8:   convert = ConvertToInt8;   break;
+        case MAT_T_UINT8:  convert = ConvertToUInt8;  break;
+        default:
+            return 1;
+    }
+
+    if ( NULL == convert[src_type] )
+        return 1;
+
+    if ( src_type == dst_type && !swap )
+        memcpy(dst,src,n*Mat_SizeOf(dst_type));
+    else
+        convert[src_type](dst,src,n,swap);
+
+    return 0;
+}
+
+/** @brief Converts data in memory from one data type to another
+ *
+ * Converts @c n elements of data type @c src_type in @c src to data type
+ * @c dst_type in @c dst, with the conversions used when reading data.
+ * Data of the same type is copied. The buffers must not overlap.
+ * @ingroup MAT
+ * @param dst Pointer to store the output values (n*Mat_SizeOf(dst_type))
+ * @param dst_type one of the numeric @c matio_types enumerations which is the
+ *                 output data type
+ * @param src Pointer to the input values
+ * @param src_type one of the numeric @c matio_types enumerations which is the
+ *                 input data type
+ * @param n Number of elements to convert
+ * @retval 0 on success
+ */
+int
+Mat_ConvertData(void *dst,enum matio_types dst_type,const void *src,
+    enum matio_types src_type,size_t n)
+{
+    return ConvertData(dst,dst_type,src,src_type,n,0);
+}
 
 /*
  * --------------------------------------------------------------------------
@@ -301,103 +335,137 @@
 
 /** @cond mat_devman */
 
-/** @brief Reads data of type @c data_type into a double type
+/** @brief Reads data of type @c data_type converted to the output type
  *
- * Reads from the MAT file @c len elements of data type @c data_type storing
- * them as double's in @c data.
+ * Reads from the MAT file @c len elements of data type @c data_type a
+ * block at a time, and converts each block to the output type with the
+ * conversion from @c convert for @c data_type. Data of the output type
+ * is read directly into @c data if it doesn't need to be byte swapped.
  * @ingroup mat_internal
  * @param mat MAT file pointer
- * @param data Pointer to store the output double values (len*sizeof(double))
+ * @param data Pointer to store the output values (len*dst_size)
+ * @param dst_type The data type of the output values
+ * @param dst_size The size of an output value
+ * @param convert The conversions to the output type, indexed by the data
+ *                type in the file
  * @param data_type one of the @c matio_types enumerations which is the source
  *                  data type in the file
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
-ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
+static size_t
+ReadConvertData(mat_t *mat,void *data,enum matio_types dst_type,
+    size_t dst_size,const ReadConvertFunc *convert,
+    enum matio_types data_type,size_t len)
 {
-    int bytesread = 0, i, j;
-    size_t data_size;
+    union {
+        double        d[READ_BLOCK_SIZE/sizeof(double)];
+        mat_uint8_t ui8[READ_BLOCK_SIZE];
+    } buf;
+    size_t data_size, block, i, n, nread = 0;
+    ReadConvertFunc func;
 
-    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
+    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) || 0 == len )
+        return 0;
+    if ( data_type > MAT_T_UINT64 || NULL == convert[data_type] )
         return 0;
 
+    func = convert[data_type];
     data_size = Mat_SizeOf(data_type);
 
-    switch ( data_type ) {
-        case MAT_T_DOUBLE:
-        {
-            bytesread += fread(data,data_size,len,(FILE*)mat->fp);
-            if ( mat->byteswap ) {
-                for ( i = 0; i < len; i++ ) {
-                    (void)Mat_doubleSwap(data+i);
-                }
-            }
-            break;
-        }
-        case MAT_T_SINGLE:
-        {
-            float v[READ_BLOCK_SIZE];
-            READ_DATA(double, Mat_floatSwap);
-            break;
-        }
-#ifdef HAVE_MAT_INT64_T
-        case MAT_T_INT64:
-        {
-            mat_int64_t v[READ_BLOCK_SIZE];
-            READ_DATA(double, Mat_int64Swap);
-            break;
-        }
-#endif
-#ifdef HAVE_MAT_UINT64_T
-        case MAT_T_UINT64:
-        {
-            mat_uint64_t v[READ_BLOCK_SIZE];
-            READ_DATA(double, Mat_uint64Swap);
-            break;
+    if ( data_type == dst_type && !mat->byteswap ) {
+        nread = fread(data,data_size,len,(FILE*)mat->fp);
+    } else {
+        block = READ_BLOCK_SIZE / data_size;
+        for ( i = 0; i < len; i += n ) {
+            n = len - i < block ? len - i : block;
+            n = fread(buf.ui8,data_size,n,(FILE*)mat->fp);
+            if ( 0 == n )
+                break;
+            func((char*)data + i*dst_size,buf.ui8,n,mat->byteswap);
+            nread += n;
         }
-#endif
-        case MAT_T_INT32:
-        {
-            mat_int32_t v[READ_BLOCK_SIZE];
-            READ_DATA(double, Mat_int32Swap);
-            break;
-        }
-        case MAT_T_UINT32:
-        {
-            mat_uint32_t v[READ_BLOCK_SIZE];
-            READ_DATA(double, Mat_uint32Swap);
-            break;
-        }
-        case MAT_T_INT16:
-        {
-            mat_int16_t v[READ_BLOCK_SIZE];
-            READ_DATA(double, Mat_int16Swap);
-            break;
-        }
-        case MAT_T_UINT16:
-        {
-            mat_uint16_t v[READ_BLOCK_SIZE];
-            READ_DATA(double, Mat_uint16Swap);
-            break;
-        }
-        case MAT_T_INT8:
-        {
-            mat_int8_t v[READ_BLOCK_SIZE];
-            READ_DATA_NOSWAP(double);
-            break;
-        }
-        case MAT_T_UINT8:
-        {
-            mat_uint8_t v[READ_BLOCK_SIZE];
-            READ_DATA_NOSWAP(double);
-            break;
-        }
-        default:
-            return 0;
     }
-    bytesread *= data_size;
-    return bytesread;
+
+    return nread*data_size;
+}
+
+#if defined(HAVE_ZLIB)
+/** @brief Inflates data of type @c data_type converted to the output type
+ *
+ * Inflates @c len elements of data type @c data_type a block at a time
+ * into a staging buffer, and converts each block to the output type
+ * with the conversion from @c convert for @c data_type. Data of the
+ * output type is inflated directly into @c data if it doesn't need to be
+ * byte swapped.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param z Pointer to the zlib stream for inflation
+ * @param data Pointer to store the output values (len*dst_size)
+ * @param dst_type The data type of the output values
+ * @param dst_size The size of an output value
+ * @param convert The conversions to the output type, indexed by the data
+ *                type in the file
+ * @param data_type one of the @c matio_types enumerations which is the source
+ *                  data type in the file
+ * @param len Number of elements of type @c data_type to read from the file
+ * @retval Number of bytes of uncompressed data
+ */
+static size_t
+ReadCompressedConvertData(mat_t *mat,z_streamp z,void *data,
+    enum matio_types dst_type,size_t dst_size,const ReadConvertFunc *convert,
+    enum matio_types data_type,size_t len)
+{
+    union {
+        double        d[READ_BLOCK_SIZE/sizeof(double)];
+        mat_uint8_t ui8[READ_BLOCK_SIZE];
+    } buf;
+    size_t data_size, block, i, n;
+    ReadConvertFunc func;
+
+    if ( (mat == NULL) || (data == NULL) || (z == NULL) || 0 == len )
+        return 0;
+    if ( data_type > MAT_T_UINT64 || NULL == convert[data_type] )
+        return 0;
+
+    func = convert[data_type];
+    data_size = Mat_SizeOf(data_type);
+
+    if ( data_type == dst_type && !mat->byteswap ) {
+        InflateData(mat,z,data,len*data_size);
+    } else {
+        /* The input is kept in the stream between the blocks, and
+         * given back to the file once after the last one */
+        block = READ_BLOCK_SIZE / data_size;
+        for ( i = 0; i < len; i += n ) {
+            n = len - i < block ? len - i : block;
+            InflateDataBlock(mat,z,buf.ui8,n*data_size,(len-i)*data_size);
+            func((char*)data + i*dst_size,buf.ui8,n,mat->byteswap);
+        }
+        InflateSync(mat,z);
+    }
+
+    return len*data_size;
+}
+#endif
+
+/** @brief Reads data of type @c data_type into a double type
+ *
+ * Reads from the MAT file @c len elements of data type @c data_type storing
+ * them as double's in @c data.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param data Pointer to store the output double values (len*sizeof(double))
+ * @param data_type one of the @c matio_types enumerations which is the source
+ *                  data type in the file
+ * @param len Number of elements of type @c data_type to read from the file
+ * @retval Number of bytes read from the file
+ */
+size_t
+ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,size_t len)
+{
+    return ReadConvertData(mat,data,MAT_T_DOUBLE,sizeof(double),
+        ConvertToDouble,data_type,len);
 }
 
 #if defined(HAVE_ZLIB)
@@ -414,380 +482,12 @@ ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedDoubleData(mat_t *mat,z_streamp z,double *data,
-    enum matio_types data_type,int len)
+    enum matio_types data_type,size_t len)
 {
-    int nBytes = 0, i;
-    unsigned int data_size;
-    union _buf {
-        float           f[256];
-#ifdef HAVE_MAT_INT64_T
-        mat_int64_t   i64[128];
-#endif
-#ifdef HAVE_MAT_UINT64_T
-        mat_uint64_t ui64[128];
-#endif
-        mat_int32_t   i32[256];
-        mat_uint32_t ui32[256];
-        mat_int16_t   i16[512];
-        mat_uint16_t ui16[512];
-        mat_int8_t     i8[1024];
-        mat_uint8_t   ui8[1024];
-    } buf;
-
-    data_size = (unsigned int)Mat_SizeOf(data_type);
-
-    switch ( data_type ) {
-        case MAT_T_DOUBLE:
-        {
-            if ( mat->byteswap ) {
-                InflateData(mat,z,data,len*data_size);
-                for ( i = 0; i < len; i++ )
-                    (void)Mat_doubleSwap(data+i);
-            } else {
-                InflateData(mat,z,data,len*data_size);
-            }
-            break;
-        }
-        case MAT_T_SINGLE:
-        {
-            if ( mat->byteswap ) {
-                if ( len <= 256 ){
-                    InflateData(mat,z,buf.f,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = Mat_floatSwap(buf.f+i);
-                } else {
-                    int j;
-                    len -= 256;
-                    for ( i = 0; i < len; i+=256 ) {
-                        InflateData(mat,z,buf.f,256*data_size);
-                        for ( j = 0; j < 256; j++ )
-                            data[i+j] = Mat_floatSwap(buf.f+j);
-                    }
-                    len = len-(i-256);
-                    InflateData(mat,z,buf.f,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = Mat_floatSwap(buf.f+j);
-                }
-            } else {
-                if ( len <= 256 ){
-                    InflateData(mat,z,buf.f,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = buf.f[i];
-                } else {
-                    int j;
-                    len -= 256;
-                    for ( i = 0; i < len; i+=256 ) {
-                        InflateData(mat,z,buf.f,256*data_size);
-                        for ( j = 0; j < 256; j++ )
-                            data[i+j] = buf.f[j];
-                    }
-                    len = len-(i-256);
-                    InflateData(mat,z,buf.f,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = buf.f[j];
-                }
-            }
-            break;
-        }
-#ifdef HAVE_MAT_INT64_T
-        case MAT_T_INT64:
-        {
-            if ( mat->byteswap ) {
-                if ( len <= 128 ){
-                    InflateData(mat,z,buf.i64,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = (double)Mat_int64Swap(buf.i64+i);
-                } else {
-                    int j;
-                    len -= 128;
-                    for ( i = 0; i < len; i+=128 ) {
-                        InflateData(mat,z,buf.i64,128*data_size);
-                        for ( j = 0; j < 128; j++ )
-                            data[i+j] = (double)Mat_int64Swap(buf.i64+j);
-                    }
-                    len = len-(i-128);
-                    InflateData(mat,z,buf.i64,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = (double)Mat_int64Swap(buf.i64+j);
-                }
-            } else {
-                if ( len <= 128 ){
-                    InflateData(mat,z,buf.i64,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = (double)buf.i64[i];
-                } else {
-                    int j;
-                    len -= 128;
-                    for ( i = 0; i < len; i+=128 ) {
-                        InflateData(mat,z,buf.i64,128*data_size);
-                        for ( j = 0; j < 128; j++ )
-                            data[i+j] = (double)buf.i64[j];
-                    }
-                    len = len-(i-128);
-                    InflateData(mat,z,buf.i64,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = (double)buf.i64[j];
-                }
-            }
-            break;
-        }
-#endif
-#ifdef HAVE_MAT_UINT64_T
-        case MAT_T_UINT64:
-        {
-            if ( mat->byteswap ) {
-                if ( len <= 128 ){
-                    InflateData(mat,z,buf.ui64,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = (double)Mat_uint64Swap(buf.ui64+i);
-                } else {
-                    int j;
-                    len -= 128;
-                    for ( i = 0; i < len; i+=128 ) {
-                        InflateData(mat,z,buf.ui64,128*data_size);
-                        for ( j = 0; j < 128; j++ )
-                            data[i+j] = (double)Mat_uint64Swap(buf.ui64+j);
-                    }
-                    len = len-(i-128);
-                    InflateData(mat,z,buf.ui64,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = (double)Mat_uint64Swap(buf.ui64+j);
-                }
-            } else {
-                if ( len <= 128 ){
-                    InflateData(mat,z,buf.ui64,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = (double)buf.ui64[i];
-                } else {
-                    int j;
-                    len -= 128;
-                    for ( i = 0; i < len; i+=128 ) {
-                        InflateData(mat,z,buf.ui64,128*data_size);
-                        for ( j = 0; j < 128; j++ )
-                            data[i+j] = (double)buf.ui64[j];
-                    }
-                    len = len-(i-128);
-                    InflateData(mat,z,buf.ui64,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = (double)buf.ui64[j];
-                }
-            }
-            break;
-        }
-#endif
-        case MAT_T_INT32:
-        {
-            if ( mat->byteswap ) {
-                if ( len <= 256 ){
-                    InflateData(mat,z,buf.i32,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = Mat_int32Swap(buf.i32+i);
-                } else {
-                    int j;
-                    len -= 256;
-                    for ( i = 0; i < len; i+=256 ) {
-                        InflateData(mat,z,buf.i32,256*data_size);
-                        for ( j = 0; j < 256; j++ )
-                            data[i+j] = Mat_int32Swap(buf.i32+j);
-                    }
-                    len = len-(i-256);
-                    InflateData(mat,z,buf.i32,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = Mat_int32Swap(buf.i32+j);
-                }
-            } else {
-                if ( len <= 256 ){
-                    InflateData(mat,z,buf.i32,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = buf.i32[i];
-                } else {
-                    int j;
-                    len -= 256;
-                    for ( i = 0; i < len; i+=256 ) {
-                        InflateData(mat,z,buf.i32,256*data_size);
-                        for ( j = 0; j < 256; j++ )
-                            data[i+j] = buf.i32[j];
-                    }
-                    len = len-(i-256);
-                    InflateData(mat,z,buf.i32,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = buf.i32[j];
-                }
-            }
-            break;
-        }
-        case MAT_T_UINT32:
-        {
-            if ( mat->byteswap ) {
-                if ( len <= 256 ){
-                    InflateData(mat,z,buf.ui32,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = Mat_uint32Swap(buf.ui32+i);
-                } else {
-                    int j;
-                    len -= 256;
-                    for ( i = 0; i < len; i+=256 ) {
-                        InflateData(mat,z,buf.ui32,256*data_size);
-                        for ( j = 0; j < 256; j++ )
-                            data[i+j] = Mat_uint32Swap(buf.ui32+j);
-                    }
-                    len = len-(i-256);
-                    InflateData(mat,z,buf.ui32,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = Mat_uint32Swap(buf.ui32+j);
-                }
-            } else {
-                if ( len <= 256 ) {
-                    InflateData(mat,z,buf.ui32,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = buf.ui32[i];
-                } else {
-                    int j;
-                    len -= 256;
-                    for ( i = 0; i < len; i+=256 ) {
-                        InflateData(mat,z,buf.ui32,256*data_size);
-                        for ( j = 0; j < 256; j++ )
-                            data[i+j] = buf.ui32[j];
-                    }
-                    len = len-(i-256);
-                    InflateData(mat,z,buf.ui32,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = buf.ui32[j];
-                }
-            }
-            break;
-        }
-        case MAT_T_INT16:
-        {
-            if ( mat->byteswap ) {
-                if ( len <= 512 ){
-                    InflateData(mat,z,buf.i16,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = Mat_int16Swap(buf.i16+i);
-                } else {
-                    int j;
-                    len -= 512;
-                    for ( i = 0; i < len; i+=512 ) {
-                        InflateData(mat,z,buf.i16,512*data_size);
-                        for ( j = 0; j < 512; j++ )
-                            data[i+j] = Mat_int16Swap(buf.i16+j);
-                    }
-                    len = len-(i-512);
-                    InflateData(mat,z,buf.i16,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = Mat_int16Swap(buf.i16+j);
-                }
-            } else {
-                if ( len <= 512 ) {
-                    InflateData(mat,z,buf.i16,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = buf.i16[i];
-                } else {
-                    int j;
-                    len -= 512;
-                    for ( i = 0; i < len; i+=512 ) {
-                        InflateData(mat,z,buf.i16,512*data_size);
-                        for ( j = 0; j < 512; j++ )
-                            data[i+j] = buf.i16[j];
-                    }
-                    len = len-(i-512);
-                    InflateData(mat,z,buf.i16,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = buf.i16[j];
-                }
-            }
-            break;
-        }
-        case MAT_T_UINT16:
-        {
-            if ( mat->byteswap ) {
-                if ( len <= 512 ){
-                    InflateData(mat,z,buf.ui16,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = Mat_uint16Swap(buf.ui16+i);
-                } else {
-                    int j;
-                    len -= 512;
-                    for ( i = 0; i < len; i+=512 ) {
-                        InflateData(mat,z,buf.ui16,512*data_size);
-                        for ( j = 0; j < 512; j++ )
-                            data[i+j] = Mat_uint16Swap(buf.ui16+j);
-                    }
-                    len = len-(i-512);
-                    InflateData(mat,z,buf.ui16,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = Mat_uint16Swap(buf.ui16+j);
-                }
-            } else {
-                if ( len <= 512 ) {
-                    InflateData(mat,z,buf.ui16,len*data_size);
-                    for ( i = 0; i < len; i++ )
-                        data[i] = buf.ui16[i];
-                } else {
-                    int j;
-                    len -= 512;
-                    for ( i = 0; i < len; i+=512 ) {
-                        InflateData(mat,z,buf.ui16,512*data_size);
-                        for ( j = 0; j < 512; j++ )
-                            data[i+j] = buf.ui16[j];
-                    }
-                    len = len-(i-512);
-                    InflateData(mat,z,buf.ui16,len*data_size);
-                    for ( j = 0; j < len; j++ )
-                        data[i+j] = buf.ui16[j];
-                }
-            }
-            break;
-        }
-        case MAT_T_UINT8:
-        {
-            if ( len <= 1024 ) {
-                InflateData(mat,z,buf.ui8,len*data_size);
-                for ( i = 0; i < len; i++ )
-                    data[i] = buf.ui8[i];
-            } else {
-                int j;
-                len -= 1024;
-                for ( i = 0; i < len; i+=1024 ) {
-                    InflateData(mat,z,buf.ui8,1024*data_size);
-                    for ( j = 0; j < 1024; j++ )
-                        data[i+j] = buf.ui8[j];
-                }
-                len = len-(i-1024);
-                InflateData(mat,z,buf.ui8,len*data_size);
-                for ( j = 0; j < len; j++ )
-                    data[i+j] = buf.ui8[j];
-            }
-            break;
-        }
-        case MAT_T_INT8:
-        {
-            if ( len <= 1024 ) {
-                InflateData(mat,z,buf.i8,len*data_size);
-                for ( i = 0; i < len; i++ )
-                    data[i] = buf.i8[i];
-            } else {
-                int j;
-                len -= 1024;
-                for ( i = 0; i < len; i+=1024 ) {
-                    InflateData(mat,z,buf.i8,1024*data_size);
-                    for ( j = 0; j < 1024; j++ )
-                        data[i+j] = buf.i8[j];
-                }
-                len = len-(i-1024);
-                InflateData(mat,z,buf.i8,len*data_size);
-                for ( j = 0; j < len; j++ )
-                    data[i+j] = buf.i8[j];
-            }
-            break;
-        }
-        default:
-            return 0;
-    }
-    nBytes = len*data_size;
-    return nBytes;
+    return ReadCompressedConvertData(mat,z,data,MAT_T_DOUBLE,sizeof(double),
+        ConvertToDouble,data_type,len);
 }
 #endif
 
@@ -803,19 +503,11 @@ ReadCompressedDoubleData(mat_t *mat,z_streamp z,double *data,
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
-ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
+size_t
+ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,size_t len)
 {
-    int bytesread = 0, i, j;
-    size_t data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
-        return 0;
-
-    data_size = Mat_SizeOf(data_type);
-    READ_DATA_TYPE(float);
-    bytesread *= data_size;
-    return bytesread;
+    return ReadConvertData(mat,data,MAT_T_SINGLE,sizeof(float),
+        ConvertToSingle,data_type,len);
 }
 
 #if defined(HAVE_ZLIB)
@@ -832,20 +524,12 @@ ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedSingleData(mat_t *mat,z_streamp z,float *data,
-    enum matio_types data_type,int len)
+    enum matio_types data_type,size_t len)
 {
-    int nBytes = 0, i;
-    unsigned int data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (z == NULL) )
-        return 0;
-
-    data_size = (unsigned int)Mat_SizeOf(data_type);
-    READ_COMPRESSED_DATA_TYPE(float);
-    nBytes = len*data_size;
-    return nBytes;
+    return ReadCompressedConvertData(mat,z,data,MAT_T_SINGLE,sizeof(float),
+        ConvertToSingle,data_type,len);
 }
 #endif
 
@@ -863,19 +547,11 @@ ReadCompressedSingleData(mat_t *mat,z_streamp z,float *data,
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
-ReadInt64Data(mat_t *mat,mat_int64_t *data,enum matio_types data_type,int len)
+size_t
+ReadInt64Data(mat_t *mat,mat_int64_t *data,enum matio_types data_type,size_t len)
 {
-    int bytesread = 0, i, j;
-    size_t data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
-        return 0;
-
-    data_size = Mat_SizeOf(data_type);
-    READ_DATA_TYPE(mat_int64_t);
-    bytesread *= data_size;
-    return bytesread;
+    return ReadConvertData(mat,data,MAT_T_INT64,sizeof(mat_int64_t),
+        ConvertToInt64,data_type,len);
 }
 
 #if defined(HAVE_ZLIB)
@@ -893,20 +569,12 @@ ReadInt64Data(mat_t *mat,mat_int64_t *data,enum matio_types data_type,int len)
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedInt64Data(mat_t *mat,z_streamp z,mat_int64_t *data,
-    enum matio_types data_type,int len)
+    enum matio_types data_type,size_t len)
 {
-    int nBytes = 0, i;
-    unsigned int data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (z == NULL) )
-        return 0;
-
-    data_size = (unsigned int)Mat_SizeOf(data_type);
-    READ_COMPRESSED_DATA_TYPE(mat_int64_t);
-    nBytes = len*data_size;
-    return nBytes;
+    return ReadCompressedConvertData(mat,z,data,MAT_T_INT64,sizeof(mat_int64_t),
+        ConvertToInt64,data_type,len);
 }
 #endif
 #endif /* HAVE_MAT_INT64_T */
@@ -925,19 +593,11 @@ ReadCompressedInt64Data(mat_t *mat,z_streamp z,mat_int64_t *data,
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
-ReadUInt64Data(mat_t *mat,mat_uint64_t *data,enum matio_types data_type,int len)
+size_t
+ReadUInt64Data(mat_t *mat,mat_uint64_t *data,enum matio_types data_type,size_t len)
 {
-    int bytesread = 0, i, j;
-    size_t data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
-        return 0;
-
-    data_size = Mat_SizeOf(data_type);
-    READ_DATA_TYPE(mat_uint64_t);
-    bytesread *= data_size;
-    return bytesread;
+    return ReadConvertData(mat,data,MAT_T_UINT64,sizeof(mat_uint64_t),
+        ConvertToUInt64,data_type,len);
 }
 
 #if defined(HAVE_ZLIB)
@@ -955,20 +615,12 @@ ReadUInt64Data(mat_t *mat,mat_uint64_t *data,enum matio_types data_type,int len)
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedUInt64Data(mat_t *mat,z_streamp z,mat_uint64_t *data,
-    enum matio_types data_type,int len)
+    enum matio_types data_type,size_t len)
 {
-    int nBytes = 0, i;
-    unsigned int data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (z == NULL) )
-        return 0;
-
-    data_size = (unsigned int)Mat_SizeOf(data_type);
-    READ_COMPRESSED_DATA_TYPE(mat_uint64_t);
-    nBytes = len*data_size;
-    return nBytes;
+    return ReadCompressedConvertData(mat,z,data,MAT_T_UINT64,sizeof(mat_uint64_t),
+        ConvertToUInt64,data_type,len);
 }
 #endif /* HAVE_ZLIB */
 #endif /* HAVE_MAT_UINT64_T */
@@ -986,19 +638,11 @@ ReadCompressedUInt64Data(mat_t *mat,z_streamp z,mat_uint64_t *data,
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
-ReadInt32Data(mat_t *mat,mat_int32_t *data,enum matio_types data_type,int len)
+size_t
+ReadInt32Data(mat_t *mat,mat_int32_t *data,enum matio_types data_type,size_t len)
 {
-    int bytesread = 0, i, j;
-    size_t data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
-        return 0;
-
-    data_size = Mat_SizeOf(data_type);
-    READ_DATA_TYPE(mat_int32_t);
-    bytesread *= data_size;
-    return bytesread;
+    return ReadConvertData(mat,data,MAT_T_INT32,sizeof(mat_int32_t),
+        ConvertToInt32,data_type,len);
 }
 
 #if defined(HAVE_ZLIB)
@@ -1016,20 +660,12 @@ ReadInt32Data(mat_t *mat,mat_int32_t *data,enum matio_types data_type,int len)
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedInt32Data(mat_t *mat,z_streamp z,mat_int32_t *data,
-    enum matio_types data_type,int len)
+    enum matio_types data_type,size_t len)
 {
-    int nBytes = 0, i;
-    unsigned int data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (z == NULL) )
-        return 0;
-
-    data_size = (unsigned int)Mat_SizeOf(data_type);
-    READ_COMPRESSED_DATA_TYPE(mat_int32_t);
-    nBytes = len*data_size;
-    return nBytes;
+    return ReadCompressedConvertData(mat,z,data,MAT_T_INT32,sizeof(mat_int32_t),
+        ConvertToInt32,data_type,len);
 }
 #endif
 
@@ -1046,19 +682,11 @@ ReadCompressedInt32Data(mat_t *mat,z_streamp z,mat_int32_t *data,
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
-ReadUInt32Data(mat_t *mat,mat_uint32_t *data,enum matio_types data_type,int len)
+size_t
+ReadUInt32Data(mat_t *mat,mat_uint32_t *data,enum matio_types data_type,size_t len)
 {
-    int bytesread = 0, i, j;
-    size_t data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
-        return 0;
-
-    data_size = Mat_SizeOf(data_type);
-    READ_DATA_TYPE(mat_uint32_t);
-    bytesread *= data_size;
-    return bytesread;
+    return ReadConvertData(mat,data,MAT_T_UINT32,sizeof(mat_uint32_t),
+        ConvertToUInt32,data_type,len);
 }
 
 #if defined(HAVE_ZLIB)
@@ -1076,20 +704,12 @@ ReadUInt32Data(mat_t *mat,mat_uint32_t *data,enum matio_types data_type,int len)
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedUInt32Data(mat_t *mat,z_streamp z,mat_uint32_t *data,
-    enum matio_types data_type,int len)
+    enum matio_types data_type,size_t len)
 {
-    int nBytes = 0, i;
-    unsigned int data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (z == NULL) )
-        return 0;
-
-    data_size = (unsigned int)Mat_SizeOf(data_type);
-    READ_COMPRESSED_DATA_TYPE(mat_uint32_t);
-    nBytes = len*data_size;
-    return nBytes;
+    return ReadCompressedConvertData(mat,z,data,MAT_T_UINT32,sizeof(mat_uint32_t),
+        ConvertToUInt32,data_type,len);
 }
 #endif
 
@@ -1106,19 +726,11 @@ ReadCompressedUInt32Data(mat_t *mat,z_streamp z,mat_uint32_t *data,
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
-ReadInt16Data(mat_t *mat,mat_int16_t *data,enum matio_types data_type,int len)
+size_t
+ReadInt16Data(mat_t *mat,mat_int16_t *data,enum matio_types data_type,size_t len)
 {
-    int bytesread = 0, i, j;
-    size_t data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
-        return 0;
-
-    data_size = Mat_SizeOf(data_type);
-    READ_DATA_TYPE(mat_int16_t);
-    bytesread *= data_size;
-    return bytesread;
+    return ReadConvertData(mat,data,MAT_T_INT16,sizeof(mat_int16_t),
+        ConvertToInt16,data_type,len);
 }
 
 #if defined(HAVE_ZLIB)
@@ -1136,20 +748,12 @@ ReadInt16Data(mat_t *mat,mat_int16_t *data,enum matio_types data_type,int len)
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedInt16Data(mat_t *mat,z_streamp z,mat_int16_t *data,
-    enum matio_types data_type,int len)
+    enum matio_types data_type,size_t len)
 {
-    int nBytes = 0, i;
-    unsigned int data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (z == NULL) )
-        return 0;
-
-    data_size = (unsigned int)Mat_SizeOf(data_type);
-    READ_COMPRESSED_DATA_TYPE(mat_int16_t);
-    nBytes = len*data_size;
-    return nBytes;
+    return ReadCompressedConvertData(mat,z,data,MAT_T_INT16,sizeof(mat_int16_t),
+        ConvertToInt16,data_type,len);
 }
 #endif
 
@@ -1166,19 +770,11 @@ ReadCompressedInt16Data(mat_t *mat,z_streamp z,mat_int16_t *data,
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
-ReadUInt16Data(mat_t *mat,mat_uint16_t *data,enum matio_types data_type,int len)
+size_t
+ReadUInt16Data(mat_t *mat,mat_uint16_t *data,enum matio_types data_type,size_t len)
 {
-    int bytesread = 0, i, j;
-    size_t data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
-        return 0;
-
-    data_size = Mat_SizeOf(data_type);
-    READ_DATA_TYPE(mat_uint16_t);
-    bytesread *= data_size;
-    return bytesread;
+    return ReadConvertData(mat,data,MAT_T_UINT16,sizeof(mat_uint16_t),
+        ConvertToUInt16,data_type,len);
 }
 
 #if defined(HAVE_ZLIB)
@@ -1196,20 +792,12 @@ ReadUInt16Data(mat_t *mat,mat_uint16_t *data,enum matio_types data_type,int len)
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedUInt16Data(mat_t *mat,z_streamp z,mat_uint16_t *data,
-    enum matio_types data_type,int len)
+    enum matio_types data_type,size_t len)
 {
-    int nBytes = 0, i;
-    unsigned int data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (z == NULL) )
-        return 0;
-
-    data_size = (unsigned int)Mat_SizeOf(data_type);
-    READ_COMPRESSED_DATA_TYPE(mat_uint16_t);
-    nBytes = len*data_size;
-    return nBytes;
+    return ReadCompressedConvertData(mat,z,data,MAT_T_UINT16,sizeof(mat_uint16_t),
+        ConvertToUInt16,data_type,len);
 }
 #endif
 
@@ -1226,19 +814,11 @@ ReadCompressedUInt16Data(mat_t *mat,z_streamp z,mat_uint16_t *data,
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
-ReadInt8Data(mat_t *mat,mat_int8_t *data,enum matio_types data_type,int len)
+size_t
+ReadInt8Data(mat_t *mat,mat_int8_t *data,enum matio_types data_type,size_t len)
 {
-    int bytesread = 0, i, j;
-    size_t data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
-        return 0;
-
-    data_size = Mat_SizeOf(data_type);
-    READ_DATA_TYPE(mat_int8_t);
-    bytesread *= data_size;
-    return bytesread;
+    return ReadConvertData(mat,data,MAT_T_INT8,sizeof(mat_int8_t),
+        ConvertToInt8,data_type,len);
 }
 
 #if defined(HAVE_ZLIB)
@@ -1256,20 +836,12 @@ ReadInt8Data(mat_t *mat,mat_int8_t *data,enum matio_types data_type,int len)
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedInt8Data(mat_t *mat,z_streamp z,mat_int8_t *data,
-    enum matio_types data_type,int len)
+    enum matio_types data_type,size_t len)
 {
-    int nBytes = 0, i;
-    unsigned int data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (z == NULL) )
-        return 0;
-
-    data_size = (unsigned int)Mat_SizeOf(data_type);
-    READ_COMPRESSED_DATA_TYPE(mat_int8_t);
-    nBytes = len*data_size;
-    return nBytes;
+    return ReadCompressedConvertData(mat,z,data,MAT_T_INT8,sizeof(mat_int8_t),
+        ConvertToInt8,data_type,len);
 }
 #endif
 
@@ -1286,19 +858,11 @@ ReadCompressedInt8Data(mat_t *mat,z_streamp z,mat_int8_t *data,
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
-ReadUInt8Data(mat_t *mat,mat_uint8_t *data,enum matio_types data_type,int len)
+size_t
+ReadUInt8Data(mat_t *mat,mat_uint8_t *data,enum matio_types data_type,size_t len)
 {
-    int bytesread = 0, i, j;
-    size_t data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
-        return 0;
-
-    data_size = Mat_SizeOf(data_type);
-    READ_DATA_TYPE(mat_uint8_t);
-    bytesread *= data_size;
-    return bytesread;
+    return ReadConvertData(mat,data,MAT_T_UINT8,sizeof(mat_uint8_t),
+        ConvertToUInt8,data_type,len);
 }
 
 #if defined(HAVE_ZLIB)
@@ -1316,33 +880,26 @@ ReadUInt8Data(mat_t *mat,mat_uint8_t *data,enum matio_types data_type,int len)
  * @param len Number of elements of type @c data_type to read from the file
  * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedUInt8Data(mat_t *mat,z_streamp z,mat_uint8_t *data,
-    enum matio_types data_type,int len)
+    enum matio_types data_type,size_t len)
 {
-    int nBytes = 0, i;
-    unsigned int data_size;
-
-    if ( (mat == NULL) || (data == NULL) || (z == NULL) )
-        return 0;
-
-    data_size = (unsigned int)Mat_SizeOf(data_type);
-    READ_COMPRESSED_DATA_TYPE(mat_uint8_t);
-    nBytes = len*data_size;
-    return nBytes;
+    return ReadCompressedConvertData(mat,z,data,MAT_T_UINT8,sizeof(mat_uint8_t),
+        ConvertToUInt8,data_type,len);
 }
 #endif
 
-#undef READ_DATA
-#undef READ_DATA_TYPE
-#undef READ_DATA_INT64
-#undef READ_DATA_UINT64
-#if defined(HAVE_ZLIB)
-#undef READ_COMPRESSED_DATA
-#undef READ_COMPRESSED_DATA_TYPE
-#undef READ_COMPRESSED_DATA_INT64
-#undef READ_COMPRESSED_DATA_UINT64
-#endif
+#undef READ_CONVERT
+#undef READ_CONVERT_INT64
+#undef READ_CONVERT_UINT64
+#undef READ_CONVERT_ENTRY_INT64
+#undef READ_CONVERT_ENTRY_UINT64
+#undef READ_CONVERT_TABLE
+#undef READ_CONVERT_LANES
+#undef SWAP_8
+#undef SWAP_16
+#undef SWAP_32
+#undef SWAP_64
 #if defined(HAVE_ZLIB)
 /** @brief Reads data of type @c data_type into a char type
  *
@@ -1804,7 +1361,7 @@ ReadCompressedDataSlabN(mat_t *mat,z_streamp z,void *data,
         } else { \
             for ( i = 0; i < edge; i++ ) { \
                 bytesread+=ReadDataFunc(mat,ptr+i,data_type,1); \
-                (void)fseek((FILE*)mat->fp,stride,SEEK_CUR); \
+                (void)fseek((FILE*)mat->fp,(long)stride,SEEK_CUR); \
             } \
         } \
     } while (0)
@@ -1820,18 +1377,16 @@ ReadCompressedDataSlabN(mat_t *mat,z_streamp z,void *data,
  * @param start Index to start reading data
  * @param stride Read every @c stride elements
  * @param edge Number of elements to read
- * @return Number of bytes read from the file, or -1 on error
+ * @return Number of bytes read from the file
  */
-int
+size_t
 ReadDataSlab1(mat_t *mat,void *data,enum matio_classes class_type,
-    enum matio_types data_type,int start,int stride,int edge)
+    enum matio_types data_type,size_t start,size_t stride,size_t edge)
 {
-    int i;
-    size_t data_size;
-    int    bytesread = 0;
+    size_t i, data_size, bytesread = 0;
 
     data_size = Mat_SizeOf(data_type);
-    (void)fseek((FILE*)mat->fp,start*data_size,SEEK_CUR);
+    (void)fseek((FILE*)mat->fp,(long)(start*data_size),SEEK_CUR);
     stride = data_size*(stride-1);
 
     switch ( class_type ) {
@@ -1914,6 +1469,7 @@ ReadDataSlab1(mat_t *mat,void *data,enum matio_classes class_type,
         /* data so get rid of the loops. */ \
         if ( (stride[0] == 1 && edge[0] == dims[0]) && \
              (stride[1] == 1) ) { \
+            (void)fseek((FILE*)mat->fp,(long)start[1]*dims[0]*data_size,SEEK_CUR); \
             ReadDataFunc(mat,ptr,data_type,(ptrdiff_t)edge[0]*edge[1]); \
         } else { \
             row_stride = (long)(stride[0]-1)*data_size; \
@@ -2073,14 +1629,15 @@ ReadDataSlab2(mat_t *mat,void *data,enum matio_classes class_type,
  * @param start Index to start reading data in each dimension
  * @param stride Read every @c stride elements in each dimension
  * @param edge Number of elements to read in each dimension
- * @retval Number of bytes read from the file, or -1 on error
+ * @retval Number of bytes read from the file
  */
-int
+size_t
 ReadCompressedDataSlab1(mat_t *mat,z_streamp z,void *data,
-    enum matio_classes class_type,enum matio_types data_type,int start,
-    int stride,int edge)
+    enum matio_classes class_type,enum matio_types data_type,size_t start,
+    size_t stride,size_t edge)
 {
-    int nBytes = 0, i, err;
+    size_t nBytes = 0, i;
+    int err;
     z_stream z_copy = {0,};
 
     if ( (mat == NULL) || (data == NULL) || (mat->fp == NULL) )
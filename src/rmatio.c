@@ -20,6 +20,16 @@
 #include <R.h>
 #include <Rinternals.h>
 #include <R_ext/Rdynload.h>
+#include <Rversion.h>
+#include <setjmp.h>
+#include <stdint.h>
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 5, 0)
+#define HAVE_UNWIND_PROTECT 1
+#endif
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 6, 0)
+#define HAVE_ALTREP 1
+#include <R_ext/Altrep.h>
+#endif
 #include "matio/matio.h"
 
 /*
@@ -89,10 +99,10 @@ map_R_object_rank_and_dims(const SEXP elmt, int *rank, size_t **dims)
     if (Rf_isNull(Rf_getAttrib(elmt, R_DimSymbol))) {
         *rank = 2;
         *dims = malloc((*rank)*sizeof(size_t));
-        if (NULL == dims)
+        if (NULL == *dims)
             return 1;
         (*dims)[0] = 1;
-        (*dims)[1] = LENGTH(elmt);
+        (*dims)[1] = XLENGTH(elmt);
     } else {
         *rank = LENGTH(GET_SLOT(elmt, R_DimSymbol));
         *dims = malloc((*rank)*sizeof(size_t));
@@ -540,8 +550,9 @@ write_matvar(mat_t *mat,
     } else if(mat_cell) {
         Mat_VarSetCell(mat_cell, index, matvar);
     } else {
-        Mat_VarWrite(mat, matvar, compression);
-        Mat_VarFree(matvar);
+        /* The variable is freed when written, possibly after it's
+         * compressed on a writer thread. */
+        Mat_VarWriteAsync(mat, matvar, compression);
     }
 
     return 0;
@@ -651,13 +662,17 @@ write_realsxp(const SEXP elmt,
     if (map_R_object_rank_and_dims(elmt, &rank, &dims))
         return 1;
 
+    /* Reference the data of the vector instead of copying it. The
+     * vector is in the list passed to write_mat, so it outlives the
+     * matvar, also in a struct or cell, and in the queue of the
+     * writer threads. Mat_VarFree doesn't free referenced data. */
     matvar = Mat_VarCreate(name,
                            MAT_C_DOUBLE,
                            MAT_T_DOUBLE,
                            rank,
                            dims,
                            REAL(elmt),
-                           0);
+                           MAT_F_DONT_COPY_DATA);
 
     free(dims);
 
@@ -708,13 +723,14 @@ write_intsxp(const SEXP elmt,
     if (map_R_object_rank_and_dims(elmt, &rank, &dims))
         return 1;
 
+    /* Reference the data of the vector, see write_realsxp */
     matvar = Mat_VarCreate(name,
                            MAT_C_INT32,
                            MAT_T_INT32,
                            rank,
                            dims,
                            INTEGER(elmt),
-                           0);
+                           MAT_F_DONT_COPY_DATA);
 
     free(dims);
 
@@ -768,20 +784,20 @@ write_cplxsxp(const SEXP elmt,
     if (map_R_object_rank_and_dims(elmt, &rank, &dims))
         return 1;
 
-    re = malloc(LENGTH(elmt)*sizeof(double));
+    re = malloc(XLENGTH(elmt)*sizeof(double));
     if (NULL == re) {
         free(dims);
         return 1;
     }
 
-    im = malloc(LENGTH(elmt)*sizeof(double));
+    im = malloc(XLENGTH(elmt)*sizeof(double));
     if (NULL == im) {
         free(dims);
         free(re);
         return 1;
     }
 
-    for (int i=0;i<LENGTH(elmt);i++) {
+    for (R_xlen_t i=0;i<XLENGTH(elmt);i++) {
         re[i] = COMPLEX(elmt)[i].r;
         im[i] = COMPLEX(elmt)[i].i;
     }
@@ -881,6 +897,218 @@ write_lglsxp(const SEXP elmt,
                         compression);
 }
 
+/** @brief Convert a double to an integer class
+ *
+ * Rounds half away from zero and saturates to [lo, hi], like a cast
+ * to an integer class in MATLAB. NaN (and NA) is converted to 0.
+ *
+ * @ingroup rmatio
+ * @param x The value to convert
+ * @param lo The smallest value of the integer class
+ * @param hi The largest value of the integer class
+ * @return The converted value.
+ */
+static double
+round_saturate(double x, double lo, double hi)
+{
+    if (ISNAN(x))
+        return 0;
+    x = round(x);
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+#ifdef HAVE_MAT_INT64_T
+/** @brief Convert a double to int64, see round_saturate
+ *
+ * @ingroup rmatio
+ * @param x The value to convert
+ * @return The converted value.
+ */
+static mat_int64_t
+round_saturate_int64(double x)
+{
+    /* INT64_MAX is not a double, 2^63 is the first double above it */
+    if (x >= 9223372036854775808.0)
+        return INT64_MAX;
+    return (mat_int64_t)round_saturate(x, -9223372036854775808.0,
+                                       9223372036854775807.0);
+}
+#endif
+
+#ifdef HAVE_MAT_UINT64_T
+/** @brief Convert a double to uint64, see round_saturate
+ *
+ * @ingroup rmatio
+ * @param x The value to convert
+ * @return The converted value.
+ */
+static mat_uint64_t
+round_saturate_uint64(double x)
+{
+    /* 2^64 is the first double above UINT64_MAX */
+    if (x >= 18446744073709551616.0)
+        return UINT64_MAX;
+    return (mat_uint64_t)round_saturate(x, 0, 18446744073709551615.0);
+}
+#endif
+
+/* Converts the values of real, or of integer if real is NULL, to
+ * type with the expression expr of the value x, a double. */
+#define CONVERT(type, expr)                                     \
+    do {                                                        \
+        type *out = (type*)dst;                                 \
+        if (NULL != real) {                                     \
+            for (size_t i = 0; i < n; i++) {                    \
+                const double x = real[i];                       \
+                out[i] = (type)(expr);                          \
+            }                                                   \
+        } else {                                                \
+            for (size_t i = 0; i < n; i++) {                    \
+                const double x = NA_INTEGER == integer[i] ?     \
+                    NA_REAL : integer[i];                       \
+                out[i] = (type)(expr);                          \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+/** @brief Convert R data to the data of a MAT class
+ *
+ * Converts the values in one pass, straight into the data of the MAT
+ * variable. Values are rounded and saturated to the range of an
+ * integer class, see round_saturate. NA is NaN in the floating point
+ * classes.
+ *
+ * @ingroup rmatio
+ * @param real The values to convert, or NULL
+ * @param integer The values to convert if real is NULL
+ * @param n The number of values
+ * @param dst The data of the MAT variable
+ * @param class_type The MAT class of dst
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+convert_data(const double *real,
+             const int *integer,
+             size_t n,
+             void *dst,
+             enum matio_classes class_type)
+{
+    switch (class_type) {
+    case MAT_C_DOUBLE:
+        CONVERT(double, x);
+        break;
+    case MAT_C_SINGLE:
+        CONVERT(float, x);
+        break;
+    case MAT_C_INT8:
+        CONVERT(mat_int8_t, round_saturate(x, INT8_MIN, INT8_MAX));
+        break;
+    case MAT_C_UINT8:
+        CONVERT(mat_uint8_t, round_saturate(x, 0, UINT8_MAX));
+        break;
+    case MAT_C_INT16:
+        CONVERT(mat_int16_t, round_saturate(x, INT16_MIN, INT16_MAX));
+        break;
+    case MAT_C_UINT16:
+        CONVERT(mat_uint16_t, round_saturate(x, 0, UINT16_MAX));
+        break;
+    case MAT_C_INT32:
+        CONVERT(mat_int32_t, round_saturate(x, INT32_MIN, INT32_MAX));
+        break;
+    case MAT_C_UINT32:
+        CONVERT(mat_uint32_t, round_saturate(x, 0, UINT32_MAX));
+        break;
+#ifdef HAVE_MAT_INT64_T
+    case MAT_C_INT64:
+        CONVERT(mat_int64_t, round_saturate_int64(x));
+        break;
+#endif
+#ifdef HAVE_MAT_UINT64_T
+    case MAT_C_UINT64:
+        CONVERT(mat_uint64_t, round_saturate_uint64(x));
+        break;
+#endif
+    default:
+        return 1;
+    }
+
+    return 0;
+}
+
+#undef CONVERT
+
+/** @brief Write a REALSXP or INTSXP as a MAT class
+ *
+ * Writes the numeric vector with the storage of the MAT class, e.g.
+ * single precision or 16-bit integers, instead of double or int32.
+ * The data is converted straight into the data of the MAT variable,
+ * see convert_data.
+ *
+ * @ingroup rmatio
+ * @param elmt R object to write
+ * @param mat MAT file pointer
+ * @param name Name of the variable to write
+ * @param class_type The MAT class to write
+ * @param compression Write the file with compression or not
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+write_numeric_as(const SEXP elmt,
+                 mat_t *mat,
+                 const char *name,
+                 enum matio_classes class_type,
+                 int compression)
+{
+    static const enum matio_types data_types[] = {
+        [MAT_C_DOUBLE] = MAT_T_DOUBLE, [MAT_C_SINGLE] = MAT_T_SINGLE,
+        [MAT_C_INT8]   = MAT_T_INT8,   [MAT_C_UINT8]  = MAT_T_UINT8,
+        [MAT_C_INT16]  = MAT_T_INT16,  [MAT_C_UINT16] = MAT_T_UINT16,
+        [MAT_C_INT32]  = MAT_T_INT32,  [MAT_C_UINT32] = MAT_T_UINT32,
+        [MAT_C_INT64]  = MAT_T_INT64,  [MAT_C_UINT64] = MAT_T_UINT64};
+    size_t *dims;
+    int rank;
+    matvar_t *matvar;
+
+    if (Rf_isNull(elmt) || (REALSXP != TYPEOF(elmt) && INTSXP != TYPEOF(elmt))
+        || class_type < MAT_C_DOUBLE || class_type > MAT_C_UINT64)
+        return 1;
+
+    /* The data is referenced without a conversion */
+    if (MAT_C_DOUBLE == class_type && REALSXP == TYPEOF(elmt))
+        return write_realsxp(elmt, mat, name, NULL, NULL, 0, 0, compression);
+    if (MAT_C_INT32 == class_type && INTSXP == TYPEOF(elmt))
+        return write_intsxp(elmt, mat, name, NULL, NULL, 0, 0, compression);
+
+    if (map_R_object_rank_and_dims(elmt, &rank, &dims))
+        return 1;
+
+    /* Create the variable without data, and convert into data that
+     * the variable owns */
+    matvar = Mat_VarCreate(name,
+                           class_type,
+                           data_types[class_type],
+                           rank,
+                           dims,
+                           NULL,
+                           0);
+    free(dims);
+    if (NULL == matvar)
+        return 1;
+
+    if (matvar->nbytes > 0) {
+        matvar->data = malloc(matvar->nbytes);
+        if (NULL == matvar->data
+            || convert_data(REALSXP == TYPEOF(elmt) ? REAL(elmt) : NULL,
+                            INTSXP == TYPEOF(elmt) ? INTEGER(elmt) : NULL,
+                            XLENGTH(elmt), matvar->data, class_type)) {
+            Mat_VarFree(matvar);
+            return 1;
+        }
+    }
+
+    return write_matvar(mat, matvar, NULL, NULL, 0, 0, compression);
+}
+
 /** @brief Write STRSXP
  *
  *
@@ -2181,7 +2409,8 @@ read_mat_complex(SEXP list,
 
 /** @brief Read data
  *
- *
+ * Copy the data that matio has read into the variable to an R vector,
+ * converted to double or integer in bulk.
  * @ingroup rmatio
  * @param list The list to hold the read data
  * @param index The position in the list where to store the read data
@@ -2195,6 +2424,7 @@ read_mat_data(SEXP list,
 {
     SEXP m;
     size_t len;
+    int err;
 
     if (NULL == matvar
         || 2 > matvar->rank
@@ -2208,71 +2438,31 @@ read_mat_data(SEXP list,
         len *= matvar->dims[j];
 
     switch (matvar->data_type) {
-    case MAT_T_SINGLE:
-        PROTECT(m = Rf_allocVector(REALSXP, len));
-        for (size_t j=0;j<len;j++)
-            REAL(m)[j] = ((float*)matvar->data)[j];
-        break;
-
     case MAT_T_DOUBLE:
-        PROTECT(m = Rf_allocVector(REALSXP, len));
-        for (size_t j=0;j<len;j++)
-            REAL(m)[j] = ((double*)matvar->data)[j];
-        break;
-
+    case MAT_T_SINGLE:
     case MAT_T_INT64:
+    case MAT_T_UINT64:
+    case MAT_T_UINT32:
         PROTECT(m = Rf_allocVector(REALSXP, len));
-        for (size_t j=0;j<len;j++)
-            REAL(m)[j] = ((mat_int64_t*)matvar->data)[j];
+        err = Mat_ConvertData(REAL(m), MAT_T_DOUBLE, matvar->data,
+                              matvar->data_type, len);
         break;
 
     case MAT_T_INT32:
-        PROTECT(m = Rf_allocVector(INTSXP, len));
-        for (size_t j=0;j<len;j++)
-            INTEGER(m)[j] = ((mat_int32_t*)matvar->data)[j];
-        break;
-
     case MAT_T_INT16:
-        PROTECT(m = Rf_allocVector(INTSXP, len));
-        for (size_t j=0;j<len;j++)
-            INTEGER(m)[j] = ((mat_int16_t*)matvar->data)[j];
-        break;
-
     case MAT_T_INT8:
-        PROTECT(m = Rf_allocVector(INTSXP, len));
-        for (size_t j=0;j<len;j++)
-            INTEGER(m)[j] = ((mat_int8_t*)matvar->data)[j];
-        break;
-
-    case MAT_T_UINT64:
-        PROTECT(m = Rf_allocVector(REALSXP, len));
-        for (size_t j=0;j<len;j++)
-            REAL(m)[j] = ((mat_uint64_t*)matvar->data)[j];
-        break;
-
-    case MAT_T_UINT32:
-        PROTECT(m = Rf_allocVector(REALSXP, len));
-        for (size_t j=0;j<len;j++)
-            REAL(m)[j] = ((mat_uint32_t*)matvar->data)[j];
-        break;
-
     case MAT_T_UINT16:
-        PROTECT(m = Rf_allocVector(INTSXP, len));
-        for (size_t j=0;j<len;j++)
-            INTEGER(m)[j] = ((mat_uint16_t*)matvar->data)[j];
-        break;
-
     case MAT_T_UINT8:
         PROTECT(m = Rf_allocVector(INTSXP, len));
-        for (size_t j=0;j<len;j++)
-            INTEGER(m)[j] = ((mat_uint8_t*)matvar->data)[j];
+        err = Mat_ConvertData(INTEGER(m), MAT_T_INT32, matvar->data,
+                              matvar->data_type, len);
         break;
 
     default:
         return 1;
     }
 
-    if (set_dim(m, matvar)) {
+    if (err || set_dim(m, matvar)) {
         UNPROTECT(1);
         return 1;
     }
@@ -2327,173 +2517,1439 @@ read_logical(SEXP list,
     return 0;
 }
 
-/*
- * -------------------------------------------------------------
- *   Read structure arrays
- * -------------------------------------------------------------
- */
-
-/** @brief Read empty structure array
+/** @brief The type of the R vector for a real numeric variable
  *
  *
  * @ingroup rmatio
- * @param list The list to hold the read data
- * @param index The position in the list where to store the read data
+ * @param mat MAT file pointer
  * @param matvar MAT variable pointer
+ * @return LGLSXP, INTSXP or REALSXP, or NILSXP if the variable is
+ * not a real numeric or logical variable.
+ */
+static SEXPTYPE
+read_mat_sexptype(mat_t *mat,
+                  matvar_t *matvar)
+{
+    if (matvar->isComplex)
+        return NILSXP;
+
+    if (matvar->isLogical)
+        return LGLSXP;
+
+    if (MAT_FT_MAT4 == Mat_GetVersion(mat)) {
+        /* The class of a version 4 variable is always double, the
+         * data is kept in the type it is stored in. */
+        switch (matvar->data_type) {
+        case MAT_T_DOUBLE:
+        case MAT_T_SINGLE:
+            return REALSXP;
+        case MAT_T_INT32:
+        case MAT_T_INT16:
+        case MAT_T_UINT16:
+        case MAT_T_UINT8:
+            return INTSXP;
+        default:
+            return NILSXP;
+        }
+    }
+
+    switch (matvar->class_type) {
+    case MAT_C_DOUBLE:
+    case MAT_C_SINGLE:
+    case MAT_C_INT64:
+    case MAT_C_UINT64:
+    case MAT_C_UINT32:
+        return REALSXP;
+    case MAT_C_INT32:
+    case MAT_C_INT16:
+    case MAT_C_INT8:
+    case MAT_C_UINT16:
+    case MAT_C_UINT8:
+        return INTSXP;
+    default:
+        return NILSXP;
+    }
+}
+
+/** @brief Read real numeric or logical data into a buffer
+ *
+ * Decode a linear range of the data of the variable into a buffer of
+ * doubles (REALSXP) or integers (INTSXP and LGLSXP).
+ * @ingroup rmatio
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo
+ * @param type The type of the R vector, see read_mat_sexptype
+ * @param start Index (0-based) of the first element to read
+ * @param n Number of elements to read
+ * @param nelems Number of elements in the variable
+ * @param buf The buffer to store the data
  * @return 0 on succes or 1 on failure.
  */
 static int
-read_empty_structure_array(SEXP list,
-                           int index,
-                           matvar_t *matvar)
+read_mat_numeric_data(mat_t *mat,
+                      matvar_t *matvar,
+                      SEXPTYPE type,
+                      size_t start,
+                      size_t n,
+                      size_t nelems,
+                      void *buf)
 {
-    SEXP names;
-    SEXP struc;
+    enum matio_classes class_type, stored_class_type;
+    int err;
 
-    if (NULL == matvar
-        || matvar->class_type != MAT_C_STRUCT
-        || 2 != matvar->rank
-        || 1 != matvar->dims[0]
-        || 1 != matvar->dims[1]
-        || Mat_VarGetNumberOfFields(matvar))
+    class_type = (REALSXP == type) ? MAT_C_DOUBLE : MAT_C_INT32;
+    if (0 == start && n == nelems) {
+        err = Mat_VarReadDataAs(mat, matvar, buf, class_type);
+    } else {
+        /* The data is converted to the type of the class */
+        stored_class_type = matvar->class_type;
+        matvar->class_type = class_type;
+        err = Mat_VarReadDataLinear(mat, matvar, buf, start, 1, n);
+        matvar->class_type = stored_class_type;
+    }
+
+    if (err)
         return 1;
 
-    PROTECT(struc = Rf_allocVector(VECSXP, 0));
-    PROTECT(names = Rf_allocVector(STRSXP, 0));
-    Rf_setAttrib(struc, R_NamesSymbol, names);
-    SET_VECTOR_ELT(list, index, struc);
-    UNPROTECT(2);
+    if (LGLSXP == type) {
+        for (size_t j=0;j<n;j++)
+            ((int*)buf)[j] = (0 != ((int*)buf)[j]);
+    }
 
     return 0;
 }
 
-/** @brief Read empty structure array with fields
- *
+/** @brief Allocate the R vector of a real numeric or logical variable
  *
+ * Allocate the R vector with the dimensions of the variable and store
+ * it in the list. The data is not read.
  * @ingroup rmatio
  * @param list The list to hold the read data
  * @param index The position in the list where to store the read data
- * @param matvar MAT variable pointer
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo
+ * @param type The type of the R vector, see read_mat_sexptype
+ * @param len The number of elements of the R vector
+ * @param buf The data pointer of the R vector
  * @return 0 on succes or 1 on failure.
  */
 static int
-read_empty_structure_array_with_fields(SEXP list,
-                                       int index,
-                                       matvar_t *matvar)
+read_mat_numeric_alloc(SEXP list,
+                       int index,
+                       mat_t *mat,
+                       matvar_t *matvar,
+                       SEXPTYPE *type,
+                       size_t *len,
+                       void **buf)
 {
-    SEXP names;
-    SEXP struc;
-    size_t nfields = 0;
-    char * const * fieldnames;
-    int err = 0;
+    SEXP m;
 
     if (NULL == matvar
-        || MAT_C_STRUCT != matvar->class_type
-        || 2 != matvar->rank
-        || 0 != matvar->dims[0]
-        || 1 != matvar->dims[1])
+        || 2 > matvar->rank
+        || NULL == matvar->dims
+        || matvar->isComplex)
         return 1;
 
-    nfields = Mat_VarGetNumberOfFields(matvar);
-    if (!nfields)
+    *type = read_mat_sexptype(mat, matvar);
+    if (NILSXP == *type)
         return 1;
 
-    fieldnames = Mat_VarGetStructFieldnames(matvar);
-    PROTECT(struc = Rf_allocVector(VECSXP, nfields));
-    PROTECT(names = Rf_allocVector(STRSXP, nfields));
+    *len = matvar->dims[0];
+    for (size_t j=1;j<matvar->rank;j++)
+        *len *= matvar->dims[j];
 
-    for (size_t i=0;i<nfields;i++) {
-        SEXP s;
+    PROTECT(m = Rf_allocVector(*type, *len));
+    if (REALSXP == *type)
+        *buf = REAL(m);
+    else if (INTSXP == *type)
+        *buf = INTEGER(m);
+    else
+        *buf = LOGICAL(m);
 
-        if (!fieldnames[i]) {
-            err = 1;
-            goto cleanup;
-        }
-        SET_STRING_ELT(names, i, Rf_mkChar(fieldnames[i]));
-        PROTECT(s = Rf_allocVector(VECSXP, 0));
-        SET_VECTOR_ELT(struc, i, s);
+    if (set_dim(m, matvar)) {
         UNPROTECT(1);
+        return 1;
     }
 
-    Rf_setAttrib(struc, R_NamesSymbol, names);
-    SET_VECTOR_ELT(list, index, struc);
+    SET_VECTOR_ELT(list, index, m);
+    UNPROTECT(1);
 
-cleanup:
-    UNPROTECT(2);
+    return 0;
+}
 
-    return err;
+/** @brief Read real numeric or logical data directly into an R vector
+ *
+ * Allocate the R vector first and decode the data of the variable
+ * straight into the vector memory, without first reading the data
+ * into a buffer allocated by matio.
+ * @ingroup rmatio
+ * @param list The list to hold the read data
+ * @param index The position in the list where to store the read data
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_mat_numeric(SEXP list,
+                 int index,
+                 mat_t *mat,
+                 matvar_t *matvar)
+{
+    SEXPTYPE type;
+    size_t len;
+    void *buf;
+
+    if (read_mat_numeric_alloc(list, index, mat, matvar, &type, &len, &buf))
+        return 1;
+
+    return read_mat_numeric_data(mat, matvar, type, 0, len, len, buf);
 }
 
-/** @brief Read structure array with empty fields
+/** @brief Compressed variables to read in parallel
  *
+ * The R vectors are allocated when the variables are found, the data
+ * is read when the whole file is scanned, see read_mat_deferred.
+ */
+struct read_mat_deferred_t {
+    size_t n;
+    size_t size;
+    matvar_t **matvars;
+    void **data;
+    enum matio_classes *class_types;
+};
+
+/** @brief Defer the read of a compressed real numeric or logical variable
  *
+ * Allocate the R vector of the variable and keep the variable to
+ * read its data later, together with the other deferred variables.
  * @ingroup rmatio
+ * @param deferred The deferred variables
  * @param list The list to hold the read data
  * @param index The position in the list where to store the read data
- * @param matvar MAT variable pointer
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo. The
+ * variable is owned by deferred on success.
  * @return 0 on succes or 1 on failure.
  */
 static int
-read_structure_array_with_empty_fields(SEXP list,
-                                       int index,
-                                       matvar_t *matvar)
+read_mat_defer(struct read_mat_deferred_t *deferred,
+               SEXP list,
+               int index,
+               mat_t *mat,
+               matvar_t *matvar)
 {
-    SEXP names;
-    SEXP struc;
-    char * const * field_names;
-    int err = 0;
+    SEXPTYPE type;
+    size_t len;
+    void *buf;
 
-    if (NULL == matvar
-        || matvar->class_type != MAT_C_STRUCT
-        || 2 != matvar->rank
-        || 1 != matvar->dims[0]
-        || 1 > matvar->dims[1])
+    if (read_mat_numeric_alloc(list, index, mat, matvar, &type, &len, &buf))
         return 1;
 
-    field_names = Mat_VarGetStructFieldnames(matvar);
-    PROTECT(struc = Rf_allocVector(VECSXP, matvar->dims[1]));
-    PROTECT(names = Rf_allocVector(STRSXP, matvar->dims[1]));
+    /* The arrays are allocated with R_alloc and released by R */
+    if (deferred->n == deferred->size) {
+        size_t size = deferred->size ? 2 * deferred->size : 16;
+        matvar_t **matvars = (matvar_t**)R_alloc(size, sizeof(matvar_t*));
+        void **data = (void**)R_alloc(size, sizeof(void*));
+        enum matio_classes *class_types =
+            (enum matio_classes*)R_alloc(size, sizeof(enum matio_classes));
+
+        if (deferred->n) {
+            memcpy(matvars, deferred->matvars, deferred->n * sizeof(matvar_t*));
+            memcpy(data, deferred->data, deferred->n * sizeof(void*));
+            memcpy(class_types, deferred->class_types,
+                   deferred->n * sizeof(enum matio_classes));
+        }
 
-    for (size_t i=0;i<matvar->dims[1];i++) {
-        SEXP s;
-        matvar_t *field = NULL;
+        deferred->size = size;
+        deferred->matvars = matvars;
+        deferred->data = data;
+        deferred->class_types = class_types;
+    }
 
-        if (!field_names[i]) {
-            err = 1;
-            goto cleanup;
-        }
-        SET_STRING_ELT(names, i, Rf_mkChar(field_names[i]));
+    deferred->matvars[deferred->n] = matvar;
+    deferred->data[deferred->n] = buf;
+    deferred->class_types[deferred->n] =
+        (REALSXP == type) ? MAT_C_DOUBLE : MAT_C_INT32;
+    deferred->n++;
 
-        field = Mat_VarGetStructFieldByIndex(matvar, i, 0);
+    return 0;
+}
+
+/** @brief Read the deferred variables
+ *
+ * Inflate the deferred variables on up to 'threads' threads, straight
+ * into the R vectors, and free the variables.
+ * @ingroup rmatio
+ * @param deferred The deferred variables
+ * @param mat MAT file pointer
+ * @param threads The maximum number of threads
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_mat_deferred(struct read_mat_deferred_t *deferred,
+                  mat_t *mat,
+                  int threads)
+{
+    int err = 0;
+
+    if (deferred->n) {
+        err = Mat_VarReadDataAsParallel(mat, deferred->matvars,
+                                        deferred->data,
+                                        deferred->class_types,
+                                        deferred->n, threads);
+    }
+
+    for (size_t i = 0; i < deferred->n; i++) {
+        matvar_t *matvar = deferred->matvars[i];
+
+        if (!err && matvar->isLogical) {
+            int *buf = (int*)deferred->data[i];
+            size_t len = matvar->dims[0];
+            for (size_t j=1;j<matvar->rank;j++)
+                len *= matvar->dims[j];
+            for (size_t j=0;j<len;j++)
+                buf[j] = (0 != buf[j]);
+        }
+
+        Mat_VarFree(matvar);
+    }
+    deferred->n = 0;
+
+    return err ? 1 : 0;
+}
+
+/*
+ * -------------------------------------------------------------
+ *   Lazy vectors
+ * -------------------------------------------------------------
+ */
+
+#if defined(HAVE_ALTREP)
+
+static R_altrep_class_t lazy_real_class;
+static R_altrep_class_t lazy_integer_class;
+static R_altrep_class_t lazy_logical_class;
+
+/* The state (data1) of a lazy vector is a list with the file name,
+ * the variable name, the file offset of the variable (-1 in a v7.3
+ * MAT file), the number of elements, if the data is compressed and
+ * an external pointer to the data in a memory mapping of the file (or
+ * R_NilValue) and the number of regions read directly from the file.
+ * The data is read into data2 on first access to the data pointer or
+ * an element, unless it's available in the mapping. The chunks of a
+ * compressed v7.3 variable are inflated by HDF5, so regions of it are
+ * read without reading all the data. */
+#define LAZY_FILENAME   0
+#define LAZY_NAME       1
+#define LAZY_OFFSET     2
+#define LAZY_LENGTH     3
+#define LAZY_COMPRESSED 4
+#define LAZY_MAP        5
+#define LAZY_REGIONS    6
+
+/* Each region read directly from the file opens the file. A few
+ * regions, e.g. x[1:10], are read directly, after that the whole
+ * vector is read, e.g. when R iterates over the vector 512 elements
+ * at a time in sum(x). */
+#define LAZY_MAX_REGIONS 8
+
+/** @brief The number of elements of a lazy vector
+ *
+ *
+ * @ingroup rmatio
+ * @param x The lazy vector
+ * @return The number of elements.
+ */
+static R_xlen_t
+lazy_length(SEXP x)
+{
+    return (R_xlen_t)REAL(VECTOR_ELT(R_altrep_data1(x), LAZY_LENGTH))[0];
+}
+
+/** @brief Pointer to the data of a lazy vector in the memory mapping
+ *
+ *
+ * @ingroup rmatio
+ * @param x The lazy vector
+ * @return Pointer to the data or NULL if the data is not mapped.
+ */
+static const void*
+lazy_mapped(SEXP x)
+{
+    SEXP ptr = VECTOR_ELT(R_altrep_data1(x), LAZY_MAP);
+
+    if (Rf_isNull(ptr))
+        return NULL;
+    return R_ExternalPtrAddr(ptr);
+}
+
+/** @brief Pointer to the data of a materialized lazy vector
+ *
+ *
+ * @ingroup rmatio
+ * @param data The data (data2) of the lazy vector
+ * @return Pointer to the data.
+ */
+static void*
+lazy_dataptr(SEXP data)
+{
+    switch (TYPEOF(data)) {
+    case REALSXP:
+        return REAL(data);
+    case INTSXP:
+        return INTEGER(data);
+    default:
+        return LOGICAL(data);
+    }
+}
+
+/** @brief Seek to the variable at a file offset from an index
+ *
+ * The offsets are stored as doubles in R, that represent all file
+ * offsets up to 2^53 exactly.
+ * @ingroup rmatio
+ * @param mat MAT file pointer
+ * @param offset The offset of the variable.
+ * @return 0 on success, or -1 if the offset isn't valid or can't be
+ * seeked to on this platform, and the variable must be looked up by
+ * scanning the file.
+ */
+static int
+read_mat_seek(mat_t *mat, double offset)
+{
+    if (!R_FINITE(offset) || offset < 0 || offset > 9007199254740992.0)
+        return -1;
+    return Mat_Seek64(mat, (mat_off_t)offset);
+}
+
+/** @brief Open the MAT file of a lazy vector and read the variable info
+ *
+ * Raise an error if the file doesn't contain the variable at the
+ * offset any longer, e.g. if the file has changed since the lazy
+ * vector was created.
+ * @ingroup rmatio
+ * @param state The state (data1) of the lazy vector
+ * @param mat Pointer to the MAT file pointer
+ * @return The variable info.
+ */
+static matvar_t*
+lazy_open(SEXP state, mat_t **mat)
+{
+    matvar_t *matvar = NULL;
+    size_t nelems = 1;
+    const char *filename = CHAR(STRING_ELT(VECTOR_ELT(state, LAZY_FILENAME), 0));
+    const char *name = CHAR(STRING_ELT(VECTOR_ELT(state, LAZY_NAME), 0));
+
+    /* Look up the variable by name if it has no offset, in a
+     * version 7.3 file, or if the offset can't be seeked to */
+    *mat = Mat_Open(filename, MAT_ACC_RDONLY);
+    if (NULL != *mat
+        && !read_mat_seek(*mat, REAL(VECTOR_ELT(state, LAZY_OFFSET))[0]))
+        matvar = Mat_VarReadNextInfo(*mat);
+    else if (NULL != *mat)
+        matvar = Mat_VarReadInfo(*mat, name);
+
+    if (NULL != matvar) {
+        for (int j = 0; j < matvar->rank; j++)
+            nelems *= matvar->dims[j];
+
+        /* Check that it's still the same variable */
+        if (NULL == matvar->name
+            || 0 != strcmp(matvar->name, name)
+            || matvar->isComplex
+            || nelems != (size_t)REAL(VECTOR_ELT(state, LAZY_LENGTH))[0]) {
+            Mat_VarFree(matvar);
+            matvar = NULL;
+        }
+    }
+
+    if (NULL == matvar) {
+        if (NULL != *mat)
+            Mat_Close(*mat);
+        *mat = NULL;
+        Rf_error("Unable to read variable '%s' from '%s', the file has changed.",
+                 name, filename);
+    }
+
+    return matvar;
+}
+
+/** @brief Read the data of a lazy vector
+ *
+ * Read the data of a lazy vector and cache it in data2 of the
+ * vector, unless the data is already read.
+ * @ingroup rmatio
+ * @param x The lazy vector
+ * @return The data of the lazy vector.
+ */
+static SEXP
+lazy_materialize(SEXP x)
+{
+    SEXP data;
+    mat_t *mat = NULL;
+    matvar_t *matvar;
+    R_xlen_t len;
+    int err;
+
+    data = R_altrep_data2(x);
+    if (!Rf_isNull(data))
+        return data;
+
+    len = lazy_length(x);
+    PROTECT(data = Rf_allocVector(TYPEOF(x), len));
+    if (NULL != lazy_mapped(x)) {
+        memcpy(REAL(data), lazy_mapped(x), len * sizeof(double));
+        R_set_altrep_data2(x, data);
+        UNPROTECT(1);
+        return data;
+    }
+
+    matvar = lazy_open(R_altrep_data1(x), &mat);
+    err = read_mat_numeric_data(mat, matvar, TYPEOF(x), 0, len, len,
+                                lazy_dataptr(data));
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+    if (err) {
+        UNPROTECT(1);
+        Rf_error("Error reading MAT file");
+    }
+
+    R_set_altrep_data2(x, data);
+    UNPROTECT(1);
+
+    return data;
+}
+
+/** @brief Read a region of a lazy vector
+ *
+ * The region is copied from the data of the vector if it's read,
+ * else from the memory mapping. The first LAZY_MAX_REGIONS regions of
+ * an uncompressed vector that is not read yet are read directly from
+ * the file without reading the whole vector.
+ * @ingroup rmatio
+ * @param x The lazy vector
+ * @param i Index (0-based) of the first element to read
+ * @param n Number of elements to read
+ * @param buf The buffer to store the data
+ * @return The number of elements read.
+ */
+static R_xlen_t
+lazy_get_region(SEXP x, R_xlen_t i, R_xlen_t n, void *buf)
+{
+    SEXP data, state = R_altrep_data1(x);
+    mat_t *mat = NULL;
+    matvar_t *matvar;
+    R_xlen_t len = lazy_length(x);
+    size_t size = (REALSXP == TYPEOF(x)) ? sizeof(double) : sizeof(int);
+    int err;
+
+    if (i < 0 || i >= len || n <= 0)
+        return 0;
+    if (n > len - i)
+        n = len - i;
+
+    /* The data may have been changed through the data pointer */
+    data = R_altrep_data2(x);
+    if (!Rf_isNull(data)) {
+        memcpy(buf, (char*)lazy_dataptr(data) + i * size, n * size);
+        return n;
+    }
+
+    if (NULL != lazy_mapped(x)) {
+        memcpy(buf, (const double*)lazy_mapped(x) + i, n * sizeof(double));
+        return n;
+    }
+
+    if (!LOGICAL(VECTOR_ELT(state, LAZY_COMPRESSED))[0]
+        && INTEGER(VECTOR_ELT(state, LAZY_REGIONS))[0] < LAZY_MAX_REGIONS) {
+        INTEGER(VECTOR_ELT(state, LAZY_REGIONS))[0]++;
+        matvar = lazy_open(state, &mat);
+        err = read_mat_numeric_data(mat, matvar, TYPEOF(x), i, n, len, buf);
+        Mat_VarFree(matvar);
+        Mat_Close(mat);
+        if (err)
+            Rf_error("Error reading MAT file");
+        return n;
+    }
+
+    data = lazy_materialize(x);
+    memcpy(buf, (char*)lazy_dataptr(data) + i * size, n * size);
+
+    return n;
+}
+
+static R_xlen_t
+lazy_real_get_region(SEXP x, R_xlen_t i, R_xlen_t n, double *buf)
+{
+    return lazy_get_region(x, i, n, buf);
+}
+
+static R_xlen_t
+lazy_integer_get_region(SEXP x, R_xlen_t i, R_xlen_t n, int *buf)
+{
+    return lazy_get_region(x, i, n, buf);
+}
+
+static double
+lazy_real_elt(SEXP x, R_xlen_t i)
+{
+    if (Rf_isNull(R_altrep_data2(x)) && NULL != lazy_mapped(x))
+        return ((const double*)lazy_mapped(x))[i];
+    return REAL(lazy_materialize(x))[i];
+}
+
+static int
+lazy_integer_elt(SEXP x, R_xlen_t i)
+{
+    return INTEGER(lazy_materialize(x))[i];
+}
+
+static int
+lazy_logical_elt(SEXP x, R_xlen_t i)
+{
+    return LOGICAL(lazy_materialize(x))[i];
+}
+
+static void*
+lazy_dataptr_method(SEXP x, Rboolean writeable)
+{
+    /* The mapping is read only, copy the data if it can be written.
+     * Once copied, the copy is used for all access, as it may have
+     * been changed. */
+    if (!Rf_isNull(R_altrep_data2(x)))
+        return lazy_dataptr(R_altrep_data2(x));
+    if (!writeable && NULL != lazy_mapped(x))
+        return (void*)lazy_mapped(x);
+    return lazy_dataptr(lazy_materialize(x));
+}
+
+static const void*
+lazy_dataptr_or_null(SEXP x)
+{
+    SEXP data = R_altrep_data2(x);
+
+    if (Rf_isNull(data))
+        return lazy_mapped(x);
+    return lazy_dataptr(data);
+}
+
+static Rboolean
+lazy_inspect(SEXP x,
+             int pre,
+             int deep,
+             int pvec,
+             void (*inspect_subtree)(SEXP, int, int, int))
+{
+    SEXP state = R_altrep_data1(x);
+
+    Rprintf(" rmatio lazy vector '%s' at offset %.0f in '%s'%s\n",
+            CHAR(STRING_ELT(VECTOR_ELT(state, LAZY_NAME), 0)),
+            REAL(VECTOR_ELT(state, LAZY_OFFSET))[0],
+            CHAR(STRING_ELT(VECTOR_ELT(state, LAZY_FILENAME), 0)),
+            !Rf_isNull(R_altrep_data2(x)) ? " (read)" :
+            NULL != lazy_mapped(x) ? " (mapped)" : "");
+
+    return TRUE;
+}
+
+/** @brief Set the methods common to all lazy vector classes
+ *
+ *
+ * @ingroup rmatio
+ * @param cls The ALTREP class
+ */
+static void
+lazy_init_class(R_altrep_class_t cls)
+{
+    R_set_altrep_Length_method(cls, lazy_length);
+    R_set_altrep_Inspect_method(cls, lazy_inspect);
+    R_set_altvec_Dataptr_method(cls, lazy_dataptr_method);
+    R_set_altvec_Dataptr_or_null_method(cls, lazy_dataptr_or_null);
+}
+
+/** @brief Register the lazy vector classes
+ *
+ *
+ * @ingroup rmatio
+ * @param info The DLL info
+ */
+static void
+lazy_init(DllInfo *info)
+{
+    lazy_real_class = R_make_altreal_class("lazy_real", "rmatio", info);
+    lazy_init_class(lazy_real_class);
+    R_set_altreal_Elt_method(lazy_real_class, lazy_real_elt);
+    R_set_altreal_Get_region_method(lazy_real_class, lazy_real_get_region);
+
+    lazy_integer_class = R_make_altinteger_class("lazy_integer", "rmatio", info);
+    lazy_init_class(lazy_integer_class);
+    R_set_altinteger_Elt_method(lazy_integer_class, lazy_integer_elt);
+    R_set_altinteger_Get_region_method(lazy_integer_class, lazy_integer_get_region);
+
+    lazy_logical_class = R_make_altlogical_class("lazy_logical", "rmatio", info);
+    lazy_init_class(lazy_logical_class);
+    R_set_altlogical_Elt_method(lazy_logical_class, lazy_logical_elt);
+    R_set_altlogical_Get_region_method(lazy_logical_class, lazy_integer_get_region);
+}
+
+/** @brief Close the MAT file of a memory mapping
+ *
+ *
+ * @ingroup rmatio
+ * @param ptr External pointer to the MAT file
+ */
+static void
+lazy_map_finalizer(SEXP ptr)
+{
+    mat_t *mat = (mat_t*)R_ExternalPtrAddr(ptr);
+
+    if (NULL != mat) {
+        Mat_Close(mat);
+        R_ClearExternalPtr(ptr);
+    }
+}
+
+/** @brief Keep a MAT file opened with MAT_ACC_MMAP open for lazy vectors
+ *
+ * The file, and the memory mapping, is closed when the external
+ * pointer is garbage collected, i.e. when no lazy vector refers to
+ * the mapping any longer.
+ * @ingroup rmatio
+ * @param mat MAT file pointer
+ * @return External pointer to the MAT file.
+ */
+static SEXP
+lazy_map(mat_t *mat)
+{
+    SEXP ptr;
+
+    PROTECT(ptr = R_MakeExternalPtr(mat, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(ptr, lazy_map_finalizer, TRUE);
+    UNPROTECT(1);
+
+    return ptr;
+}
+
+/** @brief Create a lazy vector for a real numeric or logical variable
+ *
+ * The vector holds the location of the variable in the file and the
+ * data is read on first access. Variables that can't be located in
+ * the file, e.g. in a version 7.3 MAT file, are read directly. If
+ * the file is mapped into memory, an uncompressed double variable
+ * refers to its data in the mapping.
+ * @ingroup rmatio
+ * @param list The list to hold the lazy vector
+ * @param index The position in the list where to store the vector
+ * @param filename The MAT file
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadNextInfo
+ * @param map R_NilValue or the external pointer from lazy_map to
+ * the MAT file.
+ * @param mapped Incremented if the vector refers to the mapping
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_mat_lazy(SEXP list,
+              int index,
+              const SEXP filename,
+              mat_t *mat,
+              matvar_t *matvar,
+              SEXP map,
+              int *mapped)
+{
+    SEXP m, state;
+    SEXPTYPE type;
+    R_altrep_class_t cls;
+    const void *ptr;
+    long offset;
+    size_t len;
+
+    if (NULL == matvar
+        || 2 > matvar->rank
+        || NULL == matvar->dims
+        || NULL == matvar->name)
+        return 1;
+
+    type = read_mat_sexptype(mat, matvar);
+    if (NILSXP == type)
+        return 1;
+
+    len = matvar->dims[0];
+    for (size_t j=1;j<matvar->rank;j++)
+        len *= matvar->dims[j];
+
+    if (0 == len)
+        return read_mat_numeric(list, index, mat, matvar);
+    if (Mat_VarGetFilePos(matvar, &offset, NULL)) {
+        /* The variables of a v7.3 MAT file are found by name */
+        if (MAT_FT_MAT73 != Mat_GetVersion(mat))
+            return read_mat_numeric(list, index, mat, matvar);
+        offset = -1;
+    }
+
+    if (REALSXP == type)
+        cls = lazy_real_class;
+    else if (INTSXP == type)
+        cls = lazy_integer_class;
+    else
+        cls = lazy_logical_class;
+
+    PROTECT(state = Rf_allocVector(VECSXP, 7));
+    SET_VECTOR_ELT(state, LAZY_FILENAME, Rf_ScalarString(STRING_ELT(filename, 0)));
+    SET_VECTOR_ELT(state, LAZY_NAME, Rf_mkString(matvar->name));
+    SET_VECTOR_ELT(state, LAZY_OFFSET, Rf_ScalarReal(offset));
+    SET_VECTOR_ELT(state, LAZY_LENGTH, Rf_ScalarReal(len));
+    SET_VECTOR_ELT(state, LAZY_COMPRESSED,
+                   Rf_ScalarLogical(MAT_FT_MAT73 != Mat_GetVersion(mat)
+                                    && MAT_COMPRESSION_NONE != matvar->compression));
+    SET_VECTOR_ELT(state, LAZY_REGIONS, Rf_ScalarInteger(0));
+    if (!Rf_isNull(map)
+        && REALSXP == type
+        && !Mat_VarGetDataPtr(mat, matvar, &ptr)) {
+        /* The pointer protects the external pointer to the file */
+        SET_VECTOR_ELT(state, LAZY_MAP,
+                       R_MakeExternalPtr((void*)ptr, R_NilValue, map));
+        (*mapped)++;
+    }
+    PROTECT(m = R_new_altrep(cls, state, R_NilValue));
+
+    if (set_dim(m, matvar)) {
+        UNPROTECT(2);
+        return 1;
+    }
+
+    SET_VECTOR_ELT(list, index, m);
+    UNPROTECT(2);
+
+    return 0;
+}
+
+#else
+
+/* Lazy vectors requires ALTREP (R >= 3.6.0), read the data directly. */
+static SEXP
+lazy_map(mat_t *mat)
+{
+    return R_NilValue;
+}
+
+static int
+read_mat_lazy(SEXP list,
+              int index,
+              const SEXP filename,
+              mat_t *mat,
+              matvar_t *matvar,
+              SEXP map,
+              int *mapped)
+{
+    return read_mat_numeric(list, index, mat, matvar);
+}
+
+#endif
+
+/*
+ * -------------------------------------------------------------
+ *   Read structure arrays
+ * -------------------------------------------------------------
+ */
+
+/** @brief Read empty structure array
+ *
+ *
+ * @ingroup rmatio
+ * @param list The list to hold the read data
+ * @param index The position in the list where to store the read data
+ * @param matvar MAT variable pointer
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_empty_structure_array(SEXP list,
+                           int index,
+                           matvar_t *matvar)
+{
+    SEXP names;
+    SEXP struc;
+
+    if (NULL == matvar
+        || matvar->class_type != MAT_C_STRUCT
+        || 2 != matvar->rank
+        || 1 != matvar->dims[0]
+        || 1 != matvar->dims[1]
+        || Mat_VarGetNumberOfFields(matvar))
+        return 1;
+
+    PROTECT(struc = Rf_allocVector(VECSXP, 0));
+    PROTECT(names = Rf_allocVector(STRSXP, 0));
+    Rf_setAttrib(struc, R_NamesSymbol, names);
+    SET_VECTOR_ELT(list, index, struc);
+    UNPROTECT(2);
+
+    return 0;
+}
+
+/** @brief Read empty structure array with fields
+ *
+ *
+ * @ingroup rmatio
+ * @param list The list to hold the read data
+ * @param index The position in the list where to store the read data
+ * @param matvar MAT variable pointer
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_empty_structure_array_with_fields(SEXP list,
+                                       int index,
+                                       matvar_t *matvar)
+{
+    SEXP names;
+    SEXP struc;
+    size_t nfields = 0;
+    char * const * fieldnames;
+    int err = 0;
+
+    if (NULL == matvar
+        || MAT_C_STRUCT != matvar->class_type
+        || 2 != matvar->rank
+        || 0 != matvar->dims[0]
+        || 1 != matvar->dims[1])
+        return 1;
+
+    nfields = Mat_VarGetNumberOfFields(matvar);
+    if (!nfields)
+        return 1;
+
+    fieldnames = Mat_VarGetStructFieldnames(matvar);
+    PROTECT(struc = Rf_allocVector(VECSXP, nfields));
+    PROTECT(names = Rf_allocVector(STRSXP, nfields));
+
+    for (size_t i=0;i<nfields;i++) {
+        SEXP s;
+
+        if (!fieldnames[i]) {
+            err = 1;
+            goto cleanup;
+        }
+        SET_STRING_ELT(names, i, Rf_mkChar(fieldnames[i]));
+        PROTECT(s = Rf_allocVector(VECSXP, 0));
+        SET_VECTOR_ELT(struc, i, s);
+        UNPROTECT(1);
+    }
+
+    Rf_setAttrib(struc, R_NamesSymbol, names);
+    SET_VECTOR_ELT(list, index, struc);
+
+cleanup:
+    UNPROTECT(2);
+
+    return err;
+}
+
+/** @brief Read structure array with empty fields
+ *
+ *
+ * @ingroup rmatio
+ * @param list The list to hold the read data
+ * @param index The position in the list where to store the read data
+ * @param matvar MAT variable pointer
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_structure_array_with_empty_fields(SEXP list,
+                                       int index,
+                                       matvar_t *matvar)
+{
+    SEXP names;
+    SEXP struc;
+    char * const * field_names;
+    int err = 0;
+
+    if (NULL == matvar
+        || matvar->class_type != MAT_C_STRUCT
+        || 2 != matvar->rank
+        || 1 != matvar->dims[0]
+        || 1 > matvar->dims[1])
+        return 1;
+
+    field_names = Mat_VarGetStructFieldnames(matvar);
+    PROTECT(struc = Rf_allocVector(VECSXP, matvar->dims[1]));
+    PROTECT(names = Rf_allocVector(STRSXP, matvar->dims[1]));
+
+    for (size_t i=0;i<matvar->dims[1];i++) {
+        SEXP s;
+        matvar_t *field = NULL;
+
+        if (!field_names[i]) {
+            err = 1;
+            goto cleanup;
+        }
+        SET_STRING_ELT(names, i, Rf_mkChar(field_names[i]));
+
+        field = Mat_VarGetStructFieldByIndex(matvar, i, 0);
         if (NULL == field) {
             err = 1;
             goto cleanup;
         }
 
-        if (field->isComplex) {
-            PROTECT(s = Rf_allocVector(CPLXSXP, 0));
-        } else if (field->isLogical) {
-            PROTECT(s = Rf_allocVector(LGLSXP, 0));
-        } else {
-            switch (field->class_type) {
-            case MAT_C_CHAR:
-                PROTECT(s = Rf_allocVector(STRSXP, 0));
-                break;
+        if (field->isComplex) {
+            PROTECT(s = Rf_allocVector(CPLXSXP, 0));
+        } else if (field->isLogical) {
+            PROTECT(s = Rf_allocVector(LGLSXP, 0));
+        } else {
+            switch (field->class_type) {
+            case MAT_C_CHAR:
+                PROTECT(s = Rf_allocVector(STRSXP, 0));
+                break;
+
+            case MAT_C_DOUBLE:
+            case MAT_C_SINGLE:
+                PROTECT(s = Rf_allocVector(REALSXP, 0));
+                break;
+
+            case MAT_C_INT64:
+            case MAT_C_INT32:
+            case MAT_C_INT16:
+            case MAT_C_INT8:
+            case MAT_C_UINT64:
+            case MAT_C_UINT32:
+            case MAT_C_UINT16:
+            case MAT_C_UINT8:
+                PROTECT(s = Rf_allocVector(INTSXP, 0));
+                break;
+
+            default:
+                err = 1;
+                goto cleanup;
+            }
+        }
+
+        SET_VECTOR_ELT(struc, i, s);
+        UNPROTECT(1);
+    }
+
+    Rf_setAttrib(struc, R_NamesSymbol, names);
+    SET_VECTOR_ELT(list, index, struc);
+
+cleanup:
+    UNPROTECT(2);
+
+    return err;
+}
+
+/** @brief Read structure array with fields
+ *
+ *
+ * @ingroup rmatio
+ * @param list The list to hold the read data
+ * @param index The position in the list where to store the read data
+ * @param matvar MAT variable pointer
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_structure_array_with_fields(SEXP list,
+                                 int index,
+                                 matvar_t *matvar)
+{
+    SEXP names;
+    SEXP struc;
+    char * const * fieldnames;
+    size_t nfields = 0;
+    size_t fieldlen = 0;
+    int err = 0;
+    int protected = 0;
+
+    if (NULL == matvar
+        || MAT_C_STRUCT != matvar->class_type
+        || 2 != matvar->rank
+        || NULL == matvar->dims)
+        return 1;
+
+    nfields = Mat_VarGetNumberOfFields(matvar);
+    if (!nfields)
+        return 1;
+
+    /* Check that one dimension == 1 and that the other dimension >= 1 */
+    if (1 == matvar->dims[0]) {
+        if (1 > matvar->dims[1])
+            return 1;
+        fieldlen = matvar->dims[1];
+    } else if (1 == matvar->dims[1]) {
+        if (1 > matvar->dims[0])
+            return 1;
+        fieldlen = matvar->dims[0];
+    } else {
+        return 1;
+    }
+
+    fieldnames = Mat_VarGetStructFieldnames(matvar);
+    PROTECT(struc = Rf_allocVector(VECSXP, nfields));
+    protected++;
+    PROTECT(names = Rf_allocVector(STRSXP, nfields));
+    protected++;
+
+    for (size_t i=0;i<nfields;i++) {
+        SEXP s = R_NilValue;
+
+        if (fieldnames[i])
+            SET_STRING_ELT(names, i, Rf_mkChar(fieldnames[i]));
+
+        switch (Mat_VarGetStructFieldByIndex(matvar, i, 0)->class_type) {
+        case MAT_C_CHAR:
+            PROTECT(s = Rf_allocVector(STRSXP, fieldlen));
+            protected++;
+            break;
+
+        case MAT_C_CELL:
+        case MAT_C_STRUCT:
+            s = R_NilValue;
+            break;
+
+        default:
+            PROTECT(s = Rf_allocVector(VECSXP, fieldlen));
+            protected++;
+            break;
+        }
+
+        for (size_t j=0;j<fieldlen;j++) {
+            matvar_t *field = Mat_VarGetStructFieldByIndex(matvar, i, j);
+            if (NULL == field) {
+                err = 1;
+                goto cleanup;
+            }
+
+            switch (field->class_type) {
+            case MAT_C_DOUBLE:
+            case MAT_C_SINGLE:
+            case MAT_C_INT64:
+            case MAT_C_INT32:
+            case MAT_C_INT16:
+            case MAT_C_INT8:
+            case MAT_C_UINT64:
+            case MAT_C_UINT32:
+            case MAT_C_UINT16:
+            case MAT_C_UINT8:
+                if (field->isLogical)
+                    err = read_logical(s, j, field);
+                else if (field->isComplex)
+                    err = read_mat_complex(s, j, field);
+                else
+                    err = read_mat_data(s, j, field);
+                break;
+
+            case MAT_C_SPARSE:
+                err = read_sparse(s, j, field);
+                break;
+
+            case MAT_C_CHAR:
+                switch (field->data_type) {
+                case MAT_T_UINT8:
+                case MAT_T_UNKNOWN:
+                {
+                    char* buf = (char*)malloc((field->dims[1]+1)*sizeof(char));
+                    if (NULL == buf) {
+                        err = 1;
+                        goto cleanup;
+                    }
+                    for (size_t k=0;k<field->dims[1];k++)
+                        buf[k] = ((char*)field->data)[k];
+                    buf[field->dims[1]] = 0;
+                    SET_STRING_ELT(s, j, Rf_mkChar(buf));
+                    free(buf);
+                    break;
+                }
+
+                default:
+                    err = 1;
+                    goto cleanup;
+                }
+                break;
+
+            case MAT_C_CELL:
+                err = read_mat_cell(struc, i, field);
+                break;
+
+            case MAT_C_STRUCT:
+                err = read_mat_struct(struc, i, field);
+                break;
+
+            case MAT_C_EMPTY:
+                err = 0;
+                break;
+
+            case MAT_C_FUNCTION:
+            case MAT_C_OPAQUE:
+                err = 0;
+                Rf_warning("Function class type read as NULL: %s", fieldnames[i]);
+                break;
+
+            default:
+                err = 1;
+                goto cleanup;
+            }
+
+            if (err)
+                goto cleanup;
+        }
+
+        if (!Rf_isNull(s)) {
+            SET_VECTOR_ELT(struc, i, s);
+            UNPROTECT(1);
+            protected--;
+        }
+    }
+
+    Rf_setAttrib(struc, R_NamesSymbol, names);
+    SET_VECTOR_ELT(list, index, struc);
+
+cleanup:
+    if (protected)
+        UNPROTECT(protected);
+
+    return err;
+}
+
+/** @brief Read struct
+ *
+ *
+ * @ingroup rmatio
+ * @param list The list to hold the read data
+ * @param index The position in the list where to store the read data
+ * @param matvar MAT variable pointer
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_mat_struct(SEXP list,
+                int index,
+                matvar_t *matvar)
+{
+    if (NULL == matvar
+        || MAT_C_STRUCT != matvar->class_type
+        || 2 != matvar->rank
+        || NULL == matvar->dims)
+        return 1;
+
+    if (Mat_VarGetNumberOfFields(matvar)) {
+        if (matvar->dims[0] == 0 && matvar->dims[1] == 1) {
+            return read_empty_structure_array_with_fields(list,
+                                                          index,
+                                                          matvar);
+        } else if (matvar->dims[0] && matvar->dims[1]) {
+            matvar_t *field = Mat_VarGetStructFieldByIndex(matvar, 0, 0);
+            if (field == NULL)
+                return 1;
+
+            if (!field->dims[0])
+                return read_structure_array_with_empty_fields(list,
+                                                              index,
+                                                              matvar);
+            else
+                return read_structure_array_with_fields(list,
+                                                        index,
+                                                        matvar);
+        }
+    } else if (matvar->dims[0] == 1 && matvar->dims[1] == 1) {
+        return read_empty_structure_array(list, index, matvar);
+    }
+
+    return 1;
+}
+
+/*
+ * -------------------------------------------------------------
+ *   Read cell arrays
+ * -------------------------------------------------------------
+ */
+
+/** @brief Read empty cell array
+ *
+ *
+ * @ingroup rmatio
+ * @param list The list to hold the read data
+ * @param index The position in the list where to store the read data
+ * @param matvar MAT variable pointer
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_empty_cell_array(SEXP list,
+                      int index,
+                      matvar_t *matvar)
+{
+    SEXP cell;
+
+    if (NULL == matvar
+        || MAT_C_CELL != matvar->class_type
+        || MAT_T_CELL != matvar->data_type
+        || 2 != matvar->rank
+        || NULL == matvar->dims
+        || 0 != matvar->dims[0])
+        return 1;
+
+    PROTECT(cell = Rf_allocVector(VECSXP, 0));
+    SET_VECTOR_ELT(list, index, cell);
+    UNPROTECT(1);
+
+    return 0;
+}
+
+/** @brief Read cell array with empty arrays
+ *
+ *
+ * @ingroup rmatio
+ * @param list The list to hold the read data
+ * @param index The position in the list where to store the read data
+ * @param matvar MAT variable pointer
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_cell_array_with_empty_arrays(SEXP list,
+                                  int index,
+                                  matvar_t *matvar)
+{
+    SEXP cell_array;
+    char * const * fieldnames;
+    int err = 0;
+    int protected = 0;
+
+    if (NULL == matvar
+        || MAT_C_CELL != matvar->class_type
+        || MAT_T_CELL != matvar->data_type
+        || 2 != matvar->rank
+        || NULL == matvar->dims
+        || 1 != matvar->dims[0]
+        || 1 > matvar->dims[1])
+        return 1;
+
+    PROTECT(cell_array = Rf_allocVector(VECSXP, matvar->dims[1]));
+    protected++;
+
+    for (size_t i=0;i<matvar->dims[1];i++) {
+        SEXP cell_item;
+        SEXP names;
+        matvar_t *cell = Mat_VarGetCell(matvar, i);
+
+        if (cell->isComplex) {
+            PROTECT(cell_item = Rf_allocVector(CPLXSXP, 0));
+            protected++;
+        } else if (cell->isLogical) {
+            PROTECT(cell_item = Rf_allocVector(LGLSXP, 0));
+            protected++;
+        } else {
+            switch (cell->class_type) {
+            case MAT_C_CHAR:
+                PROTECT(cell_item = Rf_allocVector(STRSXP, 0));
+                protected++;
+                break;
+
+            case MAT_C_DOUBLE:
+            case MAT_C_SINGLE:
+                PROTECT(cell_item = Rf_allocVector(REALSXP, 0));
+                protected++;
+                break;
+
+            case MAT_C_INT64:
+            case MAT_C_INT32:
+            case MAT_C_INT16:
+            case MAT_C_INT8:
+            case MAT_C_UINT64:
+            case MAT_C_UINT32:
+            case MAT_C_UINT16:
+            case MAT_C_UINT8:
+                PROTECT(cell_item = Rf_allocVector(INTSXP, 0));
+                protected++;
+                break;
+
+            case MAT_C_STRUCT:
+                if (cell->dims[0] == 0 && cell->dims[1] == 1) {
+                    PROTECT(cell_item = Rf_allocVector(VECSXP,
+                                                    Mat_VarGetNumberOfFields(cell)));
+                    protected++;
+
+                    PROTECT(names = Rf_allocVector(STRSXP,
+                                                Mat_VarGetNumberOfFields(cell)));
+                    Rf_setAttrib(cell_item, R_NamesSymbol, names);
+                    UNPROTECT(1);
+
+                    fieldnames = Mat_VarGetStructFieldnames(cell);
+                    for (size_t j=0;j<Mat_VarGetNumberOfFields(cell);j++) {
+                        SEXP field_item;
+                        SET_STRING_ELT(names, j, Rf_mkChar(fieldnames[j]));
+                        PROTECT(field_item = Rf_allocVector(VECSXP, 0));
+                        SET_VECTOR_ELT(cell_item, j, field_item);
+                        UNPROTECT(1);
+                    }
+                } else if (cell->dims[0] == 1 && cell->dims[1] == 1) {
+                    PROTECT(cell_item = Rf_allocVector(VECSXP, 0));
+                    protected++;
+                    PROTECT(names = Rf_allocVector(STRSXP, 0));
+                    Rf_setAttrib(cell_item, R_NamesSymbol, names);
+                    UNPROTECT(1);
+                } else if (cell->dims[0] == 1 && cell->dims[1] > 1) {
+                    fieldnames = Mat_VarGetStructFieldnames(cell);
+                    PROTECT(cell_item = Rf_allocVector(VECSXP, cell->dims[1]));
+                    protected++;
+                    PROTECT(names = Rf_allocVector(STRSXP, cell->dims[1]));
+                    Rf_setAttrib(cell_item, R_NamesSymbol, names);
+                    UNPROTECT(1);
+
+                    for (size_t j=0;j<cell->dims[1];j++) {
+                        SEXP field_item;
+                        matvar_t *field = Mat_VarGetStructFieldByIndex(cell, j, 0);
+                        if (NULL == field) {
+                            err = 1;
+                            goto cleanup;
+                        }
+
+                        if (fieldnames[j])
+                            SET_STRING_ELT(names, j, Rf_mkChar(fieldnames[j]));
+
+                        if (field->isComplex) {
+                            PROTECT(field_item = Rf_allocVector(CPLXSXP, 0));
+                        } else if (field->isLogical) {
+                            PROTECT(field_item = Rf_allocVector(LGLSXP, 0));
+                        } else {
+                            switch (field->class_type) {
+                            case MAT_C_CHAR:
+                                PROTECT(field_item = Rf_allocVector(STRSXP, 0));
+                                break;
+
+                            case MAT_C_DOUBLE:
+                            case MAT_C_SINGLE:
+                                PROTECT(field_item = Rf_allocVector(REALSXP, 0));
+                                break;
+
+                            case MAT_C_INT64:
+                            case MAT_C_INT32:
+                            case MAT_C_INT16:
+                            case MAT_C_INT8:
+                            case MAT_C_UINT64:
+                            case MAT_C_UINT32:
+                            case MAT_C_UINT16:
+                            case MAT_C_UINT8:
+                                PROTECT(field_item = Rf_allocVector(INTSXP, 0));
+                                break;
+
+                            default:
+                                err = 1;
+                                goto cleanup;
+                            }
+                        }
 
-            case MAT_C_DOUBLE:
-            case MAT_C_SINGLE:
-                PROTECT(s = Rf_allocVector(REALSXP, 0));
+                        SET_VECTOR_ELT(cell_item, j, field_item);
+                        UNPROTECT(1);
+                    }
+                } else {
+                    err = 1;
+                    goto cleanup;
+                }
                 break;
 
-            case MAT_C_INT64:
-            case MAT_C_INT32:
-            case MAT_C_INT16:
-            case MAT_C_INT8:
-            case MAT_C_UINT64:
-            case MAT_C_UINT32:
-            case MAT_C_UINT16:
-            case MAT_C_UINT8:
-                PROTECT(s = Rf_allocVector(INTSXP, 0));
+            case MAT_C_CELL:
+                if (cell->dims[0] == 0 && cell->dims[1] == 1) {
+                    PROTECT(cell_item = Rf_allocVector(VECSXP, 0));
+                    protected++;
+                } else {
+                    err = 1;
+                    goto cleanup;
+                }
                 break;
 
             default:
@@ -2502,20 +3958,21 @@ read_structure_array_with_empty_fields(SEXP list,
             }
         }
 
-        SET_VECTOR_ELT(struc, i, s);
+        SET_VECTOR_ELT(cell_array, i, cell_item);
         UNPROTECT(1);
+        protected--;
     }
 
-    Rf_setAttrib(struc, R_NamesSymbol, names);
-    SET_VECTOR_ELT(list, index, struc);
+    SET_VECTOR_ELT(list, index, cell_array);
 
 cleanup:
-    UNPROTECT(2);
+    if (protected)
+        UNPROTECT(protected);
 
     return err;
 }
 
-/** @brief Read structure array with fields
+/** @brief Read cell array with arrays
  *
  *
  * @ingroup rmatio
@@ -2525,78 +3982,35 @@ cleanup:
  * @return 0 on succes or 1 on failure.
  */
 static int
-read_structure_array_with_fields(SEXP list,
-                                 int index,
-                                 matvar_t *matvar)
+read_cell_array_with_arrays(SEXP list,
+                            int index,
+                            matvar_t *matvar)
 {
-    SEXP names;
-    SEXP struc;
-    char * const * fieldnames;
-    size_t nfields = 0;
-    size_t fieldlen = 0;
+    SEXP cell;
     int err = 0;
     int protected = 0;
 
-    if (NULL == matvar
-        || MAT_C_STRUCT != matvar->class_type
-        || 2 != matvar->rank
-        || NULL == matvar->dims)
-        return 1;
-
-    nfields = Mat_VarGetNumberOfFields(matvar);
-    if (!nfields)
-        return 1;
-
-    /* Check that one dimension == 1 and that the other dimension >= 1 */
-    if (1 == matvar->dims[0]) {
-        if (1 > matvar->dims[1])
-            return 1;
-        fieldlen = matvar->dims[1];
-    } else if (1 == matvar->dims[1]) {
-        if (1 > matvar->dims[0])
-            return 1;
-        fieldlen = matvar->dims[0];
-    } else {
+    if (NULL == matvar || NULL == matvar->dims)
         return 1;
-    }
 
-    fieldnames = Mat_VarGetStructFieldnames(matvar);
-    PROTECT(struc = Rf_allocVector(VECSXP, nfields));
-    protected++;
-    PROTECT(names = Rf_allocVector(STRSXP, nfields));
+    PROTECT(cell = Rf_allocVector(VECSXP, matvar->dims[0]));
     protected++;
 
-    for (size_t i=0;i<nfields;i++) {
-        SEXP s = R_NilValue;
-
-        if (fieldnames[i])
-            SET_STRING_ELT(names, i, Rf_mkChar(fieldnames[i]));
-
-        switch (Mat_VarGetStructFieldByIndex(matvar, i, 0)->class_type) {
-        case MAT_C_CHAR:
-            PROTECT(s = Rf_allocVector(STRSXP, fieldlen));
-            protected++;
-            break;
-
-        case MAT_C_CELL:
-        case MAT_C_STRUCT:
-            s = R_NilValue;
-            break;
-
-        default:
-            PROTECT(s = Rf_allocVector(VECSXP, fieldlen));
+    for (size_t i=0;i<matvar->dims[0];i++) {
+        SEXP cell_row = R_NilValue;
+        if (matvar->dims[1] > 1) {
+            PROTECT(cell_row = Rf_allocVector(VECSXP, matvar->dims[1]));
             protected++;
-            break;
         }
 
-        for (size_t j=0;j<fieldlen;j++) {
-            matvar_t *field = Mat_VarGetStructFieldByIndex(matvar, i, j);
-            if (NULL == field) {
+        for (size_t j=0;j<matvar->dims[1];j++) {
+            matvar_t *mat_cell = Mat_VarGetCell(matvar, j*matvar->dims[0] + i);
+            if (NULL == mat_cell) {
                 err = 1;
                 goto cleanup;
             }
 
-            switch (field->class_type) {
+            switch (mat_cell->class_type) {
             case MAT_C_DOUBLE:
             case MAT_C_SINGLE:
             case MAT_C_INT64:
@@ -2607,78 +4021,68 @@ read_structure_array_with_fields(SEXP list,
             case MAT_C_UINT32:
             case MAT_C_UINT16:
             case MAT_C_UINT8:
-                if (field->isLogical)
-                    err = read_logical(s, j, field);
-                else if (field->isComplex)
-                    err = read_mat_complex(s, j, field);
-                else
-                    err = read_mat_data(s, j, field);
+                if (Rf_isNull(cell_row)) {
+                    if (mat_cell->isLogical)
+                        err = read_logical(cell, i, mat_cell);
+                    else if (mat_cell->isComplex)
+                        err = read_mat_complex(cell, i, mat_cell);
+                    else
+                        err = read_mat_data(cell, i, mat_cell);
+                } else {
+                    if (mat_cell->isLogical)
+                        err = read_logical(cell_row, j, mat_cell);
+                    else if (mat_cell->isComplex)
+                        err = read_mat_complex(cell_row, j, mat_cell);
+                    else
+                        err = read_mat_data(cell_row, j, mat_cell);
+                }
                 break;
 
             case MAT_C_SPARSE:
-                err = read_sparse(s, j, field);
+                if (Rf_isNull(cell_row))
+                    err = read_sparse(cell, i, mat_cell);
+                else
+                    err = read_sparse(cell_row, j, mat_cell);
                 break;
 
             case MAT_C_CHAR:
-                switch (field->data_type) {
-                case MAT_T_UINT8:
-                case MAT_T_UNKNOWN:
-                {
-                    char* buf = (char*)malloc((field->dims[1]+1)*sizeof(char));
-                    if (NULL == buf) {
-                        err = 1;
-                        goto cleanup;
-                    }
-                    for (size_t k=0;k<field->dims[1];k++)
-                        buf[k] = ((char*)field->data)[k];
-                    buf[field->dims[1]] = 0;
-                    SET_STRING_ELT(s, j, Rf_mkChar(buf));
-                    free(buf);
-                    break;
-                }
-
-                default:
-                    err = 1;
-                    goto cleanup;
-                }
-                break;
-
-            case MAT_C_CELL:
-                err = read_mat_cell(struc, i, field);
+                if (Rf_isNull(cell_row))
+                    err = read_mat_char(cell, i, mat_cell);
+                else
+                    err = read_mat_char(cell_row, j, mat_cell);
                 break;
 
             case MAT_C_STRUCT:
-                err = read_mat_struct(struc, i, field);
-                break;
-
-            case MAT_C_EMPTY:
-                err = 0;
+                if (Rf_isNull(cell_row))
+                    err = read_mat_struct(cell, i, mat_cell);
+                else
+                    err = read_mat_struct(cell_row, j, mat_cell);
                 break;
 
-            case MAT_C_FUNCTION:
-            case MAT_C_OPAQUE:
-                err = 0;
-                Rf_warning("Function class type read as NULL: %s", fieldnames[i]);
+            case MAT_C_CELL:
+                if (Rf_isNull(cell_row))
+                    err = read_mat_cell(cell, i, mat_cell);
+                else
+                    err = read_mat_cell(cell_row, j, mat_cell);
                 break;
 
             default:
                 err = 1;
-                goto cleanup;
+                break;
             }
 
             if (err)
                 goto cleanup;
         }
 
-        if (!Rf_isNull(s)) {
-            SET_VECTOR_ELT(struc, i, s);
+        if (!Rf_isNull(cell_row)) {
+            SET_VECTOR_ELT(cell, i, cell_row);
             UNPROTECT(1);
             protected--;
         }
     }
 
-    Rf_setAttrib(struc, R_NamesSymbol, names);
-    SET_VECTOR_ELT(list, index, struc);
+    SET_VECTOR_ELT(list, index, cell);
 
 cleanup:
     if (protected)
@@ -2687,7 +4091,7 @@ cleanup:
     return err;
 }
 
-/** @brief Read struct
+/** @brief Read cell
  *
  *
  * @ingroup rmatio
@@ -2697,37 +4101,41 @@ cleanup:
  * @return 0 on succes or 1 on failure.
  */
 static int
-read_mat_struct(SEXP list,
-                int index,
-                matvar_t *matvar)
+read_mat_cell(SEXP list,
+              int index,
+              matvar_t *matvar)
 {
     if (NULL == matvar
-        || MAT_C_STRUCT != matvar->class_type
-        || 2 != matvar->rank
+        || MAT_C_CELL != matvar->class_type
+        || MAT_T_CELL != matvar->data_type
         || NULL == matvar->dims)
         return 1;
 
-    if (Mat_VarGetNumberOfFields(matvar)) {
-        if (matvar->dims[0] == 0 && matvar->dims[1] == 1) {
-            return read_empty_structure_array_with_fields(list,
-                                                          index,
-                                                          matvar);
-        } else if (matvar->dims[0] && matvar->dims[1]) {
-            matvar_t *field = Mat_VarGetStructFieldByIndex(matvar, 0, 0);
-            if (field == NULL)
-                return 1;
+    if (0 == matvar->dims[0]) {
+        return read_empty_cell_array(list, index, matvar);
+    } else if (matvar->dims[0] && matvar->dims[1]) {
+        matvar_t *cell = Mat_VarGetCell(matvar, 0);
 
-            if (!field->dims[0])
-                return read_structure_array_with_empty_fields(list,
-                                                              index,
-                                                              matvar);
+        if (NULL == cell || NULL == cell->dims)
+            return 1;
+
+        if (MAT_C_CELL == cell->class_type
+            && 0 == cell->dims[0]
+            && 1 == cell->dims[1]) {
+            return read_cell_array_with_empty_arrays(list, index, matvar);
+        } else if (MAT_C_STRUCT == cell->class_type
+                   && 1 == cell->dims[0]
+                   && 1 == cell->dims[1]) {
+
+            if(Mat_VarGetNumberOfFields(cell))
+                return read_cell_array_with_arrays(list, index, matvar);
             else
-                return read_structure_array_with_fields(list,
-                                                        index,
-                                                        matvar);
+                return read_cell_array_with_empty_arrays(list, index, matvar);
+        } else if (cell->dims[0] && cell->dims[1]) {
+            return read_cell_array_with_arrays(list, index, matvar);
+        } else {
+            return read_cell_array_with_empty_arrays(list, index, matvar);
         }
-    } else if (matvar->dims[0] == 1 && matvar->dims[1] == 1) {
-        return read_empty_structure_array(list, index, matvar);
     }
 
     return 1;
@@ -2735,545 +4143,974 @@ read_mat_struct(SEXP list,
 
 /*
  * -------------------------------------------------------------
- *   Read cell arrays
+ *   Functions to interface R
  * -------------------------------------------------------------
  */
 
-/** @brief Read empty cell array
+/** @brief The selection of the variables to read
  *
+ * A function that selects the variables is called from the matio
+ * predicate. If it raises an error, or R jumps out of it for another
+ * reason, the jump is caught to stop the scan and close the file, and
+ * is continued by read_mat.
+ */
+struct read_mat_select_t {
+    SEXP select;
+    const char *name;
+    int selected;
+    int jumped;
+    SEXP cont;
+    jmp_buf jmpbuf;
+};
+
+/** @brief Call the function that selects the variables
  *
  * @ingroup rmatio
- * @param list The list to hold the read data
- * @param index The position in the list where to store the read data
- * @param matvar MAT variable pointer
- * @return 0 on succes or 1 on failure.
+ * @param data The selection, with the name of the variable.
  */
-static int
-read_empty_cell_array(SEXP list,
-                      int index,
-                      matvar_t *matvar)
+static void
+read_mat_select_call(void *data)
 {
-    SEXP cell;
+    struct read_mat_select_t *sel = (struct read_mat_select_t*)data;
+    SEXP arg, call;
 
-    if (NULL == matvar
-        || MAT_C_CELL != matvar->class_type
-        || MAT_T_CELL != matvar->data_type
-        || 2 != matvar->rank
-        || NULL == matvar->dims
-        || 0 != matvar->dims[0])
-        return 1;
+    PROTECT(arg = Rf_mkString(sel->name));
+    PROTECT(call = Rf_lang2(sel->select, arg));
+    sel->selected = Rf_asLogical(Rf_eval(call, R_GlobalEnv)) == 1;
+    UNPROTECT(2);
+}
 
-    PROTECT(cell = Rf_allocVector(VECSXP, 0));
-    SET_VECTOR_ELT(list, index, cell);
-    UNPROTECT(1);
+#ifdef HAVE_UNWIND_PROTECT
+static SEXP
+read_mat_select_protected(void *data)
+{
+    read_mat_select_call(data);
+    return R_NilValue;
+}
 
-    return 0;
+static void
+read_mat_select_unwind(void *data, Rboolean jump)
+{
+    if (jump)
+        longjmp(((struct read_mat_select_t*)data)->jmpbuf, 1);
 }
+#endif
 
-/** @brief Read cell array with empty arrays
- *
+/** @brief Check if a variable is selected to be read
  *
+ * Predicate passed to matio to skip variables that are not selected
+ * without reading their data. A jump out of the function that
+ * selects the variables doesn't unwind through matio, it stops the
+ * scan instead, and read_mat continues the jump when the file is
+ * closed.
  * @ingroup rmatio
- * @param list The list to hold the read data
- * @param index The position in the list where to store the read data
- * @param matvar MAT variable pointer
- * @return 0 on succes or 1 on failure.
+ * @param name The name of the variable, may be NULL
+ * @param user_data The selection, either a character vector with the
+ * names to read or a function that is called with the name and
+ * returns TRUE if the variable should be read.
+ * @return 1 if the variable is selected, 0 if not, and -1 to stop
+ * the scan after a jump.
  */
 static int
-read_cell_array_with_empty_arrays(SEXP list,
-                                  int index,
-                                  matvar_t *matvar)
+read_mat_select(const char *name, const void *user_data)
 {
-    SEXP cell_array;
-    char * const * fieldnames;
-    int err = 0;
-    int protected = 0;
+    struct read_mat_select_t *sel = (struct read_mat_select_t*)user_data;
 
-    if (NULL == matvar
-        || MAT_C_CELL != matvar->class_type
-        || MAT_T_CELL != matvar->data_type
-        || 2 != matvar->rank
-        || NULL == matvar->dims
-        || 1 != matvar->dims[0]
-        || 1 > matvar->dims[1])
-        return 1;
+    if (sel->jumped)
+        return -1;
+    if (NULL == name)
+        return 0;
 
-    PROTECT(cell_array = Rf_allocVector(VECSXP, matvar->dims[1]));
-    protected++;
+    if (Rf_isString(sel->select)) {
+        for (R_xlen_t i = 0; i < XLENGTH(sel->select); i++) {
+            if (strcmp(CHAR(STRING_ELT(sel->select, i)), name) == 0)
+                return 1;
+        }
 
-    for (size_t i=0;i<matvar->dims[1];i++) {
-        SEXP cell_item;
-        SEXP names;
-        matvar_t *cell = Mat_VarGetCell(matvar, i);
+        return 0;
+    }
 
-        if (cell->isComplex) {
-            PROTECT(cell_item = Rf_allocVector(CPLXSXP, 0));
-            protected++;
-        } else if (cell->isLogical) {
-            PROTECT(cell_item = Rf_allocVector(LGLSXP, 0));
-            protected++;
-        } else {
-            switch (cell->class_type) {
-            case MAT_C_CHAR:
-                PROTECT(cell_item = Rf_allocVector(STRSXP, 0));
-                protected++;
-                break;
+    sel->name = name;
+#ifdef HAVE_UNWIND_PROTECT
+    if (setjmp(sel->jmpbuf)) {
+        sel->jumped = 1;
+        return -1;
+    }
+    R_UnwindProtect(read_mat_select_protected, sel,
+                    read_mat_select_unwind, sel, sel->cont);
+#else
+    if (!R_ToplevelExec(read_mat_select_call, sel)) {
+        sel->jumped = 1;
+        return -1;
+    }
+#endif
 
-            case MAT_C_DOUBLE:
-            case MAT_C_SINGLE:
-                PROTECT(cell_item = Rf_allocVector(REALSXP, 0));
-                protected++;
-                break;
+    return sel->selected;
+}
 
-            case MAT_C_INT64:
-            case MAT_C_INT32:
-            case MAT_C_INT16:
-            case MAT_C_INT8:
-            case MAT_C_UINT64:
-            case MAT_C_UINT32:
-            case MAT_C_UINT16:
-            case MAT_C_UINT8:
-                PROTECT(cell_item = Rf_allocVector(INTSXP, 0));
-                protected++;
-                break;
+/** @brief Read the next variable
+ *
+ *
+ * @ingroup rmatio
+ * @param mat MAT file pointer
+ * @param sel The variables to read, see read_mat.
+ * @param offsets The file offsets of the variables to read, see
+ * read_mat.
+ * @param i The index of the variable to read.
+ * @return The variable info or NULL when there are no more variables
+ * to read. The data is not read.
+ */
+static matvar_t*
+read_mat_next(mat_t *mat, struct read_mat_select_t *sel,
+              const SEXP offsets, int i)
+{
+    if (!Rf_isNull(offsets)) {
+        /* Seek directly to the variable, read.mat scans the file if
+         * it can't */
+        if (i >= LENGTH(offsets) || read_mat_seek(mat, REAL(offsets)[i]))
+            return NULL;
+        return Mat_VarReadNextInfo(mat);
+    }
 
-            case MAT_C_STRUCT:
-                if (cell->dims[0] == 0 && cell->dims[1] == 1) {
-                    PROTECT(cell_item = Rf_allocVector(VECSXP,
-                                                    Mat_VarGetNumberOfFields(cell)));
-                    protected++;
+    return Mat_VarReadNextInfoPredicate(
+        mat, Rf_isNull(sel->select) ? NULL : read_mat_select, sel);
+}
 
-                    PROTECT(names = Rf_allocVector(STRSXP,
-                                                Mat_VarGetNumberOfFields(cell)));
-                    Rf_setAttrib(cell_item, R_NamesSymbol, names);
-                    UNPROTECT(1);
+/** @brief Read matlab file
+ *
+ *
+ * @ingroup rmatio
+ * @param filename The file to read
+ * @param select R_NilValue to read all variables, a character vector
+ * with the names of the variables to read or a function that is
+ * called with the name of each variable and returns TRUE if the
+ * variable should be read.
+ * @param offsets R_NilValue or a numeric vector with the file offsets
+ * of the variables to read, e.g. from an index of the file. If given,
+ * 'select' is ignored.
+ * @param lazy If TRUE, real numeric and logical variables are
+ * returned as lazy vectors that are read from the file on first
+ * access.
+ * @param mmap If TRUE, map the file into memory. Uncompressed double
+ * variables are copied from the mapping, or with 'lazy', refer to
+ * the data in the mapping.
+ * @param threads The number of threads to inflate compressed real
+ * numeric and logical variables. With more than one thread, the
+ * variables are inflated in parallel after the file is scanned.
+ * @return a named list (VECSXP).
+ */
+SEXP read_mat(const SEXP filename,
+              const SEXP select,
+              const SEXP offsets,
+              const SEXP lazy,
+              const SEXP mmap,
+              const SEXP threads)
+{
+    mat_t *mat = NULL;
+    matvar_t *matvar = NULL;
+    int i = 0, n = 0, err = 0, mode = MAT_ACC_RDONLY, mapped = 0;
+    SEXP list, names, map = R_NilValue;
+    PROTECT_INDEX list_idx, names_idx;
+    struct read_mat_deferred_t deferred = {0, 0, NULL, NULL, NULL};
+    struct read_mat_select_t sel;
 
-                    fieldnames = Mat_VarGetStructFieldnames(cell);
-                    for (size_t j=0;j<Mat_VarGetNumberOfFields(cell);j++) {
-                        SEXP field_item;
-                        SET_STRING_ELT(names, j, Rf_mkChar(fieldnames[j]));
-                        PROTECT(field_item = Rf_allocVector(VECSXP, 0));
-                        SET_VECTOR_ELT(cell_item, j, field_item);
-                        UNPROTECT(1);
-                    }
-                } else if (cell->dims[0] == 1 && cell->dims[1] == 1) {
-                    PROTECT(cell_item = Rf_allocVector(VECSXP, 0));
-                    protected++;
-                    PROTECT(names = Rf_allocVector(STRSXP, 0));
-                    Rf_setAttrib(cell_item, R_NamesSymbol, names);
-                    UNPROTECT(1);
-                } else if (cell->dims[0] == 1 && cell->dims[1] > 1) {
-                    fieldnames = Mat_VarGetStructFieldnames(cell);
-                    PROTECT(cell_item = Rf_allocVector(VECSXP, cell->dims[1]));
-                    protected++;
-                    PROTECT(names = Rf_allocVector(STRSXP, cell->dims[1]));
-                    Rf_setAttrib(cell_item, R_NamesSymbol, names);
-                    UNPROTECT(1);
+    const char err_reading_mat_file[] = "Error reading MAT file";
+    const char err_mat_c_empty[] = "Not implemented support to read matio class type MAT_C_EMPTY";
+    const char err_mat_c_object[] = "Not implemented support to read matio class type MAT_C_OBJECT";
+    const char *err_msg = NULL;
 
-                    for (size_t j=0;j<cell->dims[1];j++) {
-                        SEXP field_item;
-                        matvar_t *field = Mat_VarGetStructFieldByIndex(cell, j, 0);
-                        if (NULL == field) {
-                            err = 1;
-                            goto cleanup;
-                        }
+    if (Rf_isNull(filename))
+        Rf_error("'filename' equals R_NilValue.");
+    if (!Rf_isString(filename))
+        Rf_error("'filename' must be a string.");
+    if (!Rf_isNull(select) && !Rf_isString(select) && !Rf_isFunction(select))
+        Rf_error("'select' must be a character vector or a function.");
+    if (!Rf_isNull(offsets) && !Rf_isReal(offsets))
+        Rf_error("'offsets' must be a numeric vector.");
+    if (!Rf_isLogical(lazy) || 1 != LENGTH(lazy))
+        Rf_error("'lazy' must be TRUE or FALSE.");
+    if (!Rf_isLogical(mmap) || 1 != LENGTH(mmap))
+        Rf_error("'mmap' must be TRUE or FALSE.");
+    if (!Rf_isInteger(threads) || 1 != LENGTH(threads)
+        || INTEGER(threads)[0] == NA_INTEGER || INTEGER(threads)[0] < 1)
+        Rf_error("'threads' must be a positive integer.");
+
+    sel.select = select;
+    sel.name = NULL;
+    sel.selected = 0;
+    sel.jumped = 0;
+    sel.cont = R_NilValue;
+#ifdef HAVE_UNWIND_PROTECT
+    if (Rf_isFunction(select))
+        sel.cont = R_MakeUnwindCont();
+#endif
+    PROTECT(sel.cont);
+
+    if (LOGICAL(mmap)[0] == TRUE)
+        mode |= MAT_ACC_MMAP;
+    mat = Mat_Open(CHAR(STRING_ELT(filename, 0)), mode);
+    if (!mat)
+        Rf_error("Unable to open file.");
 
-                        if (fieldnames[j])
-                            SET_STRING_ELT(names, j, Rf_mkChar(fieldnames[j]));
+    /* The lazy vectors that refer to the mapping keep the file
+     * open. */
+    if (LOGICAL(lazy)[0] == TRUE && LOGICAL(mmap)[0] == TRUE)
+        map = lazy_map(mat);
+    PROTECT(map);
+
+    /* Read the file in one pass and grow the list when needed. When
+     * the variables are selected by name or offset, the number of
+     * variables is known in advance and the read stops when all are
+     * found. */
+    if (!Rf_isNull(offsets))
+        n = LENGTH(offsets);
+    else if (Rf_isString(select))
+        n = LENGTH(select);
+    else
+        n = 16;
+    PROTECT_WITH_INDEX(list = Rf_allocVector(VECSXP, n), &list_idx);
+    PROTECT_WITH_INDEX(names = Rf_allocVector(STRSXP, n), &names_idx);
+
+    while ((!Rf_isString(select) || i < n) &&
+           (matvar = read_mat_next(mat, &sel, offsets, i)) != NULL) {
+        if (i == n) {
+            n *= 2;
+            REPROTECT(list = Rf_lengthgets(list, n), list_idx);
+            REPROTECT(names = Rf_lengthgets(names, n), names_idx);
+        }
 
-                        if (field->isComplex) {
-                            PROTECT(field_item = Rf_allocVector(CPLXSXP, 0));
-                        } else if (field->isLogical) {
-                            PROTECT(field_item = Rf_allocVector(LGLSXP, 0));
-                        } else {
-                            switch (field->class_type) {
-                            case MAT_C_CHAR:
-                                PROTECT(field_item = Rf_allocVector(STRSXP, 0));
-                                break;
+        if (matvar->name != NULL)
+            SET_STRING_ELT(names, i, Rf_mkChar(matvar->name));
 
-                            case MAT_C_DOUBLE:
-                            case MAT_C_SINGLE:
-                                PROTECT(field_item = Rf_allocVector(REALSXP, 0));
-                                break;
+        switch (matvar->class_type) {
+        case MAT_C_EMPTY:
+            err = 1;
+            err_msg = err_mat_c_empty;
+            goto cleanup;
 
-                            case MAT_C_INT64:
-                            case MAT_C_INT32:
-                            case MAT_C_INT16:
-                            case MAT_C_INT8:
-                            case MAT_C_UINT64:
-                            case MAT_C_UINT32:
-                            case MAT_C_UINT16:
-                            case MAT_C_UINT8:
-                                PROTECT(field_item = Rf_allocVector(INTSXP, 0));
-                                break;
+        case MAT_C_CELL:
+            Mat_VarReadDataAll(mat, matvar);
+            err = read_mat_cell(list, i, matvar);
+            break;
 
-                            default:
-                                err = 1;
-                                goto cleanup;
-                            }
-                        }
+        case MAT_C_STRUCT:
+            Mat_VarReadDataAll(mat, matvar);
+            err = read_mat_struct(list, i, matvar);
+            break;
 
-                        SET_VECTOR_ELT(cell_item, j, field_item);
-                        UNPROTECT(1);
-                    }
-                } else {
-                    err = 1;
-                    goto cleanup;
-                }
-                break;
+        case MAT_C_OBJECT:
+            err = 1;
+            err_msg = err_mat_c_object;
+            goto cleanup;
+
+        case MAT_C_CHAR:
+            Mat_VarReadDataAll(mat, matvar);
+            err = read_mat_char(list, i, matvar);
+            break;
+
+        case MAT_C_SPARSE:
+            Mat_VarReadDataAll(mat, matvar);
+            err = read_sparse(list, i, matvar);
+            break;
+
+        case MAT_C_DOUBLE:
+        case MAT_C_SINGLE:
+        case MAT_C_INT64:
+        case MAT_C_INT32:
+        case MAT_C_INT16:
+        case MAT_C_INT8:
+        case MAT_C_UINT64:
+        case MAT_C_UINT32:
+        case MAT_C_UINT16:
+        case MAT_C_UINT8:
+            /* Decode real data directly into the R vector, complex
+             * data is split in real and imaginary parts by matio and
+             * must be interleaved. */
+            if (matvar->isComplex) {
+                Mat_VarReadDataAll(mat, matvar);
+                err = read_mat_complex(list, i, matvar);
+            } else if (LOGICAL(lazy)[0] == TRUE) {
+                err = read_mat_lazy(list, i, filename, mat, matvar,
+                                    map, &mapped);
+            } else if (INTEGER(threads)[0] > 1
+                       && MAT_COMPRESSION_ZLIB == matvar->compression) {
+                err = read_mat_defer(&deferred, list, i, mat, matvar);
+                if (!err)
+                    matvar = NULL;
+            } else {
+                err = read_mat_numeric(list, i, mat, matvar);
+            }
+            break;
+
+        case MAT_C_FUNCTION:
+        case MAT_C_OPAQUE:
+            err = 0;
+            Rf_warning("Function class type read as NULL: %s",
+                       matvar->name == NULL ? "" : matvar->name);
+            break;
 
-            case MAT_C_CELL:
-                if (cell->dims[0] == 0 && cell->dims[1] == 1) {
-                    PROTECT(cell_item = Rf_allocVector(VECSXP, 0));
-                    protected++;
-                } else {
-                    err = 1;
-                    goto cleanup;
-                }
-                break;
+        default:
+            err = 1;
+            break;
+        }
 
-            default:
-                err = 1;
-                goto cleanup;
-            }
+        if (err) {
+            err_msg = err_reading_mat_file;
+            goto cleanup;
         }
 
-        SET_VECTOR_ELT(cell_array, i, cell_item);
-        UNPROTECT(1);
-        protected--;
+        Mat_VarFree(matvar);
+        matvar = NULL;
+        i++;
     }
 
-    SET_VECTOR_ELT(list, index, cell_array);
+    if (sel.jumped) {
+        err = 1;
+        goto cleanup;
+    }
+
+    if (read_mat_deferred(&deferred, mat, INTEGER(threads)[0])) {
+        err = 1;
+        err_msg = err_reading_mat_file;
+        goto cleanup;
+    }
+
+    if (i < n) {
+        REPROTECT(list = Rf_lengthgets(list, i), list_idx);
+        REPROTECT(names = Rf_lengthgets(names, i), names_idx);
+    }
+
+    Rf_setAttrib(list, R_NamesSymbol, names);
 
 cleanup:
-    if (protected)
-        UNPROTECT(protected);
+    if (matvar)
+        Mat_VarFree(matvar);
+    for (size_t j = 0; j < deferred.n; j++)
+        Mat_VarFree(deferred.matvars[j]);
+    if (!Rf_isNull(map) && (err || !mapped))
+        R_ClearExternalPtr(map);
+    if (mat && (Rf_isNull(map) || R_ExternalPtrAddr(map) == NULL))
+        Mat_Close(mat);
+    UNPROTECT(4);
+    if (sel.jumped) {
+#ifdef HAVE_UNWIND_PROTECT
+        R_ContinueUnwind(sel.cont);
+#else
+        Rf_error("Error in the function that selects the variables.");
+#endif
+    }
+    if (err)
+        Rf_error(err_msg);
 
-    return err;
+    return list;
 }
 
-/** @brief Read cell array with arrays
+/** @brief Allocate the buffer for a subset of a numeric variable
  *
+ * The buffers are allocated with R_alloc and released by R, don't
+ * let Mat_VarFree free them.
+ * @ingroup rmatio
+ * @param matvar MAT variable pointer, from Mat_VarReadInfo
+ * @param len The number of elements of the subset
+ */
+static void
+read_mat_subset_alloc(matvar_t *matvar, size_t len)
+{
+    size_t nbytes = len * Mat_SizeOfClass(matvar->class_type);
+    mat_complex_split_t *complex_data;
+
+    matvar->mem_conserve = 1;
+    if (matvar->isComplex) {
+        complex_data = (mat_complex_split_t*)R_alloc(1, sizeof(mat_complex_split_t));
+        complex_data->Re = R_alloc(nbytes, 1);
+        complex_data->Im = R_alloc(nbytes, 1);
+        matvar->data = complex_data;
+    } else {
+        matvar->data = R_alloc(nbytes, 1);
+    }
+}
+
+/** @brief Convert a subset of a numeric variable to an R vector
  *
  * @ingroup rmatio
  * @param list The list to hold the read data
  * @param index The position in the list where to store the read data
- * @param matvar MAT variable pointer
+ * @param matvar MAT variable pointer with the data of the subset,
+ * read as the class type, and the dimensions of the subset.
  * @return 0 on succes or 1 on failure.
  */
 static int
-read_cell_array_with_arrays(SEXP list,
-                            int index,
-                            matvar_t *matvar)
+read_mat_subset_data(SEXP list, int index, matvar_t *matvar)
 {
-    SEXP cell;
-    int err = 0;
-    int protected = 0;
+    /* The data are read as the class type */
+    switch (matvar->class_type) {
+    case MAT_C_DOUBLE: matvar->data_type = MAT_T_DOUBLE; break;
+    case MAT_C_SINGLE: matvar->data_type = MAT_T_SINGLE; break;
+    case MAT_C_INT64:  matvar->data_type = MAT_T_INT64;  break;
+    case MAT_C_INT32:  matvar->data_type = MAT_T_INT32;  break;
+    case MAT_C_INT16:  matvar->data_type = MAT_T_INT16;  break;
+    case MAT_C_INT8:   matvar->data_type = MAT_T_INT8;   break;
+    case MAT_C_UINT64: matvar->data_type = MAT_T_UINT64; break;
+    case MAT_C_UINT32: matvar->data_type = MAT_T_UINT32; break;
+    case MAT_C_UINT16: matvar->data_type = MAT_T_UINT16; break;
+    case MAT_C_UINT8:  matvar->data_type = MAT_T_UINT8;  break;
+    default:
+        return 1;
+    }
 
-    if (NULL == matvar || NULL == matvar->dims)
+    if (matvar->isLogical)
+        return read_logical(list, index, matvar);
+    if (matvar->isComplex)
+        return read_mat_complex(list, index, matvar);
+    return read_mat_data(list, index, matvar);
+}
+
+/** @brief Read a hyperslab of a numeric variable
+ *
+ * Allocate a buffer for the subset of the variable, read the data
+ * with Mat_VarReadData and convert it to an R vector with the
+ * dimensions of the subset.
+ * @ingroup rmatio
+ * @param list The list to hold the read data
+ * @param index The position in the list where to store the read data
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadInfo. The
+ * dimensions are changed to the dimensions of the subset.
+ * @param start Index (0-based) to start reading in each dimension.
+ * @param stride Read every stride element in each dimension.
+ * @param edge Number of elements to read in each dimension.
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_mat_subset(SEXP list,
+                int index,
+                mat_t *mat,
+                matvar_t *matvar,
+                int *start,
+                int *stride,
+                int *edge)
+{
+    size_t len = 1;
+
+    for (int j = 0; j < matvar->rank; j++) {
+        if (start[j] < 0 || stride[j] < 1 || edge[j] < 1
+            || (size_t)start[j] + (size_t)stride[j] * (edge[j] - 1) >= matvar->dims[j])
+            return 1;
+        len *= edge[j];
+    }
+
+    read_mat_subset_alloc(matvar, len);
+    if (Mat_VarReadData(mat, matvar, matvar->data, start, stride, edge))
         return 1;
 
-    PROTECT(cell = Rf_allocVector(VECSXP, matvar->dims[0]));
-    protected++;
+    for (int j = 0; j < matvar->rank; j++)
+        matvar->dims[j] = edge[j];
 
-    for (size_t i=0;i<matvar->dims[0];i++) {
-        SEXP cell_row = R_NilValue;
-        if (matvar->dims[1] > 1) {
-            PROTECT(cell_row = Rf_allocVector(VECSXP, matvar->dims[1]));
-            protected++;
-        }
+    return read_mat_subset_data(list, index, matvar);
+}
 
-        for (size_t j=0;j<matvar->dims[1];j++) {
-            matvar_t *mat_cell = Mat_VarGetCell(matvar, j*matvar->dims[0] + i);
-            if (NULL == mat_cell) {
-                err = 1;
-                goto cleanup;
-            }
+/** @brief Read a range of a numeric variable using a linear index
+ *
+ * Allocate a buffer for the range of the variable, read the data
+ * with Mat_VarReadDataLinear and convert it to an R vector.
+ * @ingroup rmatio
+ * @param list The list to hold the read data
+ * @param index The position in the list where to store the read data
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer, from Mat_VarReadInfo. The
+ * dimensions are changed to the dimensions of the range.
+ * @param start Index (0-based) of the first element to read.
+ * @param stride Read every stride element.
+ * @param edge Number of elements to read.
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+read_mat_subset_linear(SEXP list,
+                       int index,
+                       mat_t *mat,
+                       matvar_t *matvar,
+                       size_t start,
+                       size_t stride,
+                       size_t edge)
+{
+    size_t nelems = 1;
 
-            switch (mat_cell->class_type) {
-            case MAT_C_DOUBLE:
-            case MAT_C_SINGLE:
-            case MAT_C_INT64:
-            case MAT_C_INT32:
-            case MAT_C_INT16:
-            case MAT_C_INT8:
-            case MAT_C_UINT64:
-            case MAT_C_UINT32:
-            case MAT_C_UINT16:
-            case MAT_C_UINT8:
-                if (Rf_isNull(cell_row)) {
-                    if (mat_cell->isLogical)
-                        err = read_logical(cell, i, mat_cell);
-                    else if (mat_cell->isComplex)
-                        err = read_mat_complex(cell, i, mat_cell);
-                    else
-                        err = read_mat_data(cell, i, mat_cell);
-                } else {
-                    if (mat_cell->isLogical)
-                        err = read_logical(cell_row, j, mat_cell);
-                    else if (mat_cell->isComplex)
-                        err = read_mat_complex(cell_row, j, mat_cell);
-                    else
-                        err = read_mat_data(cell_row, j, mat_cell);
-                }
-                break;
+    for (int j = 0; j < matvar->rank; j++)
+        nelems *= matvar->dims[j];
 
-            case MAT_C_SPARSE:
-                if (Rf_isNull(cell_row))
-                    err = read_sparse(cell, i, mat_cell);
-                else
-                    err = read_sparse(cell_row, j, mat_cell);
-                break;
+    /* The last element, start + stride * (edge - 1), must be in the
+     * variable. */
+    if (start >= nelems || stride < 1 || edge < 1
+        || (edge - 1) > (nelems - 1 - start) / stride
+        || edge > (size_t)R_XLEN_T_MAX)
+        return 1;
 
-            case MAT_C_CHAR:
-                if (Rf_isNull(cell_row))
-                    err = read_mat_char(cell, i, mat_cell);
-                else
-                    err = read_mat_char(cell_row, j, mat_cell);
-                break;
+    read_mat_subset_alloc(matvar, edge);
+    if (Mat_VarReadDataLinear(mat, matvar, matvar->data, start, stride, edge))
+        return 1;
 
-            case MAT_C_STRUCT:
-                if (Rf_isNull(cell_row))
-                    err = read_mat_struct(cell, i, mat_cell);
-                else
-                    err = read_mat_struct(cell_row, j, mat_cell);
-                break;
+    matvar->dims[0] = edge;
+    for (int j = 1; j < matvar->rank; j++)
+        matvar->dims[j] = 1;
 
-            case MAT_C_CELL:
-                if (Rf_isNull(cell_row))
-                    err = read_mat_cell(cell, i, mat_cell);
-                else
-                    err = read_mat_cell(cell_row, j, mat_cell);
-                break;
+    return read_mat_subset_data(list, index, matvar);
+}
 
-            default:
-                err = 1;
-                break;
-            }
+/** @brief Read the info of a numeric variable in a matlab file
+ *
+ * Open the file and read the info of a numeric or logical variable,
+ * raise an error if the variable doesn't exist or is not numeric.
+ * @ingroup rmatio
+ * @param filename The file to read
+ * @param name The name of the variable to read
+ * @param mat Pointer to the MAT file pointer
+ * @return The variable info.
+ */
+static matvar_t*
+read_mat_subset_info(const SEXP filename,
+                     const SEXP name,
+                     mat_t **mat)
+{
+    matvar_t *matvar;
 
-            if (err)
-                goto cleanup;
-        }
+    if (Rf_isNull(filename))
+        Rf_error("'filename' equals R_NilValue.");
+    if (!Rf_isString(filename))
+        Rf_error("'filename' must be a string.");
+    if (!Rf_isString(name) || LENGTH(name) != 1)
+        Rf_error("'name' must be a string.");
 
-        if (!Rf_isNull(cell_row)) {
-            SET_VECTOR_ELT(cell, i, cell_row);
-            UNPROTECT(1);
-            protected--;
-        }
-    }
+    *mat = Mat_Open(CHAR(STRING_ELT(filename, 0)), MAT_ACC_RDONLY);
+    if (!*mat)
+        Rf_error("Unable to open file.");
 
-    SET_VECTOR_ELT(list, index, cell);
+    matvar = Mat_VarReadInfo(*mat, CHAR(STRING_ELT(name, 0)));
+    if (!matvar) {
+        Mat_Close(*mat);
+        Rf_error("Unable to find variable '%s'.", CHAR(STRING_ELT(name, 0)));
+    }
 
-cleanup:
-    if (protected)
-        UNPROTECT(protected);
+    switch (matvar->class_type) {
+    case MAT_C_DOUBLE:
+    case MAT_C_SINGLE:
+    case MAT_C_INT64:
+    case MAT_C_INT32:
+    case MAT_C_INT16:
+    case MAT_C_INT8:
+    case MAT_C_UINT64:
+    case MAT_C_UINT32:
+    case MAT_C_UINT16:
+    case MAT_C_UINT8:
+        break;
+    default:
+        Mat_VarFree(matvar);
+        Mat_Close(*mat);
+        Rf_error("Unable to read a subset of variable '%s' "
+                 "(must be a numeric or logical array).",
+                 CHAR(STRING_ELT(name, 0)));
+    }
 
-    return err;
+    return matvar;
 }
 
-/** @brief Read cell
+/** @brief Read a hyperslab of a variable in a matlab file
  *
  *
  * @ingroup rmatio
- * @param list The list to hold the read data
- * @param index The position in the list where to store the read data
- * @param matvar MAT variable pointer
- * @return 0 on succes or 1 on failure.
+ * @param filename The file to read
+ * @param name The name of the variable to read
+ * @param start Integer vector with the index (0-based) to start
+ * reading in each dimension, or of length one to use the same value
+ * in each dimension.
+ * @param stride Integer vector with the stride in each dimension,
+ * or of length one.
+ * @param count Integer vector with the number of elements to read in
+ * each dimension, or of length one. NA reads to the end of the
+ * dimension.
+ * @return The subset of the variable.
  */
-static int
-read_mat_cell(SEXP list,
-              int index,
-              matvar_t *matvar)
+SEXP read_mat_slab(const SEXP filename,
+                   const SEXP name,
+                   const SEXP start,
+                   const SEXP stride,
+                   const SEXP count)
 {
-    if (NULL == matvar
-        || MAT_C_CELL != matvar->class_type
-        || MAT_T_CELL != matvar->data_type
-        || NULL == matvar->dims)
-        return 1;
+    mat_t *mat = NULL;
+    matvar_t *matvar = NULL;
+    int err = 0, rank, *s_start, *s_stride, *s_edge;
+    SEXP list;
 
-    if (0 == matvar->dims[0]) {
-        return read_empty_cell_array(list, index, matvar);
-    } else if (matvar->dims[0] && matvar->dims[1]) {
-        matvar_t *cell = Mat_VarGetCell(matvar, 0);
+    if (!Rf_isInteger(start) || !Rf_isInteger(stride) || !Rf_isInteger(count))
+        Rf_error("'start', 'stride' and 'count' must be integer vectors.");
 
-        if (NULL == cell || NULL == cell->dims)
-            return 1;
+    matvar = read_mat_subset_info(filename, name, &mat);
+    rank = matvar->rank;
 
-        if (MAT_C_CELL == cell->class_type
-            && 0 == cell->dims[0]
-            && 1 == cell->dims[1]) {
-            return read_cell_array_with_empty_arrays(list, index, matvar);
-        } else if (MAT_C_STRUCT == cell->class_type
-                   && 1 == cell->dims[0]
-                   && 1 == cell->dims[1]) {
+    if ((LENGTH(start) != 1 && LENGTH(start) != rank)
+        || (LENGTH(stride) != 1 && LENGTH(stride) != rank)
+        || (LENGTH(count) != 1 && LENGTH(count) != rank)) {
+        Mat_VarFree(matvar);
+        Mat_Close(mat);
+        Rf_error("'start', 'stride' and 'count' must have length 1 or %i.", rank);
+    }
 
-            if(Mat_VarGetNumberOfFields(cell))
-                return read_cell_array_with_arrays(list, index, matvar);
-            else
-                return read_cell_array_with_empty_arrays(list, index, matvar);
-        } else if (cell->dims[0] && cell->dims[1]) {
-            return read_cell_array_with_arrays(list, index, matvar);
+    s_start = (int*)R_alloc(rank, sizeof(int));
+    s_stride = (int*)R_alloc(rank, sizeof(int));
+    s_edge = (int*)R_alloc(rank, sizeof(int));
+    for (int j = 0; j < rank; j++) {
+        s_start[j] = INTEGER(start)[LENGTH(start) == 1 ? 0 : j];
+        s_stride[j] = INTEGER(stride)[LENGTH(stride) == 1 ? 0 : j];
+        s_edge[j] = INTEGER(count)[LENGTH(count) == 1 ? 0 : j];
+        if (s_edge[j] == NA_INTEGER && s_start[j] >= 0 && s_stride[j] > 0
+            && (size_t)s_start[j] < matvar->dims[j]) {
+            /* Read to the end of the dimension */
+            s_edge[j] = (matvar->dims[j] - s_start[j] + s_stride[j] - 1) / s_stride[j];
+        }
+    }
+
+    PROTECT(list = Rf_allocVector(VECSXP, 1));
+    err = read_mat_subset(list, 0, mat, matvar, s_start, s_stride, s_edge);
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+    UNPROTECT(1);
+
+    if (err)
+        Rf_error("Unable to read a subset of variable '%s' "
+                 "(check that the subset is within the dimensions).",
+                 CHAR(STRING_ELT(name, 0)));
+
+    return VECTOR_ELT(list, 0);
+}
+
+/** @brief Read a range of a variable in a matlab file
+ *
+ * Read a range of elements of a variable using a linear (1-D) index
+ * into the variable, i.e. the elements in column-major order.
+ * @ingroup rmatio
+ * @param filename The file to read
+ * @param name The name of the variable to read
+ * @param start The index (0-based) of the first element to read, a
+ * double to index variables with more than 2^31 - 1 elements. A
+ * negative value counts from the end of the variable, e.g. -10 is the
+ * tenth last element.
+ * @param stride Read every stride element (double).
+ * @param count The number of elements to read (double). NA reads to
+ * the end of the variable.
+ * @return The elements read as a vector.
+ */
+SEXP read_mat_range(const SEXP filename,
+                    const SEXP name,
+                    const SEXP start,
+                    const SEXP stride,
+                    const SEXP count)
+{
+    mat_t *mat = NULL;
+    matvar_t *matvar = NULL;
+    int err = 0;
+    double d_start, d_stride, d_count;
+    size_t nelems = 1, s_start = 0, s_stride = 0, s_edge = 0;
+    SEXP list;
+
+    if (!Rf_isReal(start) || LENGTH(start) != 1
+        || !Rf_isReal(stride) || LENGTH(stride) != 1
+        || !Rf_isReal(count) || LENGTH(count) != 1)
+        Rf_error("'start', 'stride' and 'count' must be numeric vectors of length one.");
+
+    matvar = read_mat_subset_info(filename, name, &mat);
+    for (int j = 0; j < matvar->rank; j++)
+        nelems *= matvar->dims[j];
+
+    /* Compute the range in size_t, the checks of the range are done
+     * in read_mat_subset_linear */
+    d_start = REAL(start)[0];
+    d_stride = REAL(stride)[0];
+    d_count = REAL(count)[0];
+    if (!R_FINITE(d_start) || !R_FINITE(d_stride) || d_stride < 1
+        || (!ISNAN(d_count) && (!R_FINITE(d_count) || d_count < 1))
+        || d_start >= (double)nelems || -d_start > (double)nelems
+        || d_stride > (double)nelems
+        || (!ISNAN(d_count) && d_count > (double)nelems)) {
+        err = 1;
+    } else {
+        if (d_start < 0)
+            s_start = nelems - (size_t)(-d_start);
+        else
+            s_start = (size_t)d_start;
+        s_stride = (size_t)d_stride;
+        if (ISNAN(d_count)) {
+            /* Read to the end of the variable */
+            s_edge = (nelems - s_start + s_stride - 1) / s_stride;
         } else {
-            return read_cell_array_with_empty_arrays(list, index, matvar);
+            s_edge = (size_t)d_count;
         }
     }
 
-    return 1;
+    PROTECT(list = Rf_allocVector(VECSXP, 1));
+    if (!err)
+        err = read_mat_subset_linear(list, 0, mat, matvar, s_start, s_stride, s_edge);
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+    UNPROTECT(1);
+
+    if (err)
+        Rf_error("Unable to read a range of variable '%s' "
+                 "(check that the range is within the variable).",
+                 CHAR(STRING_ELT(name, 0)));
+
+    return VECTOR_ELT(list, 0);
 }
 
-/*
- * -------------------------------------------------------------
- *   Functions to interface R
- * -------------------------------------------------------------
+/** @brief Names of the matio class types
+ *
+ * Indexed by enum matio_classes.
+ * @ingroup rmatio
  */
+static const char *mat_class_names[] = {
+    "empty", "cell", "struct", "object", "char", "sparse", "double",
+    "single", "int8", "uint8", "int16", "uint16", "int32", "uint32",
+    "int64", "uint64", "function", "opaque"};
 
-/** @brief Number of variables in MAT-file
+/** @brief Grow the columns of the variable directory
  *
  *
  * @ingroup rmatio
- * @param mat MAT file pointer
+ * @param columns The list with the columns
+ * @param n The new length of the columns
  * @return 0 on succes or 1 on failure.
  */
 static int
-number_of_variables(mat_t *mat)
+mat_info_grow(SEXP columns, int n)
 {
-    int len=0;
-    matvar_t *matvar;
+    int i;
 
-    if (mat != NULL) {
-        if (!Mat_Rewind(mat)) {
-            while ((matvar = Mat_VarReadNextInfo(mat)) != NULL) {
-                len++;
-                Mat_VarFree(matvar);
-                matvar = NULL;
-            }
-        }
-    }
+    for (i = 0; i < LENGTH(columns); i++)
+        SET_VECTOR_ELT(columns, i, Rf_lengthgets(VECTOR_ELT(columns, i), n));
 
-    return len;
+    return 0;
 }
 
-/** @brief Read matlab file
- *
+/** @brief List the variables in a matlab file
  *
+ * Only the header of each variable is read, the data and the nested
+ * fields of structures and cell arrays are skipped.
  * @ingroup rmatio
  * @param filename The file to read
- * @return a named list (VECSXP).
+ * @return a named list (VECSXP) with the columns 'name', 'class',
+ * 'dims', 'complex', 'logical', 'global', 'bytes', 'compressed' and
+ * 'offset'.
  */
-SEXP read_mat(const SEXP filename)
+SEXP mat_info(const SEXP filename)
 {
     mat_t *mat = NULL;
     matvar_t *matvar = NULL;
-    int i = 0, n = 0, err = 0;
-    SEXP list, names;
+    int i = 0, j, n = 16;
+    long offset, nbytes;
+    SEXP columns, names;
 
-    const char err_reading_mat_file[] = "Error reading MAT file";
-    const char err_mat_c_empty[] = "Not implemented support to read matio class type MAT_C_EMPTY";
-    const char err_mat_c_object[] = "Not implemented support to read matio class type MAT_C_OBJECT";
-    const char *err_msg = NULL;
+    const char *column_names[] = {"name", "class", "dims", "complex",
+                                  "logical", "global", "bytes",
+                                  "compressed", "offset"};
+    const SEXPTYPE column_types[] = {STRSXP, STRSXP, STRSXP, LGLSXP,
+                                     LGLSXP, LGLSXP, REALSXP, LGLSXP,
+                                     REALSXP};
 
     if (Rf_isNull(filename))
         Rf_error("'filename' equals R_NilValue.");
     if (!Rf_isString(filename))
         Rf_error("'filename' must be a string.");
 
+    PROTECT(columns = Rf_allocVector(VECSXP, 9));
+    PROTECT(names = Rf_allocVector(STRSXP, 9));
+    for (j = 0; j < 9; j++) {
+        SET_VECTOR_ELT(columns, j, Rf_allocVector(column_types[j], n));
+        SET_STRING_ELT(names, j, Rf_mkChar(column_names[j]));
+    }
+    Rf_setAttrib(columns, R_NamesSymbol, names);
+
     mat = Mat_Open(CHAR(STRING_ELT(filename, 0)), MAT_ACC_RDONLY);
-    if (!mat)
+    if (!mat) {
+        UNPROTECT(2);
         Rf_error("Unable to open file.");
+    }
+
+    while ((matvar = Mat_VarReadNextInfoShallow(mat)) != NULL) {
+        if (i == n) {
+            n *= 2;
+            mat_info_grow(columns, n);
+        }
 
-    n = number_of_variables(mat);
-    PROTECT(list = Rf_allocVector(VECSXP, n));
-    PROTECT(names = Rf_allocVector(STRSXP, n));
+        SET_STRING_ELT(VECTOR_ELT(columns, 0), i,
+                       matvar->name == NULL ? NA_STRING : Rf_mkChar(matvar->name));
 
-    if (Mat_Rewind(mat)) {
-        err = 1;
-        err_msg = err_reading_mat_file;
-        goto cleanup;
+        if (matvar->class_type >= MAT_C_EMPTY &&
+            matvar->class_type <= MAT_C_OPAQUE) {
+            SET_STRING_ELT(VECTOR_ELT(columns, 1), i,
+                           Rf_mkChar(mat_class_names[matvar->class_type]));
+        } else {
+            SET_STRING_ELT(VECTOR_ELT(columns, 1), i, NA_STRING);
+        }
+
+        if (matvar->dims != NULL && matvar->rank > 0) {
+            /* Format the dimensions, e.g. "3x4" */
+            const void *vmax = vmaxget();
+            char *dims = R_alloc(matvar->rank * 21 + 1, 1), *p = dims;
+            for (j = 0; j < matvar->rank; j++)
+                p += sprintf(p, j ? "x%lu" : "%lu", (unsigned long)matvar->dims[j]);
+            SET_STRING_ELT(VECTOR_ELT(columns, 2), i, Rf_mkChar(dims));
+            vmaxset(vmax);
+        } else {
+            SET_STRING_ELT(VECTOR_ELT(columns, 2), i, NA_STRING);
+        }
+
+        LOGICAL(VECTOR_ELT(columns, 3))[i] = matvar->isComplex ? 1 : 0;
+        LOGICAL(VECTOR_ELT(columns, 4))[i] = matvar->isLogical ? 1 : 0;
+        LOGICAL(VECTOR_ELT(columns, 5))[i] = matvar->isGlobal ? 1 : 0;
+
+        if (Mat_VarGetFilePos(matvar, &offset, &nbytes)) {
+            REAL(VECTOR_ELT(columns, 6))[i] = NA_REAL;
+            REAL(VECTOR_ELT(columns, 8))[i] = NA_REAL;
+        } else {
+            REAL(VECTOR_ELT(columns, 6))[i] = (double)nbytes;
+            REAL(VECTOR_ELT(columns, 8))[i] = (double)offset;
+        }
+
+        LOGICAL(VECTOR_ELT(columns, 7))[i] =
+            matvar->compression != MAT_COMPRESSION_NONE;
+
+        Mat_VarFree(matvar);
+        matvar = NULL;
+        i++;
     }
 
-    while ((matvar = Mat_VarReadNext(mat)) != NULL) {
-        if (matvar->name != NULL)
-            SET_STRING_ELT(names, i, Rf_mkChar(matvar->name));
+    Mat_Close(mat);
 
-        switch (matvar->class_type) {
-        case MAT_C_EMPTY:
-            err = 1;
-            err_msg = err_mat_c_empty;
-            goto cleanup;
+    if (i < n)
+        mat_info_grow(columns, i);
 
-        case MAT_C_CELL:
-            err = read_mat_cell(list, i, matvar);
-            break;
+    UNPROTECT(2);
 
-        case MAT_C_STRUCT:
-            err = read_mat_struct(list, i, matvar);
-            break;
+    return columns;
+}
 
-        case MAT_C_OBJECT:
-            err = 1;
-            err_msg = err_mat_c_object;
-            goto cleanup;
+/** @brief Set the compression of the variables written to a MAT file
+ *
+ *
+ * @ingroup rmatio
+ * @param mat MAT file pointer
+ * @param compression Write with compression (1), with the level and
+ * strategy of each variable picked automatically (2) or without
+ * compression (0)
+ * @param threads The number of threads to compress variables
+ * @param level The zlib compression level, 0 to 9
+ * @param strategy The zlib compression strategy, see
+ * enum matio_compression_strategy
+ * @return The compression to write the variables with, or -1 on
+ * failure.
+ */
+static int
+set_compression(mat_t *mat,
+                const SEXP compression,
+                const SEXP threads,
+                const SEXP level,
+                const SEXP strategy)
+{
+    if (!INTEGER(compression)[0])
+        return MAT_COMPRESSION_NONE;
+
+    /* 2 picks the level and strategy of each variable */
+    if (Mat_SetCompression(mat,
+            2 == INTEGER(compression)[0] ?
+            MAT_COMPRESSION_LEVEL_AUTO : INTEGER(level)[0],
+            (enum matio_compression_strategy)INTEGER(strategy)[0])) {
+        return -1;
+    }
+    Mat_SetWriteThreads(mat, INTEGER(threads)[0]);
 
-        case MAT_C_CHAR:
-            err = read_mat_char(list, i, matvar);
-            break;
+    return MAT_COMPRESSION_ZLIB;
+}
 
-        case MAT_C_SPARSE:
-            err = read_sparse(list, i, matvar);
-            break;
+/** @brief Check the arguments to set the compression
+ *
+ *
+ * @ingroup rmatio
+ * @param compression The compression, see set_compression
+ * @param threads The number of threads to compress variables
+ * @param level The zlib compression level, 0 to 9
+ * @param strategy The zlib compression strategy
+ */
+static void
+check_compression_args(const SEXP compression,
+                       const SEXP threads,
+                       const SEXP level,
+                       const SEXP strategy)
+{
+    if (Rf_isNull(compression))
+        Rf_error("'compression' equals R_NilValue.");
+    if (!Rf_isInteger(threads) || 1 != LENGTH(threads)
+        || INTEGER(threads)[0] == NA_INTEGER || INTEGER(threads)[0] < 1)
+        Rf_error("'threads' must be a positive integer.");
+    if (!Rf_isInteger(level) || 1 != LENGTH(level)
+        || INTEGER(level)[0] == NA_INTEGER
+        || INTEGER(level)[0] < 0 || INTEGER(level)[0] > 9)
+        Rf_error("'compression_level' must be an integer from 0 to 9.");
+    if (!Rf_isInteger(strategy) || 1 != LENGTH(strategy)
+        || INTEGER(strategy)[0] == NA_INTEGER)
+        Rf_error("'compression_strategy' must be an integer.");
+}
 
-        case MAT_C_DOUBLE:
-        case MAT_C_SINGLE:
-        case MAT_C_INT64:
-        case MAT_C_INT32:
-        case MAT_C_INT16:
-        case MAT_C_INT8:
-        case MAT_C_UINT64:
-        case MAT_C_UINT32:
-        case MAT_C_UINT16:
-        case MAT_C_UINT8:
-            if (matvar->isLogical)
-                err = read_logical(list, i, matvar);
-            else if (matvar->isComplex)
-                err = read_mat_complex(list, i, matvar);
-            else
-                err = read_mat_data(list, i, matvar);
-            break;
+/** @brief Write the variables in a list to a MAT file
+ *
+ *
+ * @ingroup rmatio
+ * @param list List of variables to write
+ * @param mat MAT file pointer
+ * @param types The storage of each variable in the list, see
+ * write_mat
+ * @param compression Write the variables with compression
+ * (MAT_COMPRESSION_ZLIB) or without (MAT_COMPRESSION_NONE)
+ * @return 0 on succes or 1 on failure.
+ */
+static int
+write_list(const SEXP list,
+           mat_t *mat,
+           const SEXP types,
+           int compression)
+{
+    SEXP names;    /* names in list */
 
-        case MAT_C_FUNCTION:
-        case MAT_C_OPAQUE:
-            err = 0;
-            Rf_warning("Function class type read as NULL: %s",
-                       matvar->name == NULL ? "" : matvar->name);
-            break;
+    PROTECT(names = Rf_getAttrib(list, R_NamesSymbol));
 
-        default:
-            err = 1;
-            break;
+    for (int i = 0; i < Rf_length(list); i++) {
+        int err;
+
+        if (NA_INTEGER != INTEGER(types)[i]) {
+            err = write_numeric_as(VECTOR_ELT(list, i),
+                                   mat,
+                                   CHAR(STRING_ELT(names, i)),
+                                   (enum matio_classes)
+                                   (MAT_C_DOUBLE + INTEGER(types)[i]),
+                                   compression);
+        } else {
+            err = write_elmt(VECTOR_ELT(list, i),
+                             mat,
+                             CHAR(STRING_ELT(names, i)),
+                             NULL,
+                             NULL,
+                             0,
+                             0,
+                             0,
+                             compression);
         }
 
         if (err) {
-            err_msg = err_reading_mat_file;
-            goto cleanup;
+            UNPROTECT(1);
+            return 1;
         }
-
-        Mat_VarFree(matvar);
-        matvar = NULL;
-        i++;
     }
 
-    Rf_setAttrib(list, R_NamesSymbol, names);
-
-cleanup:
-    if (matvar)
-        Mat_VarFree(matvar);
-    if (mat)
-        Mat_Close(mat);
-    UNPROTECT(2);
-    if (err)
-        Rf_error(err_msg);
+    UNPROTECT(1);
 
-    return list;
+    return Mat_VarWriteFlush(mat) ? 1 : 0;
 }
 
 /** @brief Write matlab file
@@ -3283,7 +5120,16 @@ cleanup:
  * @param list List of variables to write
  * @param filename Name of MAT file to create
  * @param version MAT file version to create
- * @param compression Write the file with compression or not
+ * @param compression Write the file with compression (1), with the
+ * level and strategy of each variable picked automatically (2) or
+ * without compression (0)
+ * @param threads The number of threads to compress variables
+ * @param level The zlib compression level, 0 to 9
+ * @param strategy The zlib compression strategy, see
+ * enum matio_compression_strategy
+ * @param types The storage of each variable in the list: NA to
+ * write it as is, or 0 (double) to 9 (uint64) to write a numeric
+ * variable as the MAT class MAT_C_DOUBLE + type
  * @return R_NilValue.
  */
 SEXP
@@ -3291,18 +5137,19 @@ write_mat(const SEXP list,
           const SEXP filename,
           const SEXP compression,
           const SEXP version,
-          const SEXP header)
+          const SEXP header,
+          const SEXP threads,
+          const SEXP level,
+          const SEXP strategy,
+          const SEXP types)
 {
-    SEXP names;    /* names in list */
     mat_t *mat;
-    int use_compression = MAT_COMPRESSION_NONE;
+    int use_compression;
 
     if (Rf_isNull(list))
         Rf_error("'list' equals R_NilValue.");
     if (Rf_isNull(filename))
         Rf_error("'filename' equals R_NilValue.");
-    if (Rf_isNull(compression))
-        Rf_error("'compression' equals R_NilValue.");
     if (Rf_isNull(version))
         Rf_error("'version' equals R_NilValue.");
     if (Rf_isNull(header))
@@ -3311,6 +5158,9 @@ write_mat(const SEXP list,
         Rf_error("'list' must be a list.");
     if (!Rf_isString(filename))
         Rf_error("'filename' must be a string.");
+    check_compression_args(compression, threads, level, strategy);
+    if (!Rf_isInteger(types) || Rf_length(list) != LENGTH(types))
+        Rf_error("'types' must be an integer vector with one type per variable.");
 
     mat = Mat_CreateVer(CHAR(STRING_ELT(filename, 0)),
                         CHAR(STRING_ELT(header, 0)),
@@ -3318,37 +5168,231 @@ write_mat(const SEXP list,
     if (!mat)
         Rf_error("Unable to open file.");
 
-    if (INTEGER(compression)[0])
-        use_compression = MAT_COMPRESSION_ZLIB;
+    use_compression = set_compression(mat, compression, threads, level, strategy);
+    if (use_compression < 0) {
+        Mat_Close(mat);
+        Rf_error("Unable to set the compression level and strategy.");
+    }
 
-    PROTECT(names = Rf_getAttrib(list, R_NamesSymbol));
+    if (write_list(list, mat, types, use_compression)) {
+        Mat_Close(mat);
+        Rf_error("Unable to write list");
+    }
 
-    for (int i = 0; i < Rf_length(list); i++) {
-        if (write_elmt(VECTOR_ELT(list, i),
-                       mat,
-                       CHAR(STRING_ELT(names, i)),
-                       NULL,
-                       NULL,
-                       0,
-                       0,
-                       0,
-                       use_compression)) {
-            Mat_Close(mat);
-            Rf_error("Unable to write list");
+    Mat_Close(mat);
+
+    return R_NilValue;
+}
+
+/** @brief Close the MAT file of a writer
+ *
+ * Writes the variables that are being compressed on the writer
+ * threads, then closes the file.
+ * @ingroup rmatio
+ * @param ptr External pointer to the MAT file
+ */
+static void
+mat_writer_finalizer(SEXP ptr)
+{
+    mat_t *mat = (mat_t*)R_ExternalPtrAddr(ptr);
+
+    if (NULL != mat) {
+        R_ClearExternalPtr(ptr);
+        Mat_Close(mat);
+    }
+}
+
+/** @brief Get the MAT file of a writer
+ *
+ *
+ * @ingroup rmatio
+ * @param ptr External pointer to the MAT file
+ * @return MAT file pointer.
+ */
+static mat_t*
+mat_writer_file(const SEXP ptr)
+{
+    mat_t *mat;
+
+    if (EXTPTRSXP != TYPEOF(ptr))
+        Rf_error("'writer' must be an external pointer.");
+    mat = (mat_t*)R_ExternalPtrAddr(ptr);
+    if (NULL == mat)
+        Rf_error("The MAT file is closed.");
+
+    return mat;
+}
+
+/** @brief Open a MAT file to append variables to
+ *
+ * An existing file is opened for appending if it's a version 5 MAT
+ * file with the byte order of the machine, other files are not
+ * changed. A file that doesn't exist, or is empty, is created.
+ * @ingroup rmatio
+ * @param filename Name of MAT file
+ * @param version MAT file version to create
+ * @param header The header of a created MAT file
+ * @param compression Write the variables with compression (1), with
+ * the level and strategy of each variable picked automatically (2)
+ * or without compression (0)
+ * @param threads The number of threads to compress variables
+ * @param level The zlib compression level, 0 to 9
+ * @param strategy The zlib compression strategy, see
+ * enum matio_compression_strategy
+ * @return External pointer to the MAT file. The file is closed by
+ * mat_close, or when the pointer is garbage collected.
+ */
+SEXP
+mat_open(const SEXP filename,
+         const SEXP version,
+         const SEXP header,
+         const SEXP compression,
+         const SEXP threads,
+         const SEXP level,
+         const SEXP strategy)
+{
+    SEXP ptr;
+    mat_t *mat;
+    FILE *fp;
+    size_t n = 0;
+
+    if (!Rf_isString(filename) || 1 != LENGTH(filename))
+        Rf_error("'filename' must be a string.");
+    if (Rf_isNull(version))
+        Rf_error("'version' equals R_NilValue.");
+    if (!Rf_isString(header) || 1 != LENGTH(header))
+        Rf_error("'header' must be a string.");
+    check_compression_args(compression, threads, level, strategy);
+
+    fp = fopen(CHAR(STRING_ELT(filename, 0)), "rb");
+    if (fp) {
+        unsigned char buf[128];
+
+        n = fread(buf, 1, sizeof(buf), fp);
+        fclose(fp);
+
+        /* The version at byte 124 and the endian indicator 'MI' at
+         * byte 126, in the byte order of the machine. */
+        if (n > 0) {
+            mat_uint16_t ver = 0, endian = 0;
+
+            if (n == sizeof(buf)) {
+                memcpy(&ver, buf + 124, sizeof(ver));
+                memcpy(&endian, buf + 126, sizeof(endian));
+            }
+            if (0x0100 != ver || 0x4d49 != endian)
+                Rf_error("Unable to append to '%s': not a version 5 MAT "
+                         "file with the byte order of the machine.",
+                         CHAR(STRING_ELT(filename, 0)));
         }
     }
 
-    Mat_Close(mat);
+    if (n > 0) {
+        mat = Mat_Open(CHAR(STRING_ELT(filename, 0)), MAT_ACC_RDWR);
+    } else {
+        mat = Mat_CreateVer(CHAR(STRING_ELT(filename, 0)),
+                            CHAR(STRING_ELT(header, 0)),
+                            INTEGER(version)[0]);
+    }
+    if (!mat)
+        Rf_error("Unable to open file.");
+
+    PROTECT(ptr = R_MakeExternalPtr(mat, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(ptr, mat_writer_finalizer, TRUE);
+
+    if (set_compression(mat, compression, threads, level, strategy) < 0) {
+        mat_writer_finalizer(ptr);
+        Rf_error("Unable to set the compression level and strategy.");
+    }
+
+    /* Read the names of the variables in the file once, they are
+     * kept up to date as variables are appended. */
+    (void)Mat_GetDir(mat, &n);
 
     UNPROTECT(1);
 
+    return ptr;
+}
+
+/** @brief Append variables to a MAT file opened with mat_open
+ *
+ * The variables are in the file when the function returns. The
+ * names are checked against the variables in the file before any
+ * variable is written.
+ * @ingroup rmatio
+ * @param ptr External pointer to the MAT file
+ * @param list List of variables to write
+ * @param compression Write the variables with compression (non-zero)
+ * or without (0)
+ * @param types The storage of each variable in the list, see
+ * write_mat
+ * @return R_NilValue.
+ */
+SEXP
+mat_append(const SEXP ptr,
+           const SEXP list,
+           const SEXP compression,
+           const SEXP types)
+{
+    SEXP names;    /* names in list */
+    mat_t *mat = mat_writer_file(ptr);
+    char **dir;
+    size_t n = 0;
+
+    if (!Rf_isNewList(list))
+        Rf_error("'list' must be a list.");
+    if (!Rf_isInteger(compression) || 1 != LENGTH(compression))
+        Rf_error("'compression' must be an integer.");
+    if (!Rf_isInteger(types) || Rf_length(list) != LENGTH(types))
+        Rf_error("'types' must be an integer vector with one type per variable.");
+
+    names = Rf_getAttrib(list, R_NamesSymbol);
+    dir = Mat_GetDir(mat, &n);
+    for (int i = 0; i < Rf_length(list); i++) {
+        for (size_t j = 0; j < n; j++) {
+            if (NULL != dir[j] &&
+                0 == strcmp(dir[j], CHAR(STRING_ELT(names, i)))) {
+                Rf_error("Variable '%s' already exists.", dir[j]);
+            }
+        }
+    }
+
+    if (write_list(list,
+                   mat,
+                   types,
+                   INTEGER(compression)[0] ?
+                   MAT_COMPRESSION_ZLIB : MAT_COMPRESSION_NONE)) {
+        Rf_error("Unable to write list");
+    }
+
+    return R_NilValue;
+}
+
+/** @brief Close a MAT file opened with mat_open
+ *
+ *
+ * @ingroup rmatio
+ * @param ptr External pointer to the MAT file
+ * @return R_NilValue.
+ */
+SEXP
+mat_close(const SEXP ptr)
+{
+    mat_writer_finalizer(ptr);
+
     return R_NilValue;
 }
 
 static const R_CallMethodDef callMethods[] =
 {
-    {"read_mat", (DL_FUNC)&read_mat, 1},
-    {"write_mat", (DL_FUNC)&write_mat, 5},
+    {"mat_append", (DL_FUNC)&mat_append, 4},
+    {"mat_close", (DL_FUNC)&mat_close, 1},
+    {"mat_info", (DL_FUNC)&mat_info, 1},
+    {"mat_open", (DL_FUNC)&mat_open, 7},
+    {"read_mat", (DL_FUNC)&read_mat, 6},
+    {"read_mat_range", (DL_FUNC)&read_mat_range, 5},
+    {"read_mat_slab", (DL_FUNC)&read_mat_slab, 5},
+    {"write_mat", (DL_FUNC)&write_mat, 9},
     {NULL, NULL, 0}
 };
 
@@ -3364,4 +5408,7 @@ R_init_rmatio(DllInfo *info)
     R_registerRoutines(info, NULL, callMethods, NULL, NULL);
     R_useDynamicSymbols(info, FALSE);
     R_forceSymbols(info, TRUE);
+#if defined(HAVE_ALTREP)
+    lazy_init(info);
+#endif
 }